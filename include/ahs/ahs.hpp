@@ -0,0 +1,382 @@
+#pragma once
+
+/**
+ * AHS<X> models an approximate hash set over the universe X with the
+ * computational basis
+ *     contains : (AHS<X>, X) -> Bool,
+ * where contains has a false negative rate of zero and a false positive rate
+ * of fpr. Elements of X are given by their serializations.
+ *
+ * There are several data structures (backends) that model AHS<X>, each with
+ * its own trade-offs in space, speed and mutability:
+ *     bloom  : blocked Bloom filter. one cache line per query; supports
+ *              union and intersection by bitwise or and and.
+ *     cuckoo : cuckoo filter. supports deletes, union and intersection;
+ *              smaller than a Bloom filter for low false positive rates.
+ *     fuse   : binary fuse filter. static; the smallest and the fastest.
+ *     count  : count-min sketch. also counts the multiplicity of elements;
+ *              contains(x) := count(x) > 0.
+ *
+ * ahs_image is an AHS file held in memory, which is what the builders
+ * output. approximate_hash_set is a read-only AHS over a memory-mapped AHS
+ * file. It dispatches on the backend recorded in the file's header, so
+ * clients need not know which backend they are querying.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <optional>
+#include <ostream>
+#include <algorithm>
+#include <string_view>
+#include "ahs_hash.hpp"
+#include "ahs_format.hpp"
+#include "blocked_bloom.hpp"
+#include "cuckoo_filter.hpp"
+#include "binary_fuse_filter.hpp"
+#include "count_min.hpp"
+#include "../mapped_file.hpp"
+
+using std::shared_ptr;
+using std::make_shared;
+using std::string;
+using std::string_view;
+using std::vector;
+using std::optional;
+using std::nullopt;
+using std::ostream;
+
+namespace alex::ahs
+{
+    struct ahs_image
+    {
+        ahs_header header;
+        vector<char> payload;
+
+        void write(ostream & out) const
+        {
+            write_ahs(out, header, payload.data(), payload.size());
+        }
+    };
+
+    template <typename T>
+    vector<char> to_bytes(vector<T> const & xs)
+    {
+        vector<char> bytes(xs.size() * sizeof(T));
+        std::memcpy(bytes.data(), xs.data(), bytes.size());
+        return bytes;
+    }
+
+    inline uint64_t element_hash(string_view x, uint64_t seed)
+    {
+        return hash_bytes(x, seed);
+    }
+
+    /**
+     * Builds an AHS over the elements with the hashes hs (duplicates are
+     * allowed) using backend b, with a false positive rate of about fpr.
+     *
+     * The bloom and cuckoo backends are sized for capacity elements (or
+     * the number of elements, if larger). AHS files built with the same
+     * backend, seed and capacity may be merged; see ahs_merge.hpp.
+     */
+    inline optional<ahs_image> build_ahs(
+        ahs_backend b,
+        vector<uint64_t> hs,
+        double fpr,
+        uint64_t seed,
+        uint64_t capacity = 0)
+    {
+        std::sort(hs.begin(), hs.end());
+        hs.erase(std::unique(hs.begin(), hs.end()), hs.end());
+        capacity = std::max<uint64_t>(capacity, hs.size());
+
+        ahs_image img{ahs_header::make(b), {}};
+        img.header.seed = seed;
+        img.header.cardinality = hs.size();
+
+        switch (b)
+        {
+            case ahs_backend::blocked_bloom:
+            {
+                auto f = blocked_bloom_filter::for_fpr(capacity, fpr);
+                for (auto h : hs)
+                    f.insert(h);
+                img.header.params[0] = f.block_count();
+                img.header.params[1] = f.k();
+                img.header.fpr = f.view().estimate_fpr();
+                img.payload = to_bytes(f.bits());
+                return img;
+            }
+
+            case ahs_backend::cuckoo:
+            {
+                // the false positive rate is about 8/2^F at full load.
+                auto build = [&](auto f) -> optional<ahs_image>
+                {
+                    using F = typename decltype(f)::view_type::fingerprint_type;
+                    for (;;)
+                    {
+                        bool ok = true;
+                        for (auto h : hs)
+                            if (!(ok = f.insert(h)))
+                                break;
+                        if (ok)
+                            break;
+                        f = cuckoo_filter<F>(2 * f.bucket_count());
+                    }
+                    img.header.params[0] = f.bucket_count();
+                    img.header.params[1] = f.view().fingerprint_bits;
+                    img.header.fpr = f.view().estimate_fpr();
+                    img.payload = to_bytes(f.table());
+                    return img;
+                };
+                if (fpr >= 8.0 / 256)
+                    return build(cuckoo_filter<uint8_t>::for_size(capacity));
+                return build(cuckoo_filter<uint16_t>::for_size(capacity));
+            }
+
+            case ahs_backend::binary_fuse:
+            {
+                auto build = [&](auto f) -> optional<ahs_image>
+                {
+                    if (!f)
+                        return nullopt;
+                    img.header.params[0] = f->layout().seed;
+                    img.header.params[1] = f->layout().segment_length;
+                    img.header.params[2] = f->layout().segment_count;
+                    img.header.params[3] = f->view().fingerprint_bits;
+                    img.header.fpr = f->view().estimate_fpr();
+                    img.payload = to_bytes(f->array());
+                    return img;
+                };
+                if (fpr >= 1.0 / 256)
+                    return build(binary_fuse_filter<uint8_t>::build(hs));
+                return build(binary_fuse_filter<uint16_t>::build(hs));
+            }
+
+            case ahs_backend::count_min:
+                // counts need the multiplicities; see build_count_min.
+                return nullopt;
+        }
+        return nullopt;
+    }
+
+    /**
+     * Builds a count-min sketch over the elements with the hashes hs, where
+     * the multiplicity of an element is the number of times its hash occurs
+     * in hs. Counts exceed the multiplicity by more than epsilon |hs| with
+     * probability at most 1/e, and typically far less (see count_min.hpp).
+     */
+    inline ahs_image build_count_min(vector<uint64_t> const & hs, double epsilon, uint64_t seed)
+    {
+        auto cm = count_min_sketch::for_error(epsilon);
+        cm.add(hs.data(), hs.size());
+
+        ahs_image img{ahs_header::make(ahs_backend::count_min), {}};
+        img.header.seed = seed;
+        img.header.cardinality = static_cast<uint64_t>(std::llround(cm.view().estimate_cardinality()));
+        img.header.flags |= ahs_header::estimated_cardinality;
+        img.header.fpr = cm.view().estimate_fpr();
+        img.header.params[0] = cm.block_count();
+        img.header.params[1] = count_min_view::depth;
+        img.header.params[2] = 32;
+        img.header.total = hs.size();
+        img.payload = to_bytes(cm.counters());
+        return img;
+    }
+
+    class approximate_hash_set
+    {
+    public:
+        // opens the AHS file, or returns nullopt if it is not a valid AHS file.
+        static optional<approximate_hash_set> open(string const & filename)
+        {
+            auto f = make_shared<mapped_file>();
+            if (!f->open(filename))
+                return nullopt;
+
+            auto h = read_header(f->data(), f->size());
+            if (!h)
+                return nullopt;
+
+            auto s = make_view(*h, f->data() + sizeof(ahs_header));
+            if (!s)
+                return nullopt;
+
+            f->advise(MADV_RANDOM);
+            return approximate_hash_set(*h, f, s);
+        }
+
+        bool contains(string_view x) const
+        {
+            return s_->contains(element_hash(x, header_.seed));
+        }
+
+        // batched membership queries, out[i] := contains(xs[i]).
+        void contains(string_view const * xs, size_t n, bool * out) const
+        {
+            constexpr size_t batch = 256;
+            uint64_t hs[batch];
+            for (size_t i = 0; i < n; i += batch)
+            {
+                size_t const m = std::min(batch, n - i);
+                for (size_t j = 0; j < m; ++j)
+                    hs[j] = element_hash(xs[i + j], header_.seed);
+                s_->contains(hs, m, out + i);
+            }
+        }
+
+        ahs_header const & header() const { return header_; }
+        ahs_backend backend() const { return header_.type(); }
+        double tpr() const { return header_.tpr; }
+
+        // the number of elements and the false positive rate, as recorded
+        // in the header at build (or merge) time. O(1).
+        uint64_t cardinality() const { return header_.cardinality; }
+        double fpr() const { return header_.fpr; }
+
+        // whether cardinality() is an estimate rather than the
+        // exact number of elements.
+        bool cardinality_estimated() const
+        {
+            return header_.has(ahs_header::estimated_cardinality);
+        }
+
+        // estimates of the number of elements and the false positive rate
+        // computed from the payload, i.e., O(size of the AHS), though they
+        // only scan the payload (e.g., a popcount of a Bloom filter's bit
+        // array) rather than deserialize it.
+        double estimate_cardinality() const
+        {
+            if (auto n = s_->estimate_cardinality())
+                return *n;
+            return double(header_.cardinality);
+        }
+
+        double estimate_fpr() const { return s_->estimate_fpr(); }
+
+        // the counts of a counting backend (count), or nullopt.
+        optional<count_min_view> counts() const
+        {
+            if (backend() != ahs_backend::count_min)
+                return nullopt;
+            return count_min_view{reinterpret_cast<uint32_t const *>(payload()), header_.params[0]};
+        }
+
+        // the hash of x in this AHS, e.g., to query counts().
+        uint64_t hash(string_view x) const { return element_hash(x, header_.seed); }
+        char const * payload() const { return file_->data() + sizeof(ahs_header); }
+
+        // a copy of the AHS file in memory.
+        ahs_image image() const
+        {
+            return ahs_image{header_, vector<char>(payload(), payload() + header_.payload_size)};
+        }
+
+    private:
+        struct concept_type
+        {
+            virtual ~concept_type() = default;
+            virtual bool contains(uint64_t h) const = 0;
+            virtual void contains(uint64_t const * hs, size_t n, bool * out) const = 0;
+            virtual optional<double> estimate_cardinality() const = 0;
+            virtual double estimate_fpr() const = 0;
+        };
+
+        template <typename V>
+        struct model final : concept_type
+        {
+            explicit model(V v) : v(v) {}
+            bool contains(uint64_t h) const override { return v.contains(h); }
+            void contains(uint64_t const * hs, size_t n, bool * out) const override
+            {
+                v.contains(hs, n, out);
+            }
+
+            // a static backend (fuse) is always built from its elements,
+            // so its header records its cardinality exactly.
+            optional<double> estimate_cardinality() const override
+            {
+                if constexpr (requires { v.estimate_cardinality(); })
+                    return v.estimate_cardinality();
+                else
+                    return nullopt;
+            }
+
+            double estimate_fpr() const override { return v.estimate_fpr(); }
+
+            V v;
+        };
+
+        template <typename V>
+        static shared_ptr<concept_type const> erase(V v, size_t payload_size, size_t expected)
+        {
+            if (payload_size != expected)
+                return nullptr;
+            return make_shared<model<V>>(v);
+        }
+
+        static shared_ptr<concept_type const> make_view(ahs_header const & h, char const * p)
+        {
+            switch (h.type())
+            {
+                case ahs_backend::blocked_bloom:
+                {
+                    if (h.params[0] == 0)
+                        return nullptr;
+                    blocked_bloom_view v{reinterpret_cast<uint64_t const *>(p),
+                        h.params[0], static_cast<uint32_t>(h.params[1])};
+                    return erase(v, h.payload_size, v.word_count() * sizeof(uint64_t));
+                }
+
+                case ahs_backend::cuckoo:
+                {
+                    if (h.params[0] == 0 || (h.params[0] & (h.params[0] - 1)) != 0)
+                        return nullptr;
+                    if (h.params[1] == 8)
+                        return erase(cuckoo_view<uint8_t>{reinterpret_cast<uint8_t const *>(p),
+                            h.params[0]}, h.payload_size, h.params[0] * 4);
+                    if (h.params[1] == 16)
+                        return erase(cuckoo_view<uint16_t>{reinterpret_cast<uint16_t const *>(p),
+                            h.params[0]}, h.payload_size, h.params[0] * 4 * 2);
+                    return nullptr;
+                }
+
+                case ahs_backend::binary_fuse:
+                {
+                    binary_fuse_layout l{h.params[0], static_cast<uint32_t>(h.params[1]),
+                        static_cast<uint32_t>(h.params[2])};
+                    if (l.segment_length == 0 || (l.segment_length & (l.segment_length - 1)) != 0)
+                        return nullptr;
+                    if (h.params[3] == 8)
+                        return erase(binary_fuse_view<uint8_t>{reinterpret_cast<uint8_t const *>(p), l},
+                            h.payload_size, l.array_length());
+                    if (h.params[3] == 16)
+                        return erase(binary_fuse_view<uint16_t>{reinterpret_cast<uint16_t const *>(p), l},
+                            h.payload_size, l.array_length() * 2);
+                    return nullptr;
+                }
+
+                case ahs_backend::count_min:
+                {
+                    if (h.params[0] == 0 || h.params[1] != count_min_view::depth || h.params[2] != 32)
+                        return nullptr;
+                    count_min_view v{reinterpret_cast<uint32_t const *>(p), h.params[0]};
+                    return erase(v, h.payload_size, v.counter_count() * sizeof(uint32_t));
+                }
+            }
+            return nullptr;
+        }
+
+        approximate_hash_set(
+            ahs_header h,
+            shared_ptr<mapped_file const> f,
+            shared_ptr<concept_type const> s) : header_(h), file_(f), s_(s) {}
+
+        ahs_header header_;
+        shared_ptr<mapped_file const> file_;
+        shared_ptr<concept_type const> s_;
+    };
+}
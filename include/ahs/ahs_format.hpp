@@ -0,0 +1,165 @@
+#pragma once
+
+/**
+ * Binary file format of an approximate hash set AHS<X>.
+ *
+ * An AHS file is a fixed-size header followed by a backend-specific payload:
+ * ---
+ * ahs_header (128 bytes)
+ * payload    (header.payload_size bytes)
+ *
+ * The header records which backend (data structure) the payload models, so
+ * that programs like ahs_contains dispatch on the file rather than on the
+ * command line. The header is 128 bytes so that the payload of a mapped file
+ * is cache-line aligned.
+ *
+ * All integers are stored little-endian.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <ostream>
+#include <string_view>
+
+using std::uint32_t;
+using std::uint64_t;
+using std::size_t;
+using std::optional;
+using std::nullopt;
+using std::ostream;
+using std::string_view;
+
+namespace alex::ahs
+{
+    enum class ahs_backend : uint32_t
+    {
+        // a Bloom filter partitioned into cache-line sized blocks. one cache
+        // line per query. supports union and intersection, not deletes.
+        blocked_bloom = 1,
+
+        // a cuckoo filter with buckets of four fingerprints. supports deletes.
+        cuckoo = 2,
+
+        // a static 3-wise binary fuse filter. the smallest and fastest of the
+        // three, but it must be rebuilt to change the set.
+        binary_fuse = 3,
+
+        // a count-min sketch. models a multiset, i.e., it also counts the
+        // (approximate) multiplicity of an element.
+        count_min = 4
+    };
+
+    inline char const * backend_name(ahs_backend b)
+    {
+        switch (b)
+        {
+            case ahs_backend::blocked_bloom: return "bloom";
+            case ahs_backend::cuckoo: return "cuckoo";
+            case ahs_backend::binary_fuse: return "fuse";
+            case ahs_backend::count_min: return "count";
+        }
+        return "unknown";
+    }
+
+    inline optional<ahs_backend> backend_from_name(string_view name)
+    {
+        if (name == "bloom")
+            return ahs_backend::blocked_bloom;
+        if (name == "cuckoo")
+            return ahs_backend::cuckoo;
+        if (name == "fuse")
+            return ahs_backend::binary_fuse;
+        if (name == "count")
+            return ahs_backend::count_min;
+        return nullopt;
+    }
+
+    struct ahs_header
+    {
+        static constexpr char const * magic_bytes() { return "AHS\x1a\0\0\0"; }
+        static constexpr uint32_t current_version() { return 1; }
+
+        enum flag : uint32_t
+        {
+            // cardinality is an estimate (e.g., the AHS is a merge of other
+            // AHS) rather than the exact number of elements.
+            estimated_cardinality = 1
+        };
+
+        char magic[8];
+        uint32_t version;
+        uint32_t backend;
+
+        // seed of the element hash, hash_bytes(x, seed).
+        uint64_t seed;
+
+        // the number of distinct elements in the set.
+        uint64_t cardinality;
+
+        // the false positive rate of contains.
+        double fpr;
+
+        // backend-specific parameters, e.g., the number of blocks and the
+        // number of hash functions of a blocked Bloom filter.
+        uint64_t params[4];
+
+        uint64_t payload_size;
+
+        // the true positive rate of contains, i.e., 1 - fnr.
+        double tpr;
+
+        uint32_t flags;
+        uint32_t reserved0;
+
+        // the total count N of a counting AHS (the sum of the
+        // multiplicities), which, unlike params, may differ between AHS
+        // that can be merged.
+        uint64_t total;
+
+        uint64_t reserved[3];
+
+        static ahs_header make(ahs_backend b)
+        {
+            ahs_header h;
+            std::memset(&h, 0, sizeof(h));
+            std::memcpy(h.magic, magic_bytes(), sizeof(h.magic));
+            h.version = current_version();
+            h.backend = static_cast<uint32_t>(b);
+            h.tpr = 1;
+            return h;
+        }
+
+        ahs_backend type() const { return static_cast<ahs_backend>(backend); }
+
+        bool has(flag f) const { return (flags & f) != 0; }
+
+        bool valid() const
+        {
+            return std::memcmp(magic, magic_bytes(), sizeof(magic)) == 0 &&
+                   version == current_version();
+        }
+    };
+
+    static_assert(sizeof(ahs_header) == 128);
+
+    // reads the header at the front of the bytes [data, data+size), if any.
+    inline optional<ahs_header> read_header(char const * data, size_t size)
+    {
+        if (size < sizeof(ahs_header))
+            return nullopt;
+
+        ahs_header h;
+        std::memcpy(&h, data, sizeof(h));
+        if (!h.valid() || h.payload_size > size - sizeof(ahs_header))
+            return nullopt;
+        return h;
+    }
+
+    inline void write_ahs(ostream & out, ahs_header h, void const * payload, size_t n)
+    {
+        h.payload_size = n;
+        out.write(reinterpret_cast<char const *>(&h), sizeof(h));
+        out.write(static_cast<char const *>(payload), static_cast<std::streamsize>(n));
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+/**
+ * Hashing for approximate hash sets (AHS).
+ *
+ * An AHS file is persisted and queried by other programs, possibly built by
+ * a different compiler, so we cannot use std::hash (its values are
+ * implementation-defined). Elements of an AHS<X> are serializations of
+ * values of type X, so we only ever need to hash byte strings.
+ *
+ * hash_bytes is a simple multiply-rotate hash over 8-byte words followed by
+ * a strong finalizer. It is not a cryptographic hash; the seed only
+ * decorrelates the hash functions of different sets.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+using std::uint64_t;
+using std::size_t;
+using std::string_view;
+
+namespace alex::ahs
+{
+    // the finalizer of MurmurHash3. every input bit affects every output bit.
+    constexpr uint64_t mix64(uint64_t x)
+    {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    constexpr uint64_t rotl64(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    // maps a uniform 64-bit hash h onto [0,n) without a division.
+    inline uint64_t reduce(uint64_t h, uint64_t n)
+    {
+        return static_cast<uint64_t>((static_cast<unsigned __int128>(h) * n) >> 64);
+    }
+
+    // little-endian load of 1 to 8 bytes.
+    inline uint64_t load_le(char const * p, size_t n)
+    {
+        uint64_t x = 0;
+        for (size_t i = 0; i < n; ++i)
+            x |= static_cast<uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+        return x;
+    }
+
+    inline uint64_t load_le64(char const * p)
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        uint64_t x;
+        std::memcpy(&x, p, sizeof(x));
+        return x;
+#else
+        return load_le(p, 8);
+#endif
+    }
+
+    inline uint64_t hash_bytes(string_view s, uint64_t seed = 0)
+    {
+        constexpr uint64_t m = 0x9fb21c651e98df25ULL;
+        uint64_t h = seed ^ (s.size() * 0x9e3779b97f4a7c15ULL);
+
+        char const * p = s.data();
+        size_t n = s.size();
+        for (; n >= 8; p += 8, n -= 8)
+            h = rotl64(h ^ (load_le64(p) * m), 29) * m;
+        if (n != 0)
+            h = rotl64(h ^ (load_le(p, n) * m), 29) * m;
+
+        return mix64(h);
+    }
+}
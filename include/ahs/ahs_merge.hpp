@@ -0,0 +1,201 @@
+#pragma once
+
+/**
+ * Union and intersection of approximate hash sets,
+ *     union     : (AHS<X>, AHS<X>) -> AHS<X>,
+ *     intersect : (AHS<X>, AHS<X>) -> AHS<X>,
+ * computed from the AHS files directly rather than rebuilt from the
+ * elements.
+ *
+ * Two AHS are compatible if they have the same backend, element hash seed
+ * and parameters (size), i.e., if an element maps to the same bits or
+ * buckets in both. Then:
+ *
+ *     bloom  : union is the bitwise-or of the bit arrays, intersection is
+ *              the bitwise-and. The union is exactly the filter that
+ *              inserting the union of the elements would have built. The
+ *              intersection is not: an element of A but not of B is a
+ *              false positive with about the false positive rate of B,
+ *              which is higher than the rate recorded (the rate for
+ *              elements of neither A nor B).
+ *     cuckoo : a streaming merge, bucket by bucket. union inserts each
+ *              fingerprint of the second filter into the first unless it is
+ *              already in one of its two buckets; intersection keeps only
+ *              the fingerprints of the first that are in the second.
+ *     fuse   : static, so it must be rebuilt from the elements.
+ *     count  : union (of multisets) adds the counters, intersection takes
+ *              their minimum. both are again upper bounds on the counts.
+ *
+ * In each case, the false positive rate of the result is recomputed from
+ * its bits (fill or load) rather than combined from the inputs' rates.
+ *
+ * The cardinality of the result is not known without the elements, so we
+ * record an estimate computed from the result (see estimate_cardinality)
+ * and flag it as such.
+ */
+
+#include <string>
+#include <optional>
+#include <cmath>
+#include <algorithm>
+#include "ahs.hpp"
+#include "bitwise.hpp"
+
+using std::string;
+using std::optional;
+using std::nullopt;
+
+namespace alex::ahs
+{
+    enum class merge_op { set_union, set_intersection };
+
+    // why a and b may not be merged, or nullopt if they may.
+    inline optional<string> merge_incompatibility(ahs_header const & a, ahs_header const & b)
+    {
+        if (a.backend != b.backend)
+            return string("different backends (") + backend_name(a.type()) +
+                   " and " + backend_name(b.type()) + ")";
+        if (a.type() == ahs_backend::binary_fuse)
+            return string("fuse sets are static; rebuild from the elements");
+        if (a.seed != b.seed)
+            return string("different element hash seeds");
+        if (!std::equal(a.params, a.params + 4, b.params) || a.payload_size != b.payload_size)
+            return string("different parameters; rebuild one with the size of the other");
+        return nullopt;
+    }
+
+    namespace detail
+    {
+        template <typename F>
+        optional<string> merge_cuckoo(ahs_image & acc, char const * payload, merge_op op)
+        {
+            using view_type = cuckoo_view<F>;
+            uint64_t const buckets = acc.header.params[0];
+            view_type const b{reinterpret_cast<F const *>(payload), buckets};
+            cuckoo_filter<F> a(view_type{reinterpret_cast<F const *>(acc.payload.data()), buckets});
+
+            if (op == merge_op::set_union)
+            {
+                for (uint64_t i = 0; i < buckets; ++i)
+                {
+                    for (size_t j = 0; j < view_type::bucket_size; ++j)
+                    {
+                        F f = b.table[i * view_type::bucket_size + j];
+                        if (f == 0)
+                            continue;
+
+                        auto v = a.view();
+                        if (v.bucket_has(i, f) || v.bucket_has(v.alt_index(i, f), f))
+                            continue;
+                        if (!a.insert_fingerprint(i, f))
+                            return string("the union does not fit; rebuild with more buckets");
+                    }
+                }
+            }
+            else
+            {
+                auto const & t = a.table();
+                for (uint64_t i = 0; i < buckets; ++i)
+                {
+                    for (size_t j = 0; j < view_type::bucket_size; ++j)
+                    {
+                        F f = t[i * view_type::bucket_size + j];
+                        if (f != 0 && !b.bucket_has(i, f) && !b.bucket_has(b.alt_index(i, f), f))
+                            a.erase_fingerprint(i, f);
+                    }
+                }
+            }
+
+            acc.payload = to_bytes(a.table());
+            acc.header.fpr = a.view().estimate_fpr();
+            acc.header.cardinality = static_cast<uint64_t>(a.view().estimate_cardinality());
+            return nullopt;
+        }
+    }
+
+    /**
+     * acc := op(acc, b). Returns why the merge failed, or nullopt on
+     * success. acc is unchanged on failure.
+     */
+    inline optional<string> merge_into(ahs_image & acc, approximate_hash_set const & b, merge_op op)
+    {
+        if (auto why = merge_incompatibility(acc.header, b.header()))
+            return why;
+
+        switch (acc.header.type())
+        {
+            case ahs_backend::blocked_bloom:
+            {
+                auto * dst = reinterpret_cast<uint64_t *>(acc.payload.data());
+                auto const * src = reinterpret_cast<uint64_t const *>(b.payload());
+                size_t const n = acc.payload.size() / sizeof(uint64_t);
+                if (op == merge_op::set_union)
+                    bitwise_or(dst, src, n);
+                else
+                    bitwise_and(dst, src, n);
+
+                blocked_bloom_view v{dst, acc.header.params[0],
+                    static_cast<uint32_t>(acc.header.params[1])};
+                acc.header.fpr = v.estimate_fpr();
+                acc.header.cardinality = static_cast<uint64_t>(std::llround(v.estimate_cardinality()));
+                break;
+            }
+
+            case ahs_backend::cuckoo:
+            {
+                auto why = acc.header.params[1] == 8 ?
+                    detail::merge_cuckoo<uint8_t>(acc, b.payload(), op) :
+                    detail::merge_cuckoo<uint16_t>(acc, b.payload(), op);
+                if (why)
+                    return why;
+                break;
+            }
+
+            case ahs_backend::binary_fuse:
+                return string("fuse sets are static");
+
+            case ahs_backend::count_min:
+            {
+                auto * dst = reinterpret_cast<uint32_t *>(acc.payload.data());
+                auto const * src = reinterpret_cast<uint32_t const *>(b.payload());
+                size_t const n = acc.payload.size() / sizeof(uint32_t);
+                if (op == merge_op::set_union)
+                {
+                    for (size_t i = 0; i < n; ++i)
+                        dst[i] = dst[i] > UINT32_MAX - src[i] ? UINT32_MAX : dst[i] + src[i];
+                    acc.header.total += b.header().total;
+                }
+                else
+                {
+                    for (size_t i = 0; i < n; ++i)
+                        dst[i] = std::min(dst[i], src[i]);
+                    acc.header.total = std::min(acc.header.total, b.header().total);
+                }
+
+                count_min_view v{dst, acc.header.params[0]};
+                acc.header.fpr = v.estimate_fpr();
+                acc.header.cardinality = static_cast<uint64_t>(std::llround(v.estimate_cardinality()));
+                break;
+            }
+        }
+
+        acc.header.flags |= ahs_header::estimated_cardinality;
+        return nullopt;
+    }
+
+    inline optional<ahs_image> ahs_union(approximate_hash_set const & a, approximate_hash_set const & b)
+    {
+        auto acc = a.image();
+        if (merge_into(acc, b, merge_op::set_union))
+            return nullopt;
+        return acc;
+    }
+
+    inline optional<ahs_image> ahs_intersect(approximate_hash_set const & a, approximate_hash_set const & b)
+    {
+        auto acc = a.image();
+        if (merge_into(acc, b, merge_op::set_intersection))
+            return nullopt;
+        return acc;
+    }
+}
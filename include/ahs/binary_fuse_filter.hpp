@@ -0,0 +1,251 @@
+#pragma once
+
+/**
+ * A 3-wise binary fuse filter (Graf and Lemire, 2022).
+ *
+ * An element with hash h maps to three positions h0, h1, h2 in an array of
+ * fingerprints, chosen from three consecutive segments of the array, and
+ *     contains(h) := A[h0] xor A[h1] xor A[h2] == fingerprint(h).
+ * The array is constructed by peeling: repeatedly remove an element that
+ * is the only one mapped to some position, then assign the positions in
+ * the reverse order of removal. The filter uses about 1.13 F bits per
+ * element for fingerprints of F bits, and the false positive rate is 2^-F.
+ *
+ * The filter is static; to change the set, it must be rebuilt.
+ *
+ * binary_fuse_layout and peel are also useful on their own: any value may
+ * be stored in place of a fingerprint, which gives a static function (a
+ * retrieval data structure) from the keys to the values.
+ */
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <algorithm>
+#include <utility>
+#include "ahs_hash.hpp"
+
+using std::vector;
+using std::optional;
+using std::nullopt;
+using std::pair;
+using std::uint64_t;
+using std::uint32_t;
+using std::uint8_t;
+using std::size_t;
+
+namespace alex::ahs
+{
+    struct binary_fuse_layout
+    {
+        uint64_t seed;
+        uint32_t segment_length;
+        uint32_t segment_count;
+
+        static binary_fuse_layout for_size(uint64_t n, uint64_t seed)
+        {
+            constexpr uint32_t arity = 3;
+            double const size = double(std::max<uint64_t>(n, 2));
+
+            binary_fuse_layout l;
+            l.seed = seed;
+            l.segment_length = n == 0 ? 4 : uint32_t(1) << int(std::floor(
+                std::log(size) / std::log(3.33) + 2.25));
+            l.segment_length = std::min<uint32_t>(l.segment_length, 1 << 18);
+
+            double factor = std::max(1.125, 0.875 + 0.25 * std::log(1e6) / std::log(size));
+            uint64_t capacity = static_cast<uint64_t>(std::round(size * factor));
+            uint64_t segments = (capacity + l.segment_length - 1) / l.segment_length;
+            l.segment_count = segments <= arity - 1 ? 1 : uint32_t(segments - (arity - 1));
+            return l;
+        }
+
+        uint64_t segment_count_length() const
+        {
+            return uint64_t(segment_count) * segment_length;
+        }
+
+        uint64_t array_length() const
+        {
+            return uint64_t(segment_count + 2) * segment_length;
+        }
+
+        // the hash of an element as seen by this layout; rebuilding with a
+        // new seed redraws the positions of every element.
+        uint64_t rehash(uint64_t h) const { return mix64(h + seed); }
+
+        // the three positions of a (rehashed) element.
+        void positions(uint64_t h, uint64_t p[3]) const
+        {
+            uint64_t const mask = segment_length - 1;
+            p[0] = reduce(h, segment_count_length());
+            p[1] = (p[0] + segment_length) ^ ((h >> 18) & mask);
+            p[2] = (p[0] + 2 * uint64_t(segment_length)) ^ (h & mask);
+        }
+    };
+
+    /**
+     * Peels the (rehashed, distinct) hashes hs under layout l. On success,
+     * returns pairs (h, j) in the order in which values must be assigned:
+     * position j of h is not referenced by any element assigned after it.
+     * Fails (rarely) if the hypergraph has a 2-core, in which case the
+     * caller should retry with another seed.
+     */
+    inline optional<vector<pair<uint64_t,uint8_t>>> peel(
+        binary_fuse_layout const & l,
+        vector<uint64_t> const & hs)
+    {
+        uint64_t const m = l.array_length();
+        vector<uint32_t> count(m, 0);
+        vector<uint64_t> xors(m, 0);
+
+        uint64_t p[3];
+        for (auto h : hs)
+        {
+            l.positions(h, p);
+            for (int i = 0; i < 3; ++i)
+            {
+                ++count[p[i]];
+                xors[p[i]] ^= h;
+            }
+        }
+
+        vector<uint64_t> queue;
+        for (uint64_t i = 0; i < m; ++i)
+            if (count[i] == 1)
+                queue.push_back(i);
+
+        vector<pair<uint64_t,uint8_t>> order;
+        order.reserve(hs.size());
+        while (!queue.empty())
+        {
+            uint64_t i = queue.back();
+            queue.pop_back();
+            if (count[i] != 1)
+                continue;
+
+            uint64_t h = xors[i];
+            l.positions(h, p);
+            uint8_t j = p[0] == i ? 0 : (p[1] == i ? 1 : 2);
+            order.emplace_back(h, j);
+            for (int k = 0; k < 3; ++k)
+            {
+                --count[p[k]];
+                xors[p[k]] ^= h;
+                if (count[p[k]] == 1)
+                    queue.push_back(p[k]);
+            }
+        }
+
+        if (order.size() != hs.size())
+            return nullopt;
+
+        std::reverse(order.begin(), order.end());
+        return order;
+    }
+
+    template <typename F>
+    struct binary_fuse_view
+    {
+        using fingerprint_type = F;
+        static constexpr uint32_t fingerprint_bits = 8 * sizeof(F);
+
+        F const * array;
+        binary_fuse_layout layout;
+
+        static F fingerprint(uint64_t h)
+        {
+            return static_cast<F>(h ^ (h >> 32));
+        }
+
+        bool contains(uint64_t h) const
+        {
+            h = layout.rehash(h);
+            uint64_t p[3];
+            layout.positions(h, p);
+            return F(array[p[0]] ^ array[p[1]] ^ array[p[2]]) == fingerprint(h);
+        }
+
+        void contains(uint64_t const * hs, size_t n, bool * out) const
+        {
+            constexpr size_t group = 16;
+            uint64_t p[group][3];
+            for (size_t i = 0; i < n; i += group)
+            {
+                size_t const m = std::min(group, n - i);
+                for (size_t j = 0; j < m; ++j)
+                {
+                    layout.positions(layout.rehash(hs[i + j]), p[j]);
+                    for (int k = 0; k < 3; ++k)
+                        __builtin_prefetch(array + p[j][k]);
+                }
+                for (size_t j = 0; j < m; ++j)
+                {
+                    F f = array[p[j][0]] ^ array[p[j][1]] ^ array[p[j][2]];
+                    out[i + j] = f == fingerprint(layout.rehash(hs[i + j]));
+                }
+            }
+        }
+
+        double estimate_fpr() const
+        {
+            return std::ldexp(1.0, -int(fingerprint_bits));
+        }
+    };
+
+    template <typename F>
+    class binary_fuse_filter
+    {
+    public:
+        using view_type = binary_fuse_view<F>;
+
+        // builds the filter for the element hashes hs. duplicates are
+        // allowed. returns nullopt only if the construction fails for
+        // every seed tried, which in practice does not happen.
+        static optional<binary_fuse_filter> build(vector<uint64_t> hs)
+        {
+            std::sort(hs.begin(), hs.end());
+            hs.erase(std::unique(hs.begin(), hs.end()), hs.end());
+
+            vector<uint64_t> rs(hs.size());
+            for (uint64_t seed = 1; seed <= 100; ++seed)
+            {
+                auto l = binary_fuse_layout::for_size(hs.size(), seed * 0x9e3779b97f4a7c15ULL);
+                for (size_t i = 0; i < hs.size(); ++i)
+                    rs[i] = l.rehash(hs[i]);
+
+                auto order = peel(l, rs);
+                if (!order)
+                    continue;
+
+                binary_fuse_filter f(l, hs.size());
+                uint64_t p[3];
+                for (auto [h, j] : *order)
+                {
+                    l.positions(h, p);
+                    f.array_[p[j]] = view_type::fingerprint(h) ^
+                        f.array_[p[(j + 1) % 3]] ^ f.array_[p[(j + 2) % 3]];
+                }
+                return f;
+            }
+            return nullopt;
+        }
+
+        bool contains(uint64_t h) const { return view().contains(h); }
+
+        view_type view() const { return view_type{array_.data(), layout_}; }
+
+        binary_fuse_layout const & layout() const { return layout_; }
+        vector<F> const & array() const { return array_; }
+        uint64_t size() const { return size_; }
+
+    private:
+        binary_fuse_filter(binary_fuse_layout l, uint64_t n) :
+            layout_(l), array_(l.array_length(), 0), size_(n) {}
+
+        binary_fuse_layout layout_;
+        vector<F> array_;
+        uint64_t size_;
+    };
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+/**
+ * Bulk bitwise operations over word arrays, e.g., the bit arrays of Bloom
+ * filters. These are memory-bound, so we process a full vector register
+ * per instruction when the target supports it (AVX2, or SSE2, which every
+ * x86-64 target has) and fall back to 64-bit words otherwise.
+ */
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using std::uint64_t;
+using std::uint16_t;
+using std::size_t;
+
+namespace alex::ahs
+{
+    // dst[i] := dst[i] | src[i], for i in [0,n).
+    inline void bitwise_or(uint64_t * dst, uint64_t const * src, size_t n)
+    {
+        size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(dst + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_or_si256(a, b));
+        }
+#elif defined(__SSE2__)
+        for (; i + 2 <= n; i += 2)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const *>(dst + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_or_si128(a, b));
+        }
+#endif
+        for (; i < n; ++i)
+            dst[i] |= src[i];
+    }
+
+    // dst[i] := dst[i] & src[i], for i in [0,n).
+    inline void bitwise_and(uint64_t * dst, uint64_t const * src, size_t n)
+    {
+        size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(dst + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_and_si256(a, b));
+        }
+#elif defined(__SSE2__)
+        for (; i + 2 <= n; i += 2)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const *>(dst + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_and_si128(a, b));
+        }
+#endif
+        for (; i < n; ++i)
+            dst[i] &= src[i];
+    }
+
+#if defined(__AVX2__)
+    namespace detail
+    {
+        // the number of set bits in each byte of v, by a 4-bit table lookup
+        // (Mula's algorithm), summed into the four 64-bit lanes.
+        inline __m256i popcount_lanes(__m256i v)
+        {
+            __m256i const table = _mm256_setr_epi8(
+                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+            __m256i const low = _mm256_set1_epi8(0x0f);
+            __m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(v, low));
+            __m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+            return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+        }
+
+        inline uint64_t horizontal_sum(__m256i v)
+        {
+            return static_cast<uint64_t>(_mm256_extract_epi64(v, 0)) +
+                   static_cast<uint64_t>(_mm256_extract_epi64(v, 1)) +
+                   static_cast<uint64_t>(_mm256_extract_epi64(v, 2)) +
+                   static_cast<uint64_t>(_mm256_extract_epi64(v, 3));
+        }
+    }
+#endif
+
+    // the number of set bits in words[0,n).
+    inline uint64_t popcount(uint64_t const * words, size_t n)
+    {
+        uint64_t c = 0;
+        size_t i = 0;
+#if defined(__AVX2__)
+        __m256i acc = _mm256_setzero_si256();
+        for (; i + 4 <= n; i += 4)
+            acc = _mm256_add_epi64(acc, detail::popcount_lanes(
+                _mm256_loadu_si256(reinterpret_cast<__m256i const *>(words + i))));
+        c = detail::horizontal_sum(acc);
+#endif
+        for (; i < n; ++i)
+            c += static_cast<uint64_t>(__builtin_popcountll(words[i]));
+        return c;
+    }
+
+    // counts[b] := the number of set bits in the b-th 512-bit block of
+    // words, for b in [0,blocks).
+    inline void block_popcounts(uint64_t const * words, size_t blocks, uint16_t * counts)
+    {
+        for (size_t b = 0; b < blocks; ++b)
+        {
+            uint64_t const * w = words + 8 * b;
+#if defined(__AVX2__)
+            __m256i v = _mm256_add_epi64(
+                detail::popcount_lanes(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(w))),
+                detail::popcount_lanes(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(w + 4))));
+            counts[b] = static_cast<uint16_t>(detail::horizontal_sum(v));
+#else
+            uint64_t c = 0;
+            for (size_t j = 0; j < 8; ++j)
+                c += static_cast<uint64_t>(__builtin_popcountll(w[j]));
+            counts[b] = static_cast<uint16_t>(c);
+#endif
+        }
+    }
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+/**
+ * A blocked Bloom filter.
+ *
+ * The bit array is partitioned into 512-bit blocks (one cache line). The
+ * first part of an element's hash selects a block and the rest selects k
+ * bits inside of it, so a membership query touches exactly one cache line.
+ * The price is a slightly higher false positive rate than a classic Bloom
+ * filter of the same size, since the load on the blocks is not uniform.
+ *
+ * The false positive rate of a blocked Bloom filter is the average over
+ * blocks of (bits set in block / 512)^k, which we compute directly from
+ * the bit array. This also gives the correct rate after a union or an
+ * intersection of filters. Likewise, the number of elements may be
+ * estimated from the number of bits set in each block.
+ */
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "ahs_hash.hpp"
+#include "bitwise.hpp"
+
+using std::vector;
+using std::uint64_t;
+using std::uint32_t;
+using std::uint16_t;
+using std::size_t;
+
+namespace alex::ahs
+{
+    struct bloom_block_mask
+    {
+        static constexpr size_t words = 8;
+        uint64_t w[words];
+    };
+
+    struct blocked_bloom_view
+    {
+        static constexpr size_t block_bits = 512;
+        static constexpr size_t block_words = block_bits / 64;
+
+        uint64_t const * blocks;
+        uint64_t block_count;
+        uint32_t k;
+
+        size_t block_of(uint64_t h) const
+        {
+            return static_cast<size_t>(reduce(h, block_count));
+        }
+
+        // the k bits an element sets in its block. each bit is drawn from 9
+        // fresh bits of a second hash that is independent of the block index.
+        // (double hashing, a + i b mod 512, is cheaper, but the bit patterns
+        // of different elements are then correlated enough to raise the
+        // false positive rate several-fold at high k.)
+        bloom_block_mask mask_of(uint64_t h) const
+        {
+            bloom_block_mask m = {};
+            uint64_t s = h ^ 0x5851f42d4c957f2dULL;
+            uint64_t g = mix64(s);
+            int left = 64;
+            for (uint32_t i = 0; i < k; ++i)
+            {
+                if (left < 9)
+                {
+                    s += 0x9e3779b97f4a7c15ULL;
+                    g = mix64(s);
+                    left = 64;
+                }
+                uint32_t bit = static_cast<uint32_t>(g) & (block_bits - 1);
+                g >>= 9;
+                left -= 9;
+                m.w[bit >> 6] |= uint64_t(1) << (bit & 63);
+            }
+            return m;
+        }
+
+        static bool covers(uint64_t const * block, bloom_block_mask const & m)
+        {
+            // written as a reduction over all eight words (no early exit) so
+            // that it compiles to a couple of vector and/compare instructions.
+            uint64_t miss = 0;
+            for (size_t j = 0; j < block_words; ++j)
+                miss |= m.w[j] & ~block[j];
+            return miss == 0;
+        }
+
+        bool contains(uint64_t h) const
+        {
+            return covers(blocks + block_of(h) * block_words, mask_of(h));
+        }
+
+        // batched queries. we compute the block of every hash in a group
+        // and prefetch it before any of the blocks are tested, so that the
+        // cache misses of a group overlap rather than serialize.
+        void contains(uint64_t const * hs, size_t n, bool * out) const
+        {
+            constexpr size_t group = 16;
+            size_t idx[group];
+            for (size_t i = 0; i < n; i += group)
+            {
+                size_t const m = std::min(group, n - i);
+                for (size_t j = 0; j < m; ++j)
+                {
+                    idx[j] = block_of(hs[i + j]) * block_words;
+                    __builtin_prefetch(blocks + idx[j]);
+                }
+                for (size_t j = 0; j < m; ++j)
+                    out[i + j] = covers(blocks + idx[j], mask_of(hs[i + j]));
+            }
+        }
+
+        uint64_t word_count() const { return block_count * block_words; }
+
+        // the number of set bits in the filter.
+        uint64_t popcount() const
+        {
+            return ahs::popcount(blocks, word_count());
+        }
+
+        // calls f(c) with the number of set bits c of each block, in order.
+        template <typename F>
+        void for_each_block_popcount(F f) const
+        {
+            constexpr size_t chunk = 1024;
+            uint16_t counts[chunk];
+            for (uint64_t b = 0; b < block_count; b += chunk)
+            {
+                size_t const m = static_cast<size_t>(std::min<uint64_t>(chunk, block_count - b));
+                block_popcounts(blocks + b * block_words, m, counts);
+                for (size_t j = 0; j < m; ++j)
+                    f(counts[j]);
+            }
+        }
+
+        // average over blocks of the probability that k random bits of a
+        // block are all set.
+        double estimate_fpr() const
+        {
+            if (block_count == 0)
+                return 0;
+
+            double sum = 0;
+            for_each_block_popcount([&](uint16_t c)
+            {
+                sum += std::pow(double(c) / block_bits, double(k));
+            });
+            return sum / double(block_count);
+        }
+
+        // the number of distinct elements, estimated from the fill of each
+        // block (Swamidass and Baldi): a block with c of its 512 bits set
+        // holds about ln(1 - c/512) / (k ln(1 - 1/512)) elements. a full
+        // block carries no information beyond "many", so we count it as
+        // holding as many elements as a block with one bit unset.
+        double estimate_cardinality() const
+        {
+            double const unit = double(k) * std::log1p(-1.0 / block_bits);
+            double n = 0;
+            for_each_block_popcount([&](uint16_t c)
+            {
+                double const fill = double(std::min<uint16_t>(c, block_bits - 1)) / block_bits;
+                n += std::log1p(-fill) / unit;
+            });
+            return n;
+        }
+    };
+
+    class blocked_bloom_filter
+    {
+    public:
+        blocked_bloom_filter(uint64_t block_count, uint32_t k) :
+            bits_(std::max<uint64_t>(block_count, 1) * blocked_bloom_view::block_words, 0),
+            block_count_(std::max<uint64_t>(block_count, 1)), k_(k) {}
+
+        // the expected false positive rate with b bits per element and k
+        // bits set per element. the number of elements in a block is Poisson
+        // distributed with mean 512/b.
+        static double model_fpr(double b, uint32_t k)
+        {
+            double const mean = blocked_bloom_view::block_bits / b;
+            double p = std::exp(-mean), sum = 0;
+            for (uint32_t j = 0; j < 8 * mean + 64; ++j)
+            {
+                double fill = 1 - std::pow(1 - 1.0 / blocked_bloom_view::block_bits, double(k) * j);
+                sum += p * std::pow(fill, double(k));
+                p *= mean / (j + 1);
+            }
+            return sum;
+        }
+
+        // the smallest filter for n elements (in steps of a quarter bit per
+        // element) whose expected false positive rate is at most fpr.
+        static blocked_bloom_filter for_fpr(uint64_t n, double fpr)
+        {
+            double b = std::max(1.0, 1.44 * std::log2(1 / fpr));
+            uint32_t k = 1;
+            for (;; b += 0.25)
+            {
+                k = std::clamp<uint32_t>(static_cast<uint32_t>(std::round(0.69 * b)), 1, 16);
+                if (model_fpr(b, k) <= fpr || b > 64)
+                    break;
+            }
+            uint64_t blocks = static_cast<uint64_t>(std::ceil(
+                double(std::max<uint64_t>(n, 1)) * b / blocked_bloom_view::block_bits));
+            return blocked_bloom_filter(blocks, k);
+        }
+
+        void insert(uint64_t h)
+        {
+            auto v = view();
+            uint64_t * block = bits_.data() + v.block_of(h) * blocked_bloom_view::block_words;
+            auto m = v.mask_of(h);
+            for (size_t j = 0; j < blocked_bloom_view::block_words; ++j)
+                block[j] |= m.w[j];
+        }
+
+        blocked_bloom_view view() const
+        {
+            return blocked_bloom_view{bits_.data(), block_count_, k_};
+        }
+
+        bool contains(uint64_t h) const { return view().contains(h); }
+
+        uint64_t block_count() const { return block_count_; }
+        uint32_t k() const { return k_; }
+        vector<uint64_t> const & bits() const { return bits_; }
+
+    private:
+        vector<uint64_t> bits_;
+        uint64_t block_count_;
+        uint32_t k_;
+    };
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+/**
+ * A blocked count-min sketch with conservative update.
+ *
+ * A count-min sketch models an approximate multiset, with the computational
+ * basis
+ *     count : (AHS<X>, X) -> Nat,
+ * where count never underestimates the multiplicity of an element.
+ *
+ * Rather than depth rows of independent counters, the counters are
+ * partitioned into cache-line blocks of 16 32-bit counters. An element's
+ * hash selects a block and, in each of the 4 rows of the block, one of its
+ * 4 counters. An update or a query thus touches one cache line, and the
+ * block is a single 512-bit vector (or two 256-bit vectors).
+ *
+ * The rows of an element share its block, so they are not independent,
+ * and the e^-depth bound of a count-min sketch does not hold. With rows of
+ * W = e/epsilon counters (blocks times 4), each row alone is a row of a
+ * count-min sketch, so a count exceeds the multiplicity by more than
+ * epsilon N (N is the total count) with probability at most 1/e. Given
+ * the other elements of the block, of total count M, the rows are
+ * independent, and the probability is at most (M / (4 epsilon N))^4,
+ * which is about e^-4 where M is near its mean N/blocks. Measured over
+ * Zipf streams (exponents 0 to 1.2, epsilon 1e-3 and 1e-4), it was below
+ * 1e-3.
+ *
+ * Conservative update: an increment by d raises each of the element's
+ * counters only as far as min + d, where min is the current estimate. This
+ * is never less accurate than incrementing every counter, and it is
+ * typically much more accurate for skewed counts.
+ *
+ * Since count(x) > 0 for every element x that was inserted, the sketch
+ * also models an AHS with contains(x) := count(x) > 0.
+ */
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "ahs_hash.hpp"
+
+using std::vector;
+using std::uint64_t;
+using std::uint32_t;
+using std::size_t;
+
+namespace alex::ahs
+{
+    struct count_min_view
+    {
+        static constexpr size_t block_counters = 16;
+        static constexpr size_t depth = 4;
+        static constexpr size_t width = block_counters / depth;
+
+        uint32_t const * counters;
+        uint64_t block_count;
+
+        size_t block_of(uint64_t h) const
+        {
+            return static_cast<size_t>(reduce(h, block_count)) * block_counters;
+        }
+
+        // the offsets of the element's counters in its block, one per row.
+        static void slots_of(uint64_t h, size_t s[depth])
+        {
+            uint64_t g = mix64(h ^ 0x2545f4914f6cdd1dULL);
+            for (size_t r = 0; r < depth; ++r)
+                s[r] = r * width + ((g >> (2 * r)) & (width - 1));
+        }
+
+        static uint32_t min_of(uint32_t const * block, size_t const s[depth])
+        {
+            uint32_t m = block[s[0]];
+            for (size_t r = 1; r < depth; ++r)
+                m = std::min(m, block[s[r]]);
+            return m;
+        }
+
+        uint32_t count(uint64_t h) const
+        {
+            size_t s[depth];
+            slots_of(h, s);
+            return min_of(counters + block_of(h), s);
+        }
+
+        // batched queries, out[i] := count(hs[i]). the blocks of a group of
+        // hashes are prefetched before any of them are read.
+        void count(uint64_t const * hs, size_t n, uint32_t * out) const
+        {
+            constexpr size_t group = 16;
+            size_t idx[group];
+            for (size_t i = 0; i < n; i += group)
+            {
+                size_t const m = std::min(group, n - i);
+                for (size_t j = 0; j < m; ++j)
+                {
+                    idx[j] = block_of(hs[i + j]);
+                    __builtin_prefetch(counters + idx[j]);
+                }
+                for (size_t j = 0; j < m; ++j)
+                {
+                    size_t s[depth];
+                    slots_of(hs[i + j], s);
+                    out[i + j] = min_of(counters + idx[j], s);
+                }
+            }
+        }
+
+        bool contains(uint64_t h) const { return count(h) != 0; }
+
+        void contains(uint64_t const * hs, size_t n, bool * out) const
+        {
+            constexpr size_t batch = 256;
+            uint32_t cs[batch];
+            for (size_t i = 0; i < n; i += batch)
+            {
+                size_t const m = std::min(batch, n - i);
+                count(hs + i, m, cs);
+                for (size_t j = 0; j < m; ++j)
+                    out[i + j] = cs[j] != 0;
+            }
+        }
+
+        uint64_t counter_count() const { return block_count * block_counters; }
+
+        // an element that was not inserted is a false positive of contains
+        // if each of its counters is non-zero: the average over blocks of
+        // the product over rows of the fraction of non-zero counters.
+        double estimate_fpr() const
+        {
+            if (block_count == 0)
+                return 0;
+
+            double sum = 0;
+            for (uint64_t b = 0; b < block_count; ++b)
+            {
+                uint32_t const * block = counters + b * block_counters;
+                double p = 1;
+                for (size_t r = 0; r < depth; ++r)
+                {
+                    size_t nz = 0;
+                    for (size_t j = 0; j < width; ++j)
+                        nz += block[r * width + j] != 0;
+                    p *= double(nz) / width;
+                }
+                sum += p;
+            }
+            return sum / double(block_count);
+        }
+
+        // the number of distinct elements by linear counting on the first
+        // row: with z of its w counters zero, about -w ln(z/w) elements.
+        double estimate_cardinality() const
+        {
+            uint64_t z = 0;
+            for (uint64_t b = 0; b < block_count; ++b)
+                for (size_t j = 0; j < width; ++j)
+                    z += counters[b * block_counters + j] == 0;
+
+            double const w = double(block_count * width);
+            return -w * std::log(double(std::max<uint64_t>(z, 1)) / w);
+        }
+    };
+
+    class count_min_sketch
+    {
+    public:
+        using view_type = count_min_view;
+
+        explicit count_min_sketch(uint64_t block_count) :
+            block_count_(std::max<uint64_t>(block_count, 1)),
+            counters_(block_count_ * view_type::block_counters, 0) {}
+
+        // a sketch whose rows have e/epsilon counters, so that count(x)
+        // exceeds the multiplicity of x by more than epsilon N with
+        // probability at most 1/e, and typically far less (see above).
+        static count_min_sketch for_error(double epsilon)
+        {
+            return count_min_sketch(static_cast<uint64_t>(
+                std::ceil(std::exp(1.0) / epsilon / view_type::width)));
+        }
+
+        // increments the multiplicity of the element with hash h by d.
+        void add(uint64_t h, uint32_t d = 1)
+        {
+            auto v = view();
+            size_t s[view_type::depth];
+            view_type::slots_of(h, s);
+            uint32_t * block = counters_.data() + v.block_of(h);
+            conservative_update(block, s, d);
+        }
+
+        // batched increments, add(hs[i], 1) for each i. the blocks of a
+        // group of hashes are prefetched before any of them are updated.
+        void add(uint64_t const * hs, size_t n)
+        {
+            auto v = view();
+            constexpr size_t group = 16;
+            size_t idx[group];
+            for (size_t i = 0; i < n; i += group)
+            {
+                size_t const m = std::min(group, n - i);
+                for (size_t j = 0; j < m; ++j)
+                {
+                    idx[j] = v.block_of(hs[i + j]);
+                    __builtin_prefetch(counters_.data() + idx[j], 1);
+                }
+                for (size_t j = 0; j < m; ++j)
+                {
+                    size_t s[view_type::depth];
+                    view_type::slots_of(hs[i + j], s);
+                    conservative_update(counters_.data() + idx[j], s, 1);
+                }
+            }
+        }
+
+        uint32_t count(uint64_t h) const { return view().count(h); }
+
+        view_type view() const { return view_type{counters_.data(), block_count_}; }
+
+        uint64_t block_count() const { return block_count_; }
+        vector<uint32_t> const & counters() const { return counters_; }
+
+    private:
+        static void conservative_update(uint32_t * block, size_t const s[], uint32_t d)
+        {
+            uint32_t const m = view_type::min_of(block, s);
+            uint32_t const target = m > UINT32_MAX - d ? UINT32_MAX : m + d;
+            for (size_t r = 0; r < view_type::depth; ++r)
+                block[s[r]] = std::max(block[s[r]], target);
+        }
+
+        uint64_t block_count_;
+        vector<uint32_t> counters_;
+    };
+}
@@ -0,0 +1,258 @@
+#pragma once
+
+/**
+ * A cuckoo filter with buckets of four fingerprints.
+ *
+ * An element with hash h has a fingerprint f and two candidate buckets,
+ *     i1 = h mod B, and
+ *     i2 = i1 xor hash(f) mod B,
+ * where B, the number of buckets, is a power of two. Since i1 may also be
+ * computed from i2 and f, a fingerprint may be moved to its alternate
+ * bucket without knowing the element it came from. Thus, unlike a Bloom
+ * filter, elements may be deleted.
+ *
+ * With load a (the fraction of occupied slots), the false positive rate
+ * is about 8a/2^F, where F is the bit length of a fingerprint.
+ */
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <bit>
+#include <utility>
+#include "ahs_hash.hpp"
+
+using std::vector;
+using std::uint64_t;
+using std::uint32_t;
+using std::uint16_t;
+using std::uint8_t;
+using std::size_t;
+
+namespace alex::ahs
+{
+    template <typename F>
+    struct cuckoo_view
+    {
+        using fingerprint_type = F;
+        static constexpr size_t bucket_size = 4;
+        static constexpr uint32_t fingerprint_bits = 8 * sizeof(F);
+
+        F const * table;
+        uint64_t bucket_count;
+
+        // zero marks an empty slot, so it is not a fingerprint.
+        static F fingerprint(uint64_t h)
+        {
+            F f = static_cast<F>(h >> 32);
+            return f == 0 ? F(1) : f;
+        }
+
+        size_t index(uint64_t h) const
+        {
+            return static_cast<size_t>(h & (bucket_count - 1));
+        }
+
+        size_t alt_index(size_t i, F f) const
+        {
+            return static_cast<size_t>((i ^ mix64(f)) & (bucket_count - 1));
+        }
+
+        bool bucket_has(size_t i, F f) const
+        {
+            F const * b = table + i * bucket_size;
+            bool found = false;
+            for (size_t j = 0; j < bucket_size; ++j)
+                found |= (b[j] == f);
+            return found;
+        }
+
+        bool contains(uint64_t h) const
+        {
+            F f = fingerprint(h);
+            size_t i1 = index(h);
+            return bucket_has(i1, f) || bucket_has(alt_index(i1, f), f);
+        }
+
+        // batched queries. both candidate buckets of a group of hashes are
+        // prefetched before any of them are tested.
+        void contains(uint64_t const * hs, size_t n, bool * out) const
+        {
+            constexpr size_t group = 16;
+            size_t i1[group], i2[group];
+            for (size_t i = 0; i < n; i += group)
+            {
+                size_t const m = std::min(group, n - i);
+                for (size_t j = 0; j < m; ++j)
+                {
+                    i1[j] = index(hs[i + j]);
+                    i2[j] = alt_index(i1[j], fingerprint(hs[i + j]));
+                    __builtin_prefetch(table + i1[j] * bucket_size);
+                    __builtin_prefetch(table + i2[j] * bucket_size);
+                }
+                for (size_t j = 0; j < m; ++j)
+                {
+                    F f = fingerprint(hs[i + j]);
+                    out[i + j] = bucket_has(i1[j], f) || bucket_has(i2[j], f);
+                }
+            }
+        }
+
+        uint64_t slot_count() const { return bucket_count * bucket_size; }
+
+        // the number of occupied slots.
+        uint64_t occupancy() const
+        {
+            uint64_t c = 0;
+            uint64_t const n = slot_count();
+            for (uint64_t i = 0; i < n; ++i)
+                c += (table[i] != 0);
+            return c;
+        }
+
+        // each element occupies one slot, so the occupancy estimates the
+        // number of distinct elements. it is low by the (rare) distinct
+        // elements that share a fingerprint and a bucket pair.
+        double estimate_cardinality() const
+        {
+            return double(occupancy());
+        }
+
+        // a query compares against the 2 * bucket_size slots of two buckets,
+        // each of which is occupied with probability a and then matches
+        // with probability 2^-F.
+        double estimate_fpr() const
+        {
+            if (bucket_count == 0)
+                return 0;
+            double a = double(occupancy()) / double(slot_count());
+            return 1 - std::pow(1 - std::ldexp(1.0, -int(fingerprint_bits)),
+                                2 * bucket_size * a);
+        }
+    };
+
+    template <typename F>
+    class cuckoo_filter
+    {
+    public:
+        using view_type = cuckoo_view<F>;
+        static constexpr size_t bucket_size = view_type::bucket_size;
+        static constexpr size_t max_kicks = 500;
+
+        explicit cuckoo_filter(uint64_t bucket_count) :
+            bucket_count_(std::bit_ceil(std::max<uint64_t>(bucket_count, 1))),
+            table_(bucket_count_ * bucket_size, 0) {}
+
+        // a copy of the filter v, e.g., to modify a mapped filter.
+        explicit cuckoo_filter(view_type v) :
+            bucket_count_(v.bucket_count),
+            table_(v.table, v.table + v.slot_count()) {}
+
+        // the number of buckets for n elements at a load of 95%.
+        static cuckoo_filter for_size(uint64_t n)
+        {
+            return cuckoo_filter(static_cast<uint64_t>(
+                std::ceil(double(n) / (0.95 * bucket_size))));
+        }
+
+        // returns false if the filter is too full to insert the element, in
+        // which case the filter is left unchanged.
+        bool insert(uint64_t h)
+        {
+            return insert_fingerprint(view().index(h), view_type::fingerprint(h));
+        }
+
+        // inserts the fingerprint f into bucket i or its alternate bucket.
+        // fingerprints may be moved between filters with the same number of
+        // buckets in this way, e.g., to merge them.
+        bool insert_fingerprint(size_t i1, F f)
+        {
+            auto v = view();
+            size_t i2 = v.alt_index(i1, f);
+            if (place(i1, f) || place(i2, f))
+                return true;
+
+            // evict a random fingerprint to its alternate bucket, and so
+            // on. the path of evictions is recorded so that a failed insert
+            // may be undone.
+            size_t path[max_kicks];
+            size_t i = (rng() & 1) ? i1 : i2;
+            for (size_t kick = 0; kick < max_kicks; ++kick)
+            {
+                size_t slot = i * bucket_size + (rng() % bucket_size);
+                path[kick] = slot;
+                std::swap(f, table_[slot]);
+                i = v.alt_index(i, f);
+                if (place(i, f))
+                    return true;
+            }
+
+            for (size_t kick = max_kicks; kick-- > 0; )
+                std::swap(f, table_[path[kick]]);
+            return false;
+        }
+
+        // removes one copy of the element's fingerprint. deleting an element
+        // that was never inserted may remove another element's fingerprint.
+        bool erase(uint64_t h)
+        {
+            return erase_fingerprint(view().index(h), view_type::fingerprint(h));
+        }
+
+        // removes one copy of the fingerprint f from bucket i or its
+        // alternate bucket.
+        bool erase_fingerprint(size_t i1, F f)
+        {
+            return remove(i1, f) || remove(view().alt_index(i1, f), f);
+        }
+
+        bool contains(uint64_t h) const { return view().contains(h); }
+
+        view_type view() const { return view_type{table_.data(), bucket_count_}; }
+
+        uint64_t bucket_count() const { return bucket_count_; }
+        vector<F> const & table() const { return table_; }
+
+    private:
+        bool place(size_t i, F f)
+        {
+            F * b = table_.data() + i * bucket_size;
+            for (size_t j = 0; j < bucket_size; ++j)
+            {
+                if (b[j] == 0)
+                {
+                    b[j] = f;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool remove(size_t i, F f)
+        {
+            F * b = table_.data() + i * bucket_size;
+            for (size_t j = 0; j < bucket_size; ++j)
+            {
+                if (b[j] == f)
+                {
+                    b[j] = 0;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        uint64_t rng()
+        {
+            rng_state_ ^= rng_state_ << 13;
+            rng_state_ ^= rng_state_ >> 7;
+            rng_state_ ^= rng_state_ << 17;
+            return rng_state_;
+        }
+
+        uint64_t bucket_count_;
+        vector<F> table_;
+        uint64_t rng_state_ = 0x2545f4914f6cdd1dULL;
+    };
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+/**
+ * A minimal perfect hash function of a static set of n distinct 64-bit
+ * keys: a function onto [0,n) that maps no two keys to the same position.
+ * It does not store the keys, so it takes about 6 bits per key, and it maps
+ * any other key to some position in [0,n) as well.
+ *
+ * The construction is PTHash's (Pibiri and Trani, 2021). A key hashes to
+ * one of about n/4 buckets, and each bucket has a pilot p, a small number
+ * such that the keys of the bucket have free positions
+ *     position(k, p) := reduce(mix64(k + p * phi), m)
+ * in a table of m = n + n/32 + 1 slots. The buckets are placed from the
+ * largest to the smallest, each taking the first pilot that fits. The slots
+ * at or past n that keys were placed in are then remapped to the free slots
+ * below n, so the function is minimal.
+ *
+ * A lookup is two mix64s, a load of a pilot, and, for about 3% of the
+ * keys, a load from the remap table.
+ */
+
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include "ahs_hash.hpp"
+
+using std::vector;
+using std::optional;
+using std::nullopt;
+using std::uint64_t;
+using std::uint16_t;
+using std::size_t;
+
+namespace alex::ahs
+{
+    class minimal_perfect_hash
+    {
+    public:
+        minimal_perfect_hash() = default;
+
+        /**
+         * Builds the function of the n keys. Returns nullopt if they are
+         * not distinct, or (which in practice does not happen) if no pilots
+         * are found for any seed tried.
+         */
+        static optional<minimal_perfect_hash> build(uint64_t const * keys, size_t n)
+        {
+            for (uint64_t seed = 1; seed <= 16; ++seed)
+            {
+                minimal_perfect_hash f(n, seed * 0x9e3779b97f4a7c15ULL);
+                switch (f.place(keys))
+                {
+                case placement::placed: return f;
+                case placement::duplicate: return nullopt;
+                case placement::failed: break;
+                }
+            }
+            return nullopt;
+        }
+
+        static optional<minimal_perfect_hash> build(vector<uint64_t> const & keys)
+        {
+            return build(keys.data(), keys.size());
+        }
+
+        // the position of k, in [0,size()).
+        uint64_t operator()(uint64_t k) const
+        {
+            uint64_t const h = rehash(k);
+            uint64_t const s = position(h, pilots_[bucket(h)]);
+            return s < n_ ? s : remap_[s - n_];
+        }
+
+        // out[i] := f(ks[i]) for i in [0,n).
+        void operator()(uint64_t const * ks, size_t n, uint64_t * out) const
+        {
+            constexpr size_t group = 16;
+            uint64_t hs[group];
+            for (size_t i = 0; i < n; i += group)
+            {
+                size_t const m = std::min(group, n - i);
+                for (size_t j = 0; j < m; ++j)
+                {
+                    hs[j] = rehash(ks[i + j]);
+                    __builtin_prefetch(pilots_.data() + bucket(hs[j]));
+                }
+                for (size_t j = 0; j < m; ++j)
+                {
+                    uint64_t const s = position(hs[j], pilots_[bucket(hs[j])]);
+                    out[i + j] = s < n_ ? s : remap_[s - n_];
+                }
+            }
+        }
+
+        uint64_t size() const { return n_; }
+
+        // the size of the function in bytes.
+        size_t bytes() const
+        {
+            return pilots_.size() * sizeof(uint16_t) + remap_.size() * sizeof(uint64_t);
+        }
+
+    private:
+        enum class placement { placed, duplicate, failed };
+
+        minimal_perfect_hash(uint64_t n, uint64_t seed) :
+            n_(n), slots_(n + n / 32 + 1), buckets_(n / 4 + 1), seed_(seed),
+            pilots_(buckets_, 0), remap_(slots_ - n_, 0) {}
+
+        uint64_t rehash(uint64_t k) const { return mix64(k + seed_); }
+        uint64_t bucket(uint64_t h) const { return reduce(h, buckets_); }
+
+        uint64_t position(uint64_t h, uint64_t p) const
+        {
+            return reduce(mix64(h + p * 0x9e3779b97f4a7c15ULL), slots_);
+        }
+
+        placement place(uint64_t const * keys)
+        {
+            // the hashes, by bucket. rehash is a bijection, so keys are
+            // distinct if and only if their hashes are.
+            vector<uint64_t> start(buckets_ + 1, 0);
+            vector<uint64_t> hs(n_);
+            for (uint64_t i = 0; i < n_; ++i)
+                ++start[bucket(rehash(keys[i])) + 1];
+            for (uint64_t b = 0; b < buckets_; ++b)
+                start[b + 1] += start[b];
+            {
+                vector<uint64_t> next(start.begin(), start.end() - 1);
+                for (uint64_t i = 0; i < n_; ++i)
+                {
+                    uint64_t const h = rehash(keys[i]);
+                    hs[next[bucket(h)]++] = h;
+                }
+            }
+
+            // the buckets, from the largest to the smallest.
+            uint64_t largest = 0;
+            for (uint64_t b = 0; b < buckets_; ++b)
+            {
+                uint64_t const size = start[b + 1] - start[b];
+                largest = std::max(largest, size);
+                std::sort(hs.begin() + start[b], hs.begin() + start[b + 1]);
+                if (std::adjacent_find(hs.begin() + start[b], hs.begin() + start[b + 1]) !=
+                    hs.begin() + start[b + 1])
+                    return placement::duplicate;
+            }
+            vector<uint64_t> by_size(largest + 2, 0);
+            for (uint64_t b = 0; b < buckets_; ++b)
+                ++by_size[largest - (start[b + 1] - start[b]) + 1];
+            for (uint64_t j = 0; j <= largest; ++j)
+                by_size[j + 1] += by_size[j];
+            vector<uint64_t> order(buckets_);
+            for (uint64_t b = 0; b < buckets_; ++b)
+                order[by_size[largest - (start[b + 1] - start[b])]++] = b;
+
+            vector<uint64_t> taken((slots_ + 63) / 64, 0);
+            auto is_taken = [&](uint64_t s) { return (taken[s / 64] >> (s % 64)) & 1; };
+            auto flip = [&](uint64_t s) { taken[s / 64] ^= uint64_t(1) << (s % 64); };
+            vector<uint64_t> ps(largest);
+            for (uint64_t b : order)
+            {
+                uint64_t const * const bh = hs.data() + start[b];
+                uint64_t const size = start[b + 1] - start[b];
+                if (size == 0)
+                    break;
+                for (uint64_t p = 0; ; ++p)
+                {
+                    if (p > UINT16_MAX)
+                        return placement::failed;
+                    uint64_t j = 0;
+                    for (; j < size; ++j)
+                    {
+                        ps[j] = position(bh[j], p);
+                        if (is_taken(ps[j]))
+                            break;
+                        flip(ps[j]);
+                    }
+                    if (j == size)
+                    {
+                        pilots_[b] = uint16_t(p);
+                        break;
+                    }
+                    for (uint64_t i = 0; i < j; ++i)
+                        flip(ps[i]);
+                }
+            }
+
+            // there are as many keys past n as there are free slots below.
+            uint64_t free = 0;
+            for (uint64_t s = n_; s < slots_; ++s)
+            {
+                if (!is_taken(s))
+                    continue;
+                while (is_taken(free))
+                    ++free;
+                remap_[s - n_] = free++;
+            }
+            return placement::placed;
+        }
+
+        uint64_t n_ = 0;
+        uint64_t slots_ = 1;
+        uint64_t buckets_ = 1;
+        uint64_t seed_ = 0;
+        vector<uint16_t> pilots_ = vector<uint16_t>(1, 0);
+        vector<uint64_t> remap_ = vector<uint64_t>(1, 0);
+    };
+}
@@ -0,0 +1,257 @@
+#pragma once
+
+/**
+ * Batch case analysis of cipher sum types (see cipher_union.hpp).
+ *
+ * case_of eliminates one cipher_sum_type by branching on its cipher type.
+ * Over a long stream of values of mixed types, that branch is
+ * unpredictable and keeps a typed kernel from being vectorized, since each
+ * value may need a different one. cipher_sum_dispatcher instead takes a
+ * batch of values and, for each block of block_size of them,
+ *
+ *  1. classifies each value by its cipher type, counting the values of
+ *     each kernel;
+ *  2. partitions the values by type into contiguous buffers (a radix
+ *     partition with one digit, the kernel index), remembering the
+ *     position of each;
+ *  3. calls each type's kernel once on its buffer;
+ *  4. scatters the results back to the positions of their values.
+ *
+ * So a kernel runs on contiguous values of one type, as it would on a
+ * homogeneous column. A block fits in the L1/L2 cache, so the partition
+ * and the scatter do not go to memory.
+ *
+ * A cipher type is classified without branches, by a load and a compare:
+ * the dispatcher finds a multiplicative hash under which its types have
+ * distinct slots in a small table. (With many types, it may not find one,
+ * in which case the table is open-addressed.)
+ */
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include "cipher_union.hpp"
+#include "ahs/ahs_hash.hpp"
+
+using std::vector;
+using std::size_t;
+using std::uint8_t;
+using std::uint16_t;
+using std::uint64_t;
+
+namespace alex::cipher
+{
+    class cipher_sum_dispatcher
+    {
+    public:
+        // a typed kernel: out[i] = f(values[i]) for i < n.
+        using kernel = std::function<void(uint64_t const * values, size_t n, uint64_t * out)>;
+
+        static constexpr size_t max_kernels = 255;
+        static constexpr size_t block_size = 2048;
+
+        cipher_sum_dispatcher() { rehash(); }
+
+        /**
+         * Sets the kernel of the values of cipher type t. Returns false if
+         * there are max_kernels kernels already.
+         */
+        bool on(size_t t, kernel k)
+        {
+            for (size_t j = 0; j < types_.size(); ++j)
+            {
+                if (types_[j] == t)
+                {
+                    kernels_[j] = std::move(k);
+                    return true;
+                }
+            }
+            if (types_.size() == max_kernels)
+                return false;
+            types_.push_back(t);
+            kernels_.push_back(std::move(k));
+            rehash();
+            return true;
+        }
+
+        size_t size() const { return types_.size(); }
+
+        /**
+         * Sets out[i] to the result of the kernel of the cipher type of
+         * xs[i] on its value, for each of the n values. Returns the number
+         * of values whose type has no kernel, whose out is not set.
+         */
+        size_t run(cipher_sum_type const * xs, size_t n, uint64_t * out)
+        {
+            size_t unknown = 0;
+            for (size_t b = 0; b < n; b += block_size)
+                unknown += run_block(xs + b, std::min(block_size, n - b), out + b);
+            return unknown;
+        }
+
+    private:
+        size_t run_block(cipher_sum_type const * xs, size_t n, uint64_t * out)
+        {
+            // the values with no kernel are in partition k.
+            size_t const k = types_.size();
+
+            // 1. classify and count.
+            classify(xs, n);
+            size_t count[max_kernels + 1] = {};
+            for (size_t i = 0; i < n; ++i)
+                ++count[index_[i]];
+
+            // a block of one type, e.g., of a homogeneous column, needs no
+            // partition.
+            size_t const first = index_[0];
+            if (first < k && count[first] == n)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    values_[i] = uint64_t(xs[i].cipher_value);
+                kernels_[first](values_, n, out);
+                return 0;
+            }
+
+            // 2. partition, the values of kernel j at [start[j], start[j+1]).
+            size_t start[max_kernels + 2];
+            start[0] = 0;
+            for (size_t j = 0; j <= k; ++j)
+                start[j + 1] = start[j] + count[j];
+            size_t next[max_kernels + 1];
+            std::copy(start, start + k + 1, next);
+            for (size_t i = 0; i < n; ++i)
+            {
+                size_t const at = next[index_[i]]++;
+                values_[at] = uint64_t(xs[i].cipher_value);
+                positions_[at] = uint16_t(i);
+            }
+
+            // 3. one call of each kernel on its values.
+            for (size_t j = 0; j < k; ++j)
+            {
+                if (count[j] != 0)
+                    kernels_[j](values_ + start[j], count[j], results_ + start[j]);
+            }
+
+            // 4. scatter back, but for the values with no kernel.
+            for (size_t at = 0; at < start[k]; ++at)
+                out[positions_[at]] = results_[at];
+            return count[k];
+        }
+
+        // sets index_[i] to the kernel of xs[i], or to the number of
+        // kernels if it has none.
+        void classify(cipher_sum_type const * xs, size_t n)
+        {
+            uint8_t * const index = index_;
+            uint8_t const k = uint8_t(types_.size());
+            if (perfect_)
+            {
+                // one slot per type, so a lookup is a load and a compare.
+                uint64_t const mul = mul_;
+                unsigned const shift = shift_;
+                size_t const * const types = slot_types_.data();
+                uint8_t const * const kernels = slot_kernels_.data();
+                for (size_t i = 0; i < n; ++i)
+                {
+                    size_t const t = xs[i].cipher_type;
+                    size_t const s = size_t((uint64_t(t) * mul) >> shift);
+                    uint8_t const other = uint8_t(0u - unsigned(types[s] != t));
+                    index[i] = uint8_t((kernels[s] & ~other) | (k & other));
+                }
+                return;
+            }
+
+            size_t const mask = slot_types_.size() - 1;
+            for (size_t i = 0; i < n; ++i)
+            {
+                size_t const t = xs[i].cipher_type;
+                uint8_t j = k;
+                for (size_t s = size_t(ahs::mix64(t)) & mask; slot_kernels_[s] != k; s = (s + 1) & mask)
+                {
+                    if (slot_types_[s] == t)
+                    {
+                        j = slot_kernels_[s];
+                        break;
+                    }
+                }
+                index[i] = j;
+            }
+        }
+
+        /**
+         * Builds the table of types. It looks for a multiplier under which
+         * the types have distinct slots in a table of at most max_slots, which
+         * there usually is for up to a few dozen types; else, the table is
+         * open-addressed.
+         */
+        void rehash()
+        {
+            constexpr size_t max_slots = size_t(1) << 12;
+            uint8_t const k = uint8_t(types_.size());
+            unsigned bits = 4;
+            while ((size_t(1) << bits) < 2 * types_.size())
+                ++bits;
+
+            for (; (size_t(1) << bits) <= max_slots; ++bits)
+            {
+                for (uint64_t seed = 1; seed <= 64; ++seed)
+                {
+                    uint64_t const mul = ahs::mix64(seed) | 1;
+                    unsigned const shift = 64 - bits;
+                    slot_types_.assign(size_t(1) << bits, 0);
+                    slot_kernels_.assign(size_t(1) << bits, k);
+                    bool distinct = true;
+                    for (size_t j = 0; j < types_.size() && distinct; ++j)
+                    {
+                        size_t const s = size_t((uint64_t(types_[j]) * mul) >> shift);
+                        distinct = slot_kernels_[s] == k;
+                        slot_types_[s] = types_[j];
+                        slot_kernels_[s] = uint8_t(j);
+                    }
+                    if (distinct)
+                    {
+                        perfect_ = true;
+                        mul_ = mul;
+                        shift_ = shift;
+                        return;
+                    }
+                }
+            }
+
+            perfect_ = false;
+            size_t slots = 16;
+            while (slots < 2 * types_.size())
+                slots *= 2;
+            slot_types_.assign(slots, 0);
+            slot_kernels_.assign(slots, k);
+            for (size_t j = 0; j < types_.size(); ++j)
+            {
+                size_t s = size_t(ahs::mix64(types_[j])) & (slots - 1);
+                while (slot_kernels_[s] != k)
+                    s = (s + 1) & (slots - 1);
+                slot_types_[s] = types_[j];
+                slot_kernels_[s] = uint8_t(j);
+            }
+        }
+
+        vector<size_t> types_;
+        vector<kernel> kernels_;
+
+        // the table of types: a slot holds a type and its kernel, or the
+        // number of kernels if it is empty.
+        vector<size_t> slot_types_;
+        vector<uint8_t> slot_kernels_;
+        bool perfect_ = false;
+        uint64_t mul_ = 0;
+        unsigned shift_ = 64;
+
+        // the state of a block.
+        uint8_t index_[block_size];
+        uint16_t positions_[block_size];
+        uint64_t values_[block_size];
+        uint64_t results_[block_size];
+    };
+}
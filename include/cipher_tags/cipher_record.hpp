@@ -0,0 +1,164 @@
+#pragma once
+
+/**
+ * Typed views of buffers of type-erased cipher values.
+ *
+ * A cipher_record<N> is a cipher value of N bytes whose type has been
+ * erased: only its cipher tag (see cipher_tag.hpp) says what it is. It is
+ * the cipher<N> of include/test.hpp, laid out so that a buffer of records
+ * (e.g., as received from the wire, or mapped from a file) may be used in
+ * place.
+ *
+ * try_convert_to<X>(records, tag) is the bulk form of
+ * try_convert_to<X,N>(cipher<N>): it checks that every record has the tag
+ * of X and, if so, returns a typed_cipher_span<X,N>, a view of the same
+ * records that is typed by X, so that a kernel of cipher<X,N> values may
+ * take it and run on the buffer. Nothing is constructed or copied; the
+ * view aliases the buffer and lives as long as it does.
+ *
+ * The tags are checked in blocks of 64 records without branches, which the
+ * compiler vectorizes, and a block is only searched for the first bad
+ * record if it has one.
+ */
+
+#include <span>
+#include <optional>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "cipher_tag.hpp"
+#include "static_type_tag.hpp"
+
+using std::span;
+using std::optional;
+using std::nullopt;
+using std::size_t;
+
+namespace alex::cipher
+{
+    template <size_t N>
+    struct cipher_record
+    {
+        cipher_tag tag;
+        unsigned char value[N];
+    };
+
+    /**
+     * A view of records whose tags are known to be the tag of X.
+     */
+    template <typename X, size_t N>
+    class typed_cipher_span
+    {
+    public:
+        using record_type = cipher_record<N>;
+
+        typed_cipher_span() = default;
+
+        record_type const & operator[](size_t i) const { return records_[i]; }
+        record_type const * data() const { return records_.data(); }
+        size_t size() const { return records_.size(); }
+        bool empty() const { return records_.empty(); }
+
+        auto begin() const { return records_.begin(); }
+        auto end() const { return records_.end(); }
+
+        span<record_type const> records() const { return records_; }
+
+        // the tag of X that every record has.
+        cipher_tag const & tag() const { return tag_; }
+
+        // the value of record i as an X, if a cipher value of X is an X.
+        X value(size_t i) const
+        {
+            static_assert(sizeof(X) == N && std::is_trivially_copyable_v<X>);
+            X x;
+            std::memcpy(&x, records_[i].value, N);
+            return x;
+        }
+
+        typed_cipher_span subspan(size_t offset, size_t count) const
+        {
+            return typed_cipher_span(records_.subspan(offset, count), tag_);
+        }
+
+    private:
+        template <typename Y, size_t M>
+        friend optional<typed_cipher_span<Y,M>> try_convert_to(span<cipher_record<M> const>, cipher_tag const &);
+
+        typed_cipher_span(span<record_type const> records, cipher_tag const & tag) :
+            records_(records), tag_(tag) {}
+
+        span<record_type const> records_;
+        cipher_tag tag_{};
+    };
+
+    /**
+     * The index of the first record whose tag is not tag, or the number of
+     * records if there is none.
+     */
+    template <size_t N>
+    size_t find_mismatch(span<cipher_record<N> const> records, cipher_tag const & tag)
+    {
+        constexpr size_t block = 64;
+        size_t const n = records.size();
+        for (size_t b = 0; b < n; b += block)
+        {
+            size_t const m = n - b < block ? n - b : block;
+            uint64_t bad = 0;
+            for (size_t i = b; i < b + m; ++i)
+                bad |= (uint64_t(records[i].tag.value) ^ uint64_t(tag.value)) |
+                       (uint64_t(records[i].tag.s) ^ uint64_t(tag.s));
+            if (bad != 0)
+            {
+                for (size_t i = b; ; ++i)
+                {
+                    if (records[i].tag != tag)
+                        return i;
+                }
+            }
+        }
+        return n;
+    }
+
+    /**
+     * A view of records as values of X, whose tag is tag, or nullopt if
+     * any record has another tag.
+     */
+    template <typename X, size_t N>
+    optional<typed_cipher_span<X,N>> try_convert_to(span<cipher_record<N> const> records, cipher_tag const & tag)
+    {
+        if (find_mismatch(records, tag) != records.size())
+            return nullopt;
+        return typed_cipher_span<X,N>(records, tag);
+    }
+
+    /**
+     * As above, for a statically known type X, whose tag is given by its
+     * fingerprint (see static_type_tag.hpp), a type_key and the secret's
+     * hash, s.
+     */
+    template <typename X, size_t N>
+    optional<typed_cipher_span<X,N>> try_convert_to(span<cipher_record<N> const> records,
+        type_key const & k, cipher_tag::cipher_secret_type s)
+    {
+        cipher_tag tag;
+        tag.value = cipher_tag::value_type(static_type_cipher<X>(k));
+        tag.s = s;
+        return try_convert_to<X,N>(records, tag);
+    }
+
+    /**
+     * The records of a buffer, e.g., as read from the wire, or nullopt if
+     * its size is not a multiple of a record or it is not aligned for one.
+     */
+    template <size_t N>
+    optional<span<cipher_record<N> const>> as_cipher_records(void const * data, size_t bytes)
+    {
+        if (bytes % sizeof(cipher_record<N>) != 0 ||
+            reinterpret_cast<std::uintptr_t>(data) % alignof(cipher_record<N>) != 0)
+            return nullopt;
+        return span<cipher_record<N> const>(static_cast<cipher_record<N> const *>(data),
+            bytes / sizeof(cipher_record<N>));
+    }
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+/**
+ * A column of cipher tags, and a batch check of a column against a small
+ * set of allowed tags.
+ *
+ * cipher_tag_column stores the tags of a stream of records as two arrays
+ * (structure of arrays), their values and their secrets, so that the
+ * values of consecutive records are contiguous and may be loaded into a
+ * vector register at once.
+ *
+ * cipher_tag_matcher holds up to 16 allowed tags. match() finds, for each
+ * record of a column, the index of the allowed tag it equals (the same
+ * equality as cipher_tag::operator==, i.e., both the value and the secret),
+ * or reject if there is none. It compares 8 records (AVX-512) or 4 records
+ * (AVX2) with each allowed tag at once; when the allowed tags share one
+ * secret, which is the common case, the secrets of the records are
+ * compared with it once rather than once per allowed tag. Without either,
+ * e.g., in a build without -mavx2 or -march=native, it compares one record
+ * at a time.
+ */
+
+#include <vector>
+#include <algorithm>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+#include "cipher_tag.hpp"
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+using std::vector;
+using std::optional;
+using std::nullopt;
+using std::size_t;
+using std::uint8_t;
+using std::uint64_t;
+
+namespace alex::cipher
+{
+    class cipher_tag_column
+    {
+    public:
+        static_assert(sizeof(cipher_tag::value_type) == sizeof(uint64_t) &&
+                      sizeof(cipher_tag::cipher_secret_type) == sizeof(uint64_t));
+
+        void push_back(cipher_tag const & t)
+        {
+            values_.push_back(uint64_t(t.value));
+            secrets_.push_back(uint64_t(t.s));
+        }
+
+        cipher_tag operator[](size_t i) const
+        {
+            cipher_tag t;
+            t.value = cipher_tag::value_type(values_[i]);
+            t.s = cipher_tag::cipher_secret_type(secrets_[i]);
+            return t;
+        }
+
+        void reserve(size_t n)
+        {
+            values_.reserve(n);
+            secrets_.reserve(n);
+        }
+
+        void resize(size_t n)
+        {
+            values_.resize(n);
+            secrets_.resize(n);
+        }
+
+        void clear()
+        {
+            values_.clear();
+            secrets_.clear();
+        }
+
+        size_t size() const { return values_.size(); }
+        bool empty() const { return values_.empty(); }
+
+        uint64_t const * values() const { return values_.data(); }
+        uint64_t const * secrets() const { return secrets_.data(); }
+        uint64_t * values() { return values_.data(); }
+        uint64_t * secrets() { return secrets_.data(); }
+
+    private:
+        vector<uint64_t> values_;
+        vector<uint64_t> secrets_;
+    };
+
+    class cipher_tag_matcher
+    {
+    public:
+        static constexpr size_t max_tags = 16;
+        static constexpr uint8_t reject = 0xff;
+
+        // returns nullopt if there are more than max_tags allowed tags.
+        static optional<cipher_tag_matcher> make(vector<cipher_tag> const & allowed)
+        {
+            if (allowed.size() > max_tags)
+                return nullopt;
+
+            cipher_tag_matcher m;
+            m.count_ = allowed.size();
+            m.one_secret_ = true;
+            for (size_t j = 0; j < allowed.size(); ++j)
+            {
+                m.values_[j] = uint64_t(allowed[j].value);
+                m.secrets_[j] = uint64_t(allowed[j].s);
+                m.one_secret_ = m.one_secret_ && m.secrets_[j] == m.secrets_[0];
+            }
+            return m;
+        }
+
+        size_t size() const { return count_; }
+
+        /**
+         * Sets index[i] to the index of the (first) allowed tag that record
+         * i of the n records of values and secrets equals, or to reject.
+         * Returns the number of rejected records.
+         */
+        size_t match(uint64_t const * values, uint64_t const * secrets, size_t n, uint8_t * index) const
+        {
+            size_t i = 0;
+#if defined(__AVX512F__)
+            __m512i tv[max_tags], ts[max_tags];
+            for (size_t j = 0; j < count_; ++j)
+            {
+                tv[j] = _mm512_set1_epi64(static_cast<long long>(values_[j]));
+                ts[j] = _mm512_set1_epi64(static_cast<long long>(secrets_[j]));
+            }
+            for (; i + 8 <= n; i += 8)
+            {
+                __m512i const v = _mm512_loadu_si512(values + i);
+                __m512i const s = _mm512_loadu_si512(secrets + i);
+                __mmask8 const same = one_secret_ ? _mm512_cmpeq_epi64_mask(s, ts[0]) : __mmask8(0xff);
+                __m512i r = _mm512_set1_epi64(reject);
+                // the first match wins, so the tags are compared in reverse.
+                for (size_t j = count_; j-- > 0; )
+                {
+                    __mmask8 m = _mm512_mask_cmpeq_epi64_mask(same, v, tv[j]);
+                    if (!one_secret_)
+                        m = _mm512_mask_cmpeq_epi64_mask(m, s, ts[j]);
+                    r = _mm512_mask_mov_epi64(r, m, _mm512_set1_epi64(static_cast<long long>(j)));
+                }
+                _mm_storel_epi64(reinterpret_cast<__m128i *>(index + i),
+                    _mm512_mask_cvtepi64_epi8(_mm_setzero_si128(), 0xff, r));
+            }
+#elif defined(__AVX2__)
+            __m256i tv[max_tags], ts[max_tags];
+            for (size_t j = 0; j < count_; ++j)
+            {
+                tv[j] = _mm256_set1_epi64x(static_cast<long long>(values_[j]));
+                ts[j] = _mm256_set1_epi64x(static_cast<long long>(secrets_[j]));
+            }
+            for (; i + 4 <= n; i += 4)
+            {
+                __m256i const v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(values + i));
+                __m256i const s = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(secrets + i));
+                __m256i const same = one_secret_ ? _mm256_cmpeq_epi64(s, ts[0]) : _mm256_set1_epi64x(-1);
+                __m256i r = _mm256_set1_epi64x(reject);
+                for (size_t j = count_; j-- > 0; )
+                {
+                    __m256i m = _mm256_and_si256(same, _mm256_cmpeq_epi64(v, tv[j]));
+                    if (!one_secret_)
+                        m = _mm256_and_si256(m, _mm256_cmpeq_epi64(s, ts[j]));
+                    r = _mm256_blendv_epi8(r, _mm256_set1_epi64x(static_cast<long long>(j)), m);
+                }
+                // the low byte of each 64-bit lane.
+                alignas(32) uint64_t lanes[4];
+                _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), r);
+                for (size_t l = 0; l < 4; ++l)
+                    index[i + l] = uint8_t(lanes[l]);
+            }
+#endif
+            for (; i < n; ++i)
+                index[i] = match_one(values[i], secrets[i]);
+
+            size_t rejected = 0;
+            for (size_t k = 0; k < n; ++k)
+                rejected += index[k] == reject;
+            return rejected;
+        }
+
+        size_t match(cipher_tag_column const & c, uint8_t * index) const
+        {
+            return match(c.values(), c.secrets(), c.size(), index);
+        }
+
+        /**
+         * Sets bit i % 64 of mask[i / 64] if record i matches no allowed
+         * tag. Returns the number of rejected records.
+         */
+        size_t reject_mask(cipher_tag_column const & c, uint64_t * mask) const
+        {
+            constexpr size_t block = 256;
+            uint8_t index[block];
+            size_t rejected = 0;
+            for (size_t i = 0; i < c.size(); i += block)
+            {
+                size_t const n = std::min(block, c.size() - i);
+                rejected += match(c.values() + i, c.secrets() + i, n, index);
+                for (size_t k = 0; k < n; k += 64)
+                {
+                    uint64_t bits = 0;
+                    for (size_t b = 0; b < 64 && k + b < n; ++b)
+                        bits |= uint64_t(index[k + b] == reject) << b;
+                    mask[(i + k) / 64] = bits;
+                }
+            }
+            return rejected;
+        }
+
+        uint8_t match_one(uint64_t value, uint64_t secret) const
+        {
+            for (size_t j = 0; j < count_; ++j)
+            {
+                if (values_[j] == value && secrets_[j] == secret)
+                    return uint8_t(j);
+            }
+            return reject;
+        }
+
+    private:
+        cipher_tag_matcher() = default;
+
+        uint64_t values_[max_tags] = {};
+        uint64_t secrets_[max_tags] = {};
+        size_t count_ = 0;
+        bool one_secret_ = true;
+    };
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+/**
+ * Column files (see columnar.hpp) of cipher tags.
+ *
+ * The values and the secrets of a cipher_tag_column are stored as two
+ * columns, tag_values_column and tag_secrets_column, each in the encoding
+ * in which it is smallest. The values of a column of random 64-bit tags
+ * are stored plain, 8 bytes each (about a third of their decimal text),
+ * and may be read in place from a column_file_view; the secrets, which are
+ * usually few, take a few bits each.
+ */
+
+#include <string>
+#include <optional>
+#include "cipher_tag_column.hpp"
+#include "../columnar.hpp"
+
+using std::string;
+using std::optional;
+using std::nullopt;
+
+namespace alex::cipher
+{
+    constexpr size_t tag_values_column = 0;
+    constexpr size_t tag_secrets_column = 1;
+
+    // writes the tags of c to the column file filename. returns false on
+    // failure.
+    inline bool write_tag_column_file(string const & filename, cipher_tag_column const & c,
+        column_encoding values = column_encoding::automatic,
+        column_encoding secrets = column_encoding::automatic)
+    {
+        column_file_writer w;
+        w.add(c.values(), c.size(), values);
+        w.add(c.secrets(), c.size(), secrets);
+        return w.write(filename);
+    }
+
+    /**
+     * Reads the tags of the column file filename. Returns nullopt if it is
+     * not a column file of tags or it is corrupt, i.e., if its checksum
+     * does not match (see column_file_view::verify).
+     */
+    inline optional<cipher_tag_column> read_tag_column_file(string const & filename)
+    {
+        auto v = column_file_view::open(filename);
+        if (!v || !v->verify() || v->column_count() != 2 ||
+            v->count(tag_values_column) != v->count(tag_secrets_column))
+            return nullopt;
+
+        cipher_tag_column c;
+        c.resize(v->count(tag_values_column));
+        if (!v->decode(tag_values_column, c.values()) ||
+            !v->decode(tag_secrets_column, c.secrets()))
+            return nullopt;
+        return c;
+    }
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+/**
+ * cipher_tag_interner hash-conses composite cipher tags.
+ *
+ * A composite tag is a tree of products, sums and functions over primitive
+ * cipher tags (see cipher_tag_composition.hpp), e.g., X+(Y*Z) is
+ *     (+ X (* Y Z)).
+ * The interner stores each distinct node once and names it by a tag_id, a
+ * 32-bit index. A composite node is interned after its children, so it is
+ * identified by its kind and the ids of its children, and structurally
+ * equal trees get the same id: equality of tags, however deep, is one
+ * integer compare.
+ *
+ * Each node memoizes its hash, which is computed from the kind and the
+ * memoized hashes of its children when it is interned. So interning a node
+ * costs O(1) expected (a hash of three words and a probe of the table), and
+ * the cipher_tag of a composite is the hash of its node, rather than a
+ * rehash of the tree on each conversion.
+ *
+ * The node table is open-addressed (linear probing, at most half full). A
+ * slot holds a node id and 32 bits of the node's hash, so a probe only
+ * reads a node when its hash bits match, i.e., interning a new node costs
+ * one cache miss. The nodes themselves are stored contiguously in the order
+ * they were interned. Ids are stable, since nodes are never removed.
+ *
+ * An interner is not thread-safe.
+ */
+
+#include <vector>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+#include "cipher_tag.hpp"
+#include "../ahs/ahs_hash.hpp"
+
+using std::vector;
+using std::size_t;
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+
+namespace alex::cipher
+{
+    struct tag_id
+    {
+        uint32_t value;
+
+        bool operator==(tag_id const &) const = default;
+    };
+
+    enum class tag_kind : uint8_t
+    {
+        primitive,
+        product,
+        sum,
+        fn
+    };
+
+    class cipher_tag_interner
+    {
+    public:
+        cipher_tag_interner() = default;
+
+        // the id of the primitive tag t.
+        tag_id primitive(cipher_tag const & t)
+        {
+            return intern(node{tag_kind::primitive, 0, 0,
+                ahs::mix64(uint64_t(t.value) ^ ahs::mix64(uint64_t(t.s))),
+                uint64_t(t.value), uint64_t(t.s)});
+        }
+
+        tag_id product(tag_id a, tag_id b) { return composite(tag_kind::product, a, b); }
+        tag_id sum(tag_id a, tag_id b) { return composite(tag_kind::sum, a, b); }
+        tag_id fn(tag_id domain, tag_id codomain) { return composite(tag_kind::fn, domain, codomain); }
+
+        tag_id composite(tag_kind k, tag_id a, tag_id b)
+        {
+            auto const & x = nodes_[a.value];
+            auto const & y = nodes_[b.value];
+            // the children are ordered, e.g., X*Y and Y*X differ.
+            uint64_t const h = ahs::mix64(
+                (x.hash * 0x9e3779b97f4a7c15ULL) ^ ahs::rotl64(y.hash, 31) ^
+                (uint64_t(k) + 1) * 0xc2b2ae3d27d4eb4fULL);
+            return intern(node{k, a.value, b.value, h, 0, x.s});
+        }
+
+        tag_kind kind(tag_id t) const { return nodes_[t.value].kind; }
+
+        // the children of a composite.
+        tag_id left(tag_id t) const { return tag_id{nodes_[t.value].a}; }
+        tag_id right(tag_id t) const { return tag_id{nodes_[t.value].b}; }
+
+        // the memoized structural hash of t.
+        uint64_t hash(tag_id t) const { return nodes_[t.value].hash; }
+
+        /**
+         * The cipher tag of t. A primitive is its own tag; a composite is
+         * tagged by its structural hash and the secret of its leftmost
+         * primitive.
+         */
+        cipher_tag tag(tag_id t) const
+        {
+            auto const & n = nodes_[t.value];
+            cipher_tag c;
+            c.value = cipher_tag::value_type(n.kind == tag_kind::primitive ? n.value : n.hash);
+            c.s = cipher_tag::cipher_secret_type(n.s);
+            return c;
+        }
+
+        // the number of distinct nodes.
+        size_t size() const { return nodes_.size(); }
+
+        void reserve(size_t n)
+        {
+            nodes_.reserve(n);
+            size_t slots = 16;
+            while (slots < 2 * n)
+                slots *= 2;
+            if (slots > table_.size())
+                rehash(slots);
+        }
+
+    private:
+        // a slot holds the node id plus one (0 if it is empty) and the low
+        // half of the node's hash. the slot of a hash is given by its top
+        // bits, which are independent of the low half.
+        struct slot
+        {
+            uint32_t id;
+            uint32_t check;
+        };
+
+        static constexpr uint32_t no_node = 0;
+
+        struct node
+        {
+            tag_kind kind;
+            uint32_t a;
+            uint32_t b;
+            uint64_t hash;
+            // the value of a primitive, and the secret of its leftmost
+            // primitive.
+            uint64_t value;
+            uint64_t s;
+
+            bool same(node const & rhs) const
+            {
+                return kind == rhs.kind && a == rhs.a && b == rhs.b &&
+                    value == rhs.value && s == rhs.s;
+            }
+        };
+
+        size_t mask() const { return table_.size() - 1; }
+
+        size_t home(uint64_t h) const { return size_t(h >> shift_); }
+
+        tag_id intern(node const & n)
+        {
+            if (2 * (nodes_.size() + 1) > table_.size())
+                rehash(std::max<size_t>(16, 2 * table_.size()));
+
+            uint32_t const check = uint32_t(n.hash);
+            size_t i = home(n.hash);
+            for (; table_[i].id != no_node; i = (i + 1) & mask())
+            {
+                if (table_[i].check == check && nodes_[table_[i].id - 1].same(n))
+                    return tag_id{table_[i].id - 1};
+            }
+
+            nodes_.push_back(n);
+            table_[i] = slot{uint32_t(nodes_.size()), check};
+            return tag_id{uint32_t(nodes_.size() - 1)};
+        }
+
+        void rehash(size_t slots)
+        {
+            table_.assign(slots, slot{no_node, 0});
+            shift_ = unsigned(64 - std::countr_zero(slots));
+            for (uint32_t e = 0; e < nodes_.size(); ++e)
+            {
+                size_t i = home(nodes_[e].hash);
+                while (table_[i].id != no_node)
+                    i = (i + 1) & mask();
+                table_[i] = slot{e + 1, uint32_t(nodes_[e].hash)};
+            }
+        }
+
+        vector<node> nodes_;
+        vector<slot> table_;
+        unsigned shift_ = 64;
+    };
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+/**
+ * A bulk reader of cipher tags in the text format of deserialize<cipher_tag>
+ * (see cipher_tag.hpp): a sequence of whitespace-separated pairs
+ *     secret value
+ * of unsigned 64-bit numbers, in decimal or, with a 0x prefix, in hex.
+ *
+ * parse_cipher_tags reads a whole buffer into a cipher_tag_column (see
+ * cipher_tag_column.hpp). Unlike deserialize<cipher_tag>, which calls
+ * strtoull on NUL-terminated tokens, it reads the buffer in place and does
+ * not depend on the locale. Decimal numbers are read 8 digits at a time:
+ * 8 bytes are tested for digits and converted with a few multiplies (SWAR,
+ * i.e., SIMD within a 64-bit register); only a 20th digit is checked for
+ * overflow. Hex numbers, and the rare decimal numbers of more than 20
+ * digits, are read with std::from_chars.
+ *
+ * On an error, the result gives its message and the offset in the buffer
+ * of the token at fault; the tags before it are in the column.
+ */
+
+#include <string_view>
+#include <charconv>
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+#include "cipher_tag_column.hpp"
+#include "../ahs/ahs_hash.hpp"
+
+using std::string_view;
+using std::uint64_t;
+using std::size_t;
+
+namespace alex::cipher
+{
+    struct tag_parse_result
+    {
+        // the number of tags read.
+        size_t tags = 0;
+
+        // the error, if any, and the offset of the token at fault.
+        char const * error = nullptr;
+        size_t error_offset = 0;
+
+        explicit operator bool() const { return error == nullptr; }
+    };
+
+    namespace detail
+    {
+        constexpr uint64_t ascii_zeros = 0x3030303030303030ULL;
+
+        // a mask of the high bit of each byte of x that is not a digit.
+        inline uint64_t non_digits(uint64_t x)
+        {
+            return ((x - ascii_zeros) | (x + 0x4646464646464646ULL)) & 0x8080808080808080ULL;
+        }
+
+        // the value of 8 digits, the first in the low byte of x.
+        inline uint64_t parse_eight_digits(uint64_t x)
+        {
+            x -= ascii_zeros;
+            x = (x * 10) + (x >> 8);
+            return (((x & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32))) +
+                    (((x >> 16) & 0x000000ff000000ffULL) * (1 + (10000ULL << 32)))) >> 32;
+        }
+
+        constexpr uint64_t pow10(size_t n)
+        {
+            uint64_t p = 1;
+            while (n-- > 0)
+                p *= 10;
+            return p;
+        }
+
+        /**
+         * Reads the decimal number at p into v. Returns the end of its
+         * digits, or nullptr if it has none or overflows.
+         */
+        inline char const * parse_decimal(char const * p, char const * end, uint64_t & v)
+        {
+            char const * const begin = p;
+            uint64_t x = 0;
+            while (end - p >= 8)
+            {
+                uint64_t const w = ahs::load_le64(p);
+                uint64_t const nd = non_digits(w);
+                if (nd == 0)
+                {
+                    x = x * 100000000ULL + parse_eight_digits(w);
+                    p += 8;
+                    if (p - begin == 16)
+                        break;
+                    continue;
+                }
+
+                // the n digits before the first non-digit, shifted up and
+                // padded with leading zeros.
+                size_t const n = size_t(std::countr_zero(nd)) / 8;
+                if (n != 0)
+                {
+                    uint64_t const digits = (w << (64 - 8 * n)) | (ascii_zeros >> (8 * n));
+                    x = x * pow10(n) + parse_eight_digits(digits);
+                    p += n;
+                }
+                break;
+            }
+            // up to 19 digits, which cannot overflow.
+            while (p != end && unsigned(*p - '0') < 10 && p - begin < 19)
+            {
+                x = x * 10 + uint64_t(*p - '0');
+                ++p;
+            }
+            if (p == begin)
+                return nullptr;
+
+            // a 20th digit may overflow.
+            if (p != end && unsigned(*p - '0') < 10)
+            {
+                if (__builtin_mul_overflow(x, 10, &x) || __builtin_add_overflow(x, uint64_t(*p - '0'), &x))
+                    return nullptr;
+                ++p;
+            }
+            if (p - begin <= 20 && (p == end || unsigned(*p - '0') >= 10))
+            {
+                v = x;
+                return p;
+            }
+
+            // more than 20 digits, which are in range only with leading
+            // zeros; from_chars finds whether they are.
+            auto const r = std::from_chars(begin, end, v, 10);
+            return r.ec == std::errc() ? r.ptr : nullptr;
+        }
+
+        inline bool tag_space(char c)
+        {
+            return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+        }
+    }
+
+    /**
+     * Appends the tags of buffer to column.
+     */
+    inline tag_parse_result parse_cipher_tags(string_view buffer, cipher_tag_column & column)
+    {
+        tag_parse_result r;
+        char const * const begin = buffer.data();
+        char const * const end = begin + buffer.size();
+        char const * p = begin;
+
+        auto fail = [&](char const * what, char const * at)
+        {
+            r.error = what;
+            r.error_offset = size_t(at - begin);
+            return r;
+        };
+
+        uint64_t fields[2];
+        for (;;)
+        {
+            char const * field_begin = p;
+            for (int f = 0; f < 2; ++f)
+            {
+                while (p != end && detail::tag_space(*p))
+                    ++p;
+                if (p == end)
+                {
+                    if (f == 0)
+                        return r;
+                    return fail("a secret without a value", field_begin);
+                }
+                field_begin = p;
+
+                char const * q;
+                if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+                {
+                    auto const c = std::from_chars(p + 2, end, fields[f], 16);
+                    if (c.ec == std::errc::result_out_of_range)
+                        return fail("number out of range", p);
+                    q = c.ec == std::errc() ? c.ptr : nullptr;
+                }
+                else
+                {
+                    q = detail::parse_decimal(p, end, fields[f]);
+                    if (q == nullptr && p != end && unsigned(*p - '0') < 10)
+                        return fail("number out of range", p);
+                }
+                if (q == nullptr || (q != end && !detail::tag_space(*q)))
+                    return fail("not a number", p);
+                p = q;
+            }
+
+            cipher_tag t;
+            t.s = cipher_tag::cipher_secret_type(fields[0]);
+            t.value = cipher_tag::value_type(fields[1]);
+            column.push_back(t);
+            ++r.tags;
+        }
+    }
+}
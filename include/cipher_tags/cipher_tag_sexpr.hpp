@@ -0,0 +1,349 @@
+#pragma once
+
+/**
+ * A streaming reader of composite cipher tags serialized as S-expressions,
+ * e.g., as written by serialize<cipher_tag_product>,
+ *     (product (cipher_secret 42) 1234 (sum 5678 91011))
+ * which it interns into a cipher_tag_interner (see cipher_tag_interner.hpp).
+ *
+ * The grammar,
+ *     tag       := number | (op [secret] tag tag...)
+ *     op        := product | * | sum | + | fn | ->
+ *     secret    := (cipher_secret number)
+ * where a number is a primitive tag, whose secret is given by the nearest
+ * enclosing cipher_secret (or 0). product and sum take two or more operands
+ * and associate to the left, i.e., (* X Y Z) is (* (* X Y) Z); fn takes a
+ * domain and a codomain.
+ *
+ * The parser is incremental: feed() takes the input in chunks of any size,
+ * and a token or tag may span chunks, since the parser keeps its state (a
+ * partial number or keyword and the stack of open lists) between calls. It
+ * does not allocate: the stack has a fixed depth (max_depth) and keywords
+ * are matched in a fixed buffer. Each complete top-level tag is passed to a
+ * callback as its tag_id as soon as its closing parenthesis is read.
+ */
+
+#include <string>
+#include <string_view>
+#include <istream>
+#include <optional>
+#include <cstring>
+#include <cstdint>
+#include "cipher_tag_interner.hpp"
+#include "../mapped_file.hpp"
+
+using std::string;
+using std::string_view;
+using std::optional;
+using std::nullopt;
+using std::uint64_t;
+
+namespace alex::cipher
+{
+    class cipher_tag_sexpr_parser
+    {
+    public:
+        static constexpr size_t max_depth = 256;
+
+        explicit cipher_tag_sexpr_parser(cipher_tag_interner & interner) : in_(&interner) {}
+
+        /**
+         * Parses the next chunk of the input, calling f(tag_id) for each
+         * complete top-level tag. Returns false on a syntax error, after
+         * which the parser stays failed; see error() and error_offset().
+         */
+        template <typename F>
+        bool feed(string_view chunk, F && f)
+        {
+            char const * p = chunk.data();
+            char const * const end = p + chunk.size();
+            while (p != end && !failed())
+            {
+                char const c = *p;
+                if (token_ == token::number)
+                {
+                    // the common case, so digits are consumed in a tight loop.
+                    char const * q = p;
+                    while (q != end && unsigned(*q - '0') < 10)
+                    {
+                        uint64_t const d = uint64_t(*q - '0');
+                        if (number_ > (UINT64_MAX - d) / 10)
+                        {
+                            offset_ += uint64_t(q - p);
+                            return fail("number out of range");
+                        }
+                        number_ = number_ * 10 + d;
+                        ++q;
+                    }
+                    offset_ += uint64_t(q - p);
+                    p = q;
+                    if (p == end)
+                        break;
+                    if (!delimiter(*p))
+                        return fail("bad number");
+                    token_ = token::none;
+                    if (!on_number(f))
+                        return false;
+                    continue;
+                }
+                if (token_ == token::symbol)
+                {
+                    if (!delimiter(c))
+                    {
+                        if (symbol_size_ == sizeof(symbol_))
+                            return fail("unknown keyword");
+                        symbol_[symbol_size_++] = c;
+                        ++p;
+                        ++offset_;
+                        continue;
+                    }
+                    token_ = token::none;
+                    if (!on_symbol())
+                        return false;
+                    continue;
+                }
+
+                if (c == '(')
+                {
+                    if (depth_ == max_depth)
+                        return fail("too deeply nested");
+                    frame & fr = stack_[depth_];
+                    fr = frame{};
+                    fr.secret = depth_ == 0 ? 0 : stack_[depth_ - 1].secret;
+                    ++depth_;
+                }
+                else if (c == ')')
+                {
+                    if (!on_close(f))
+                        return false;
+                }
+                else if (unsigned(c - '0') < 10)
+                {
+                    token_ = token::number;
+                    number_ = 0;
+                    continue;
+                }
+                else if (!space(c))
+                {
+                    token_ = token::symbol;
+                    symbol_size_ = 0;
+                    continue;
+                }
+                ++p;
+                ++offset_;
+            }
+            return !failed();
+        }
+
+        /**
+         * Ends the input. Returns false if it ends inside a tag.
+         */
+        template <typename F>
+        bool finish(F && f)
+        {
+            if (failed())
+                return false;
+            if (token_ == token::number)
+            {
+                token_ = token::none;
+                if (!on_number(f))
+                    return false;
+            }
+            else if (token_ == token::symbol)
+            {
+                token_ = token::none;
+                if (!on_symbol())
+                    return false;
+            }
+            if (depth_ != 0)
+                return fail("unexpected end of input");
+            return true;
+        }
+
+        bool failed() const { return error_ != nullptr; }
+
+        // the syntax error, and the offset in the input at which it was
+        // found.
+        char const * error() const { return error_; }
+        uint64_t error_offset() const { return offset_; }
+
+        // the number of top-level tags read.
+        uint64_t count() const { return count_; }
+
+    private:
+        enum class token : uint8_t { none, number, symbol };
+
+        // what the list on the top of the stack is.
+        enum class list_kind : uint8_t { open, composite, secret };
+
+        struct frame
+        {
+            list_kind kind = list_kind::open;
+            tag_kind op = tag_kind::product;
+            bool has_secret = false;
+            uint32_t operands = 0;
+            uint64_t secret = 0;
+            // the operands so far, folded to the left.
+            tag_id acc{0};
+        };
+
+        static bool space(char c)
+        {
+            return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+        }
+
+        static bool delimiter(char c)
+        {
+            return space(c) || c == '(' || c == ')';
+        }
+
+        bool fail(char const * what)
+        {
+            error_ = what;
+            return false;
+        }
+
+        template <typename F>
+        bool emit(tag_id t, F & f)
+        {
+            if (depth_ == 0)
+            {
+                ++count_;
+                f(t);
+                return true;
+            }
+
+            frame & fr = stack_[depth_ - 1];
+            if (fr.kind != list_kind::composite)
+                return fail("operand outside of an operation");
+            if (fr.operands == 0)
+                fr.acc = t;
+            else if (fr.op == tag_kind::fn && fr.operands == 2)
+                return fail("fn takes two operands");
+            else
+                fr.acc = in_->composite(fr.op, fr.acc, t);
+            ++fr.operands;
+            return true;
+        }
+
+        template <typename F>
+        bool on_number(F & f)
+        {
+            if (depth_ != 0 && stack_[depth_ - 1].kind == list_kind::secret)
+            {
+                frame & fr = stack_[depth_ - 1];
+                if (fr.has_secret)
+                    return fail("cipher_secret takes one number");
+                fr.secret = number_;
+                fr.has_secret = true;
+                return true;
+            }
+
+            cipher_tag t;
+            t.value = cipher_tag::value_type(number_);
+            t.s = cipher_tag::cipher_secret_type(depth_ == 0 ? 0 : stack_[depth_ - 1].secret);
+            return emit(in_->primitive(t), f);
+        }
+
+        bool on_symbol()
+        {
+            if (depth_ == 0 || stack_[depth_ - 1].kind != list_kind::open)
+                return fail("unexpected keyword");
+
+            string_view const s(symbol_, symbol_size_);
+            frame & fr = stack_[depth_ - 1];
+            fr.kind = list_kind::composite;
+            if (s == "product" || s == "*")
+                fr.op = tag_kind::product;
+            else if (s == "sum" || s == "+")
+                fr.op = tag_kind::sum;
+            else if (s == "fn" || s == "->")
+                fr.op = tag_kind::fn;
+            else if (s == "cipher_secret")
+            {
+                if (depth_ < 2 || stack_[depth_ - 2].kind != list_kind::composite ||
+                    stack_[depth_ - 2].operands != 0)
+                    return fail("cipher_secret must precede the operands");
+                fr.kind = list_kind::secret;
+            }
+            else
+                return fail("unknown keyword");
+            return true;
+        }
+
+        template <typename F>
+        bool on_close(F & f)
+        {
+            if (depth_ == 0)
+                return fail("unbalanced ')'");
+
+            frame const fr = stack_[--depth_];
+            switch (fr.kind)
+            {
+            case list_kind::open:
+                return fail("empty list");
+            case list_kind::secret:
+                if (!fr.has_secret)
+                    return fail("cipher_secret takes one number");
+                stack_[depth_ - 1].secret = fr.secret;
+                return true;
+            case list_kind::composite:
+                if (fr.operands < 2)
+                    return fail("an operation takes two or more operands");
+                return emit(fr.acc, f);
+            }
+            return true;
+        }
+
+        cipher_tag_interner * in_;
+        frame stack_[max_depth];
+        size_t depth_ = 0;
+
+        token token_ = token::none;
+        uint64_t number_ = 0;
+        char symbol_[16];
+        size_t symbol_size_ = 0;
+
+        uint64_t offset_ = 0;
+        uint64_t count_ = 0;
+        char const * error_ = nullptr;
+    };
+
+    /**
+     * Reads the tags of in, in chunks of chunk_size bytes, calling f(tag_id)
+     * for each. Returns the parser, to check for errors.
+     */
+    template <typename F>
+    cipher_tag_sexpr_parser read_tags(std::istream & in, cipher_tag_interner & interner,
+        F && f, size_t chunk_size = size_t(1) << 16)
+    {
+        cipher_tag_sexpr_parser p(interner);
+        string buf(chunk_size, '\0');
+        while (in)
+        {
+            in.read(buf.data(), std::streamsize(buf.size()));
+            if (!p.feed(string_view(buf.data(), size_t(in.gcount())), f))
+                return p;
+        }
+        p.finish(f);
+        return p;
+    }
+
+    /**
+     * Reads the tags of the file filename, which is memory-mapped and parsed
+     * as a single chunk. Returns nullopt if it cannot be opened.
+     */
+    template <typename F>
+    optional<cipher_tag_sexpr_parser> read_tags(string const & filename,
+        cipher_tag_interner & interner, F && f)
+    {
+        mapped_file file;
+        if (!file.open(filename))
+            return nullopt;
+        file.advise(MADV_SEQUENTIAL);
+        cipher_tag_sexpr_parser p(interner);
+        if (p.feed(string_view(file.data(), file.size()), f))
+            p.finish(f);
+        return p;
+    }
+}
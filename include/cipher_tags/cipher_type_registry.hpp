@@ -67,7 +67,13 @@
 #include <functional>
 #include <string_view>
 #include <optional>
+#include <type_traits>
+#include <cstdint>
 #include "cipher_tag.hpp"
+#include "label_cipher_table.hpp"
+#include "keyed_hash.hpp"
+#include "static_type_tag.hpp"
+#include "cipher_type_registry_file.hpp"
 
 using std::string;
 using std::move;
@@ -89,19 +95,40 @@ namespace alex::cipher
     // is not known, then only the type equality query is provided, i.e.,
     // whatever types two values represent, we can determine if they have the
     // same type.
-    template <size_t MagicBits>
-    struct cipher_tag_registry
+    //
+    // the labels and cipher types are kept in a label_cipher_table, so that
+    // a type may be looked up by its label or by its cipher type in O(1).
+    //
+    // cipher types are keyed hashes (see keyed_hash.hpp), by default
+    // SipHash-2-4 with a key derived from the secret and MagicBits, so they
+    // are the same for every compiler and platform. a key is derived from
+    // the secret once per call; to tag many values, derive it with key()
+    // and pass it instead of the secret.
+    //
+    // the cipher type of a C++ type T is its compile-time fingerprint (see
+    // static_type_tag.hpp) combined with a type_key derived from the key,
+    // so with a type_key, is_type<T> is a multiply-xor and a compare.
+    //
+    // save() writes the registry in a binary format that view_type answers
+    // queries from directly, without loading it (see
+    // cipher_type_registry_file.hpp).
+    template <size_t MagicBits, typename KeyedHash = siphash24>
+    struct cipher_type_registry
     {
         using trapdoor_type = size_t;
         using cipher_type = size_t;
         using label_type = string;
         using secret_type = string_view;
+        using key_type = KeyedHash;
+        using view_type = cipher_type_registry_view<cipher_type_registry>;
+
+        static_assert(sizeof(cipher_type) == sizeof(uint64_t));
 
         // approximate type on
         //     == : cipher_type_info -> cipher_type_info -> bool
-        struct cipher_tag_info
+        struct cipher_type_info
         {
-            cipher_tag value;
+            cipher_type value;
             cipher_type_registry const & reg;
 
             bool operator==(cipher_type_info const & rhs) const
@@ -126,7 +153,7 @@ namespace alex::cipher
             template <typename T>
             bool is_type(secret_type s) const
             {
-                return reg.is_type<T>(value, s);
+                return reg.template is_type<T>(value, s);
             }
 
             // determine if ciphertype denotes a cipher type.
@@ -153,7 +180,7 @@ namespace alex::cipher
                 static auto cipher_of_secret() { return true; }
 
                 // the version of the cipher type info
-                static auto version() { return static_cast<size_t>(1); }
+                static auto version() { return static_cast<size_t>(2); }
 
                 // the header. this may be revealed in the type system too,
                 // so that there can be common agreement on the algorithms.
@@ -161,7 +188,7 @@ namespace alex::cipher
 
                 // a small customization point so that even if the same secret
                 // is in use, different ciphers of the same types may be
-                // generated by varying magicbits().
+                // generated by varying magicbits(). it tweaks the key.
                 static auto magic_bits() { return MagicBits; }
             } ret;
             return ret;
@@ -173,27 +200,55 @@ namespace alex::cipher
         cipher_type_registry(secret_type secret) : secret_hash_(cipher_of_secret(secret)) {}
         cipher_type_registry(istream & in) { deserialize(in); }
 
+        // a mutable copy of the registry of a view.
+        explicit cipher_type_registry(view_type const & v) : secret_hash_(v.cipher_of_secret())
+        {
+            tags_.reserve(v.size());
+            v.for_each([&](string_view label, cipher_type c)
+            {
+                tags_.insert_or_assign(string(label), c);
+            });
+        }
+
+        // the key of the cipher types of secret.
+        static key_type key(secret_type secret)
+        {
+            return key_type(secret, MagicBits);
+        }
+
         static trapdoor_type cipher_of_secret(secret_type secret)
         {
-            return hash<string_view>{}(secret) ^ MagicBits;
+            return key(secret).check();
         }
 
         template <typename T>
         bool insert(string type, secret_type s)
         {
-            if (!is_secret(s))
+            return insert<T>(move(type), key(s));
+        }
+
+        template <typename T>
+        bool insert(string type, key_type const & k)
+        {
+            if (!is_key(k))
                 return false;
 
-            tags_[move(type)] = cipher(typeid(T).hash_code(), s);
+            tags_.insert_or_assign(move(type), type_cipher<T>(type_tag_key(k)));
             return true;
         }
 
         bool insert(string type, secret_type s)
         {
-            if (!is_secret(s))
+            return insert(move(type), key(s));
+        }
+
+        bool insert(string type, key_type const & k)
+        {
+            if (!is_key(k))
                 return false;
 
-            tags_[move(type)] = cipher(type, s);
+            auto c = cipher(type, k);
+            tags_.insert_or_assign(move(type), c);
             return true;
         }
 
@@ -201,18 +256,65 @@ namespace alex::cipher
         // False positive with probability 2^-H where H := sizeof(hash_type).
         bool is_secret(secret_type s) const
         {
-            return cipher_of_secret() == cipher_of_secret(s);
+            return is_key(key(s));
+        }
+
+        bool is_key(key_type const & k) const
+        {
+            return cipher_of_secret() == k.check();
         }
 
         template <typename T>
         static cipher_type cipher(T const & x, secret_type s)
         {
-            return hash<T>{}(x) ^ hash<string_view>{}(s) ^ MagicBits;
+            return cipher(x, key(s));
+        }
+
+        // strings are hashed by their bytes and integers by their value, so
+        // their cipher types are portable. other types fall back on
+        // std::hash, whose values are not.
+        template <typename T>
+        static cipher_type cipher(T const & x, key_type const & k)
+        {
+            if constexpr (std::is_convertible_v<T const &, string_view>)
+                return k(string_view(x));
+            else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>)
+                return k(uint64_t(x));
+            else
+                return k(uint64_t(hash<T>{}(x)));
+        }
+
+        // the key of the cipher types of C++ types.
+        static type_key type_tag_key(key_type const & k)
+        {
+            return type_key(k);
+        }
+
+        static type_key type_tag_key(secret_type s)
+        {
+            return type_key(key(s));
+        }
+
+        template <typename T>
+        static constexpr cipher_type type_cipher(type_key const & k)
+        {
+            return cipher_type(static_type_cipher<T>(k));
+        }
+
+        // out[i] = cipher(xs[i], k) for i in [0,n), several at a time.
+        static void cipher_many(string_view const * xs, size_t n, key_type const & k, cipher_type * out)
+        {
+            k.hash_many(xs, n, reinterpret_cast<uint64_t *>(out));
+        }
+
+        static void cipher_many(uint64_t const * xs, size_t n, key_type const & k, cipher_type * out)
+        {
+            k.hash_many(xs, n, reinterpret_cast<uint64_t *>(out));
         }
 
         struct const_iterator
         {
-            map<string, cipher_type>::const_iterator cur;
+            typename label_cipher_table<cipher_type>::const_iterator cur;
             cipher_type_registry const & r;
 
             bool operator==(const_iterator const & rhs) const
@@ -240,10 +342,17 @@ namespace alex::cipher
             o << metadata().version() << "\n";
             o << cipher_of_secret() << "\n";
             o << size() << "\n";
-            for (auto const & t : *this)
+            for (auto const & t : tags_)
                 o << t.first << "\t" << t.second << "\n";
         }
 
+        // writes the registry to the registry file filename, for view_type.
+        // returns false on failure.
+        bool save(string const & filename) const
+        {
+            return write_registry_file(filename, uint64_t(MagicBits), uint64_t(secret_hash_), tags_);
+        }
+
         bool deserialize(istream & is)
         {
             string hdr;
@@ -259,11 +368,14 @@ namespace alex::cipher
             is >> secret_hash_;
             size_t n;
             is >> n;
+            tags_.reserve(n);
             for (size_t i = 0; i < n; ++i)
             {
                 string type_label;
-                is >> type_label;
-                is >> tags_[type_label];
+                cipher_type t;
+                if (!(is >> type_label >> t))
+                    return false;
+                tags_.insert_or_assign(move(type_label), t);
             }
             return true;
         }
@@ -281,25 +393,22 @@ namespace alex::cipher
             if (!is_secret(s))
                 return nullopt;
 
-            for (auto const & x : tags_)
-            {
-                if (x.second == t)
-                    return x.first;
-            }
+            if (auto label = tags_.label_of(t))
+                return string(*label);
             return nullopt;
         }
 
+
         template <typename T>
-        T as_type(cipher_value<T> x, secret_type s) const
+        bool is_type(cipher_type t, secret_type s) const
         {
-            return 
+            return is_type<T>(t, type_tag_key(s));
         }
 
-
         template <typename T>
-        bool is_type(cipher_type t, secret_type s) const
+        bool is_type(cipher_type t, type_key const & k) const
         {
-            return cipher(typeid(T).hash_code(), s) == t;
+            return type_cipher<T>(k) == t;
         }
 
         // determine if ciphertype denotes a cipher type.
@@ -310,17 +419,11 @@ namespace alex::cipher
             if (!is_secret(s))
                 return false;
 
-            for (auto const & x : tags_)
-            {
-                if (x.second == t)
-                    return true;
-            }
-            return false;
-
+            return tags_.contains_cipher(t);
         }
 
     private:
         trapdoor_type secret_hash_;
-        map<string, cipher_type> tags_;
+        label_cipher_table<cipher_type> tags_;
     };
 }
\ No newline at end of file
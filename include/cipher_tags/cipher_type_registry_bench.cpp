@@ -0,0 +1,180 @@
+/**
+ * Compares the lookups of cipher_type_registry, which keeps its types in a
+ * label_cipher_table, against the std::map it used to keep them in, where
+ * finding the label of a cipher type is a linear scan; and measures the
+ * throughput of tagging values one at a time and with cipher_many.
+ *
+ * Build and run, e.g.,
+ *     g++ -std=c++2a -O2 -march=native cipher_type_registry_bench.cpp -o bench && ./bench
+ */
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <optional>
+#include "label_cipher_table.hpp"
+#include "cipher_type_registry.hpp"
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::map;
+using std::optional;
+using std::nullopt;
+using std::cout;
+
+using clock_type = std::chrono::steady_clock;
+
+// the registry's former lookups.
+struct map_registry
+{
+    map<string, size_t> tags;
+
+    optional<string> plaintext(size_t t) const
+    {
+        for (auto const & x : tags)
+        {
+            if (x.second == t)
+                return x.first;
+        }
+        return nullopt;
+    }
+
+    bool is_any_type(size_t t) const
+    {
+        for (auto const & x : tags)
+        {
+            if (x.second == t)
+                return true;
+        }
+        return false;
+    }
+};
+
+template <typename F>
+double ns_per_op(size_t ops, F f)
+{
+    auto start = clock_type::now();
+    f();
+    std::chrono::duration<double, std::nano> d = clock_type::now() - start;
+    return d.count() / double(ops);
+}
+
+int main()
+{
+    std::mt19937_64 rng(1);
+    size_t sink = 0;
+
+    cout << "types\tinsert (map)\tinsert (flat)\tplaintext (map)\tplaintext (flat)\tis_any_type (map)\tis_any_type (flat)\n";
+    for (size_t n : {10, 100, 1000, 10000})
+    {
+        vector<string> labels;
+        vector<size_t> ciphers;
+        for (size_t i = 0; i < n; ++i)
+        {
+            labels.push_back("type_" + std::to_string(rng()));
+            ciphers.push_back(rng());
+        }
+
+        map_registry m;
+        alex::cipher::label_cipher_table<size_t> t;
+        double const insert_map = ns_per_op(n, [&]
+        {
+            for (size_t i = 0; i < n; ++i)
+                m.tags[labels[i]] = ciphers[i];
+        });
+        double const insert_flat = ns_per_op(n, [&]
+        {
+            for (size_t i = 0; i < n; ++i)
+                t.insert_or_assign(labels[i], ciphers[i]);
+        });
+
+        // half of the queries are types that are not in the registry.
+        size_t const q = std::max<size_t>(1000, 10000000 / n);
+        vector<size_t> queries(q);
+        for (auto & x : queries)
+            x = rng() % 2 ? ciphers[rng() % n] : rng();
+
+        for (size_t i = 0; i < 1000; ++i)
+        {
+            auto a = m.plaintext(queries[i]);
+            auto b = t.label_of(queries[i]);
+            if (a.has_value() != b.has_value() || (a && *a != *b))
+            {
+                std::cerr << "mismatch\n";
+                return 1;
+            }
+        }
+
+        double const plain_map = ns_per_op(q, [&]
+        {
+            for (auto x : queries)
+                sink += m.plaintext(x) ? 1 : 0;
+        });
+        double const plain_flat = ns_per_op(q, [&]
+        {
+            for (auto x : queries)
+                sink += t.label_of(x) ? 1 : 0;
+        });
+        double const any_map = ns_per_op(q, [&]
+        {
+            for (auto x : queries)
+                sink += m.is_any_type(x);
+        });
+        double const any_flat = ns_per_op(q, [&]
+        {
+            for (auto x : queries)
+                sink += t.contains_cipher(x);
+        });
+
+        cout << n << "\t" << insert_map << "\t" << insert_flat << "\t"
+             << plain_map << "\t" << plain_flat << "\t"
+             << any_map << "\t" << any_flat << "\n";
+    }
+    cout << "(ns per operation; " << sink << ")\n";
+
+    using registry = alex::cipher::cipher_type_registry<0>;
+    auto const key = registry::key("secret");
+    size_t const n = size_t(1) << 22;
+    vector<uint64_t> values(n);
+    vector<string> labels(n);
+    vector<string_view> views(n);
+    size_t label_bytes = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        values[i] = rng();
+        labels[i] = "type_" + std::to_string(rng() % 1000000000);
+        views[i] = labels[i];
+        label_bytes += labels[i].size();
+    }
+
+    vector<size_t> tags(n);
+    double const one_value = ns_per_op(n, [&]
+    {
+        for (size_t i = 0; i < n; ++i)
+            tags[i] = registry::cipher(values[i], key);
+    });
+    double const many_values = ns_per_op(n, [&]
+    {
+        registry::cipher_many(values.data(), n, key, tags.data());
+    });
+    double const one_label = ns_per_op(n, [&]
+    {
+        for (size_t i = 0; i < n; ++i)
+            tags[i] = registry::cipher(views[i], key);
+    });
+    double const many_labels = ns_per_op(n, [&]
+    {
+        registry::cipher_many(views.data(), n, key, tags.data());
+    });
+
+    double const label_size = double(label_bytes) / double(n);
+    cout << "\ntagging\tcipher (ns, GB/s)\tcipher_many (ns, GB/s)\n";
+    cout << "values\t" << one_value << ", " << 8 / one_value << "\t"
+         << many_values << ", " << 8 / many_values << "\n";
+    cout << "labels\t" << one_label << ", " << label_size / one_label << "\t"
+         << many_labels << ", " << label_size / many_labels << "\n";
+}
@@ -20,7 +20,7 @@ using std::map;
  * For a cipher constructor, if (approximate) strong typing is desired, then 
  */
 
-#include "cipher_type_tagger.hpp"
+#include "cipher_type_registry.hpp"
 
 int main()
 {
@@ -56,7 +56,7 @@ int main()
     std::cout << tagger.metadata().header() << "\n";
 
 
-    auto nfo = tagger.type_info(8947580955690856278);
+    auto nfo = tagger.type_info(18371284338183943647ULL);
     std::cout << nfo.is_type<int>("secret") << "\n";
     std::cout << nfo.is_any_type("secret") << "\n";
     std::cout << nfo.is_type<bool>("secret") << "\n";
@@ -0,0 +1,370 @@
+#pragma once
+
+/**
+ * A binary file format for cipher_type_registry, laid out to be used
+ * directly from a memory mapping (see mapped_file.hpp).
+ *
+ * The text format of cipher_type_registry::serialize must be parsed and
+ * inserted type by type before the first query. A registry file instead
+ * holds its hash tables pre-built, so cipher_type_registry_view opens it
+ * with a system call and answers plaintext, is_type and is_any_type from
+ * the mapped bytes; a query only touches the pages it probes.
+ *
+ * The file format,
+ * ---
+ * registry_file_header   (128 bytes)
+ * entries                (count registry_file_entry, in insertion order)
+ * label table            (slot_count uint32)
+ * cipher table           (slot_count uint32)
+ * labels                 (the labels, concatenated)
+ *
+ * The tables are open-addressed with linear probing and at most half full.
+ * A slot holds the position of an entry plus one, or 0 if it is empty. The
+ * label table is keyed by ahs::hash_bytes of the label, so it is the same
+ * for every compiler, and the cipher table by ahs::mix64 of the cipher type.
+ * Entries are inserted in order, so the first entry of a cipher type on its
+ * probe sequence is the first inserted, as in label_cipher_table.
+ *
+ * The checksum is ahs::hash_bytes of everything after the header. It is
+ * checked by verify(), not by open(), which would read the whole file.
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include "../ahs/ahs_hash.hpp"
+#include "../mapped_file.hpp"
+#include "static_type_tag.hpp"
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::optional;
+using std::nullopt;
+using std::uint64_t;
+using std::uint32_t;
+
+namespace alex::cipher
+{
+    struct registry_file_header
+    {
+        static constexpr char const * magic_bytes() { return "CTREG\0\0"; }
+        static constexpr uint32_t current_version() { return 1; }
+
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved0;
+
+        // the registry's MagicBits and cipher_of_secret().
+        uint64_t magic_bits;
+        uint64_t secret_hash;
+
+        uint64_t count;
+        uint64_t slot_count;
+        uint64_t entries_offset;
+        uint64_t label_table_offset;
+        uint64_t cipher_table_offset;
+        uint64_t labels_offset;
+        uint64_t labels_size;
+        uint64_t checksum;
+        uint64_t reserved[4];
+
+        bool valid() const
+        {
+            return std::memcmp(magic, magic_bytes(), sizeof(magic)) == 0 &&
+                   version == current_version();
+        }
+    };
+
+    static_assert(sizeof(registry_file_header) == 128);
+
+    struct registry_file_entry
+    {
+        uint64_t cipher;
+        uint64_t label_offset;
+        uint32_t label_size;
+        // the top half of the label's hash, compared before the label.
+        uint32_t label_check;
+    };
+
+    static_assert(sizeof(registry_file_entry) == 24);
+
+    namespace detail
+    {
+        inline uint64_t registry_label_hash(string_view label)
+        {
+            return ahs::hash_bytes(label);
+        }
+
+        inline uint64_t registry_cipher_hash(uint64_t c)
+        {
+            return ahs::mix64(c);
+        }
+    }
+
+    /**
+     * Writes the (label, cipher type) pairs of types, in order, to the
+     * registry file filename. Returns false on failure.
+     */
+    template <typename Types>
+    bool write_registry_file(
+        string const & filename,
+        uint64_t magic_bits,
+        uint64_t secret_hash,
+        Types const & types)
+    {
+        vector<registry_file_entry> entries;
+        string labels;
+        for (auto const & [label, c] : types)
+        {
+            registry_file_entry e;
+            e.cipher = uint64_t(c);
+            e.label_offset = labels.size();
+            e.label_size = uint32_t(label.size());
+            e.label_check = uint32_t(detail::registry_label_hash(label) >> 32);
+            entries.push_back(e);
+            labels += label;
+        }
+        if (entries.size() >= UINT32_MAX)
+            return false;
+
+        uint64_t slots = 16;
+        while (slots < 2 * entries.size())
+            slots *= 2;
+        uint64_t const mask = slots - 1;
+
+        vector<uint32_t> by_label(slots, 0), by_cipher(slots, 0);
+        for (uint32_t i = 0; i < entries.size(); ++i)
+        {
+            auto const & e = entries[i];
+            string_view const label(labels.data() + e.label_offset, e.label_size);
+
+            // a repeated label keeps its first entry.
+            uint64_t j = detail::registry_label_hash(label) & mask;
+            bool repeated = false;
+            for (; by_label[j] != 0; j = (j + 1) & mask)
+            {
+                auto const & f = entries[by_label[j] - 1];
+                if (string_view(labels.data() + f.label_offset, f.label_size) == label)
+                {
+                    repeated = true;
+                    break;
+                }
+            }
+            if (!repeated)
+                by_label[j] = i + 1;
+
+            j = detail::registry_cipher_hash(e.cipher) & mask;
+            while (by_cipher[j] != 0)
+                j = (j + 1) & mask;
+            by_cipher[j] = i + 1;
+        }
+
+        registry_file_header h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, registry_file_header::magic_bytes(), sizeof(h.magic));
+        h.version = registry_file_header::current_version();
+        h.magic_bits = magic_bits;
+        h.secret_hash = secret_hash;
+        h.count = entries.size();
+        h.slot_count = slots;
+        h.entries_offset = sizeof(registry_file_header);
+        h.label_table_offset = h.entries_offset + entries.size() * sizeof(registry_file_entry);
+        h.cipher_table_offset = h.label_table_offset + slots * sizeof(uint32_t);
+        h.labels_offset = h.cipher_table_offset + slots * sizeof(uint32_t);
+        h.labels_size = labels.size();
+
+        string body;
+        body.reserve(h.labels_offset + labels.size() - sizeof(h));
+        body.append(reinterpret_cast<char const *>(entries.data()), entries.size() * sizeof(registry_file_entry));
+        body.append(reinterpret_cast<char const *>(by_label.data()), slots * sizeof(uint32_t));
+        body.append(reinterpret_cast<char const *>(by_cipher.data()), slots * sizeof(uint32_t));
+        body.append(labels);
+        h.checksum = ahs::hash_bytes(body);
+
+        string const tmp = filename + ".tmp";
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<char const *>(&h), sizeof(h));
+        out.write(body.data(), std::streamsize(body.size()));
+        out.close();
+        if (!out)
+        {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return std::rename(tmp.c_str(), filename.c_str()) == 0;
+    }
+
+    /**
+     * A read-only cipher_type_registry (Registry) answered from a mapped
+     * registry file. Labels are returned as views of the mapping, which
+     * live as long as the view.
+     */
+    template <typename Registry>
+    class cipher_type_registry_view
+    {
+    public:
+        using cipher_type = typename Registry::cipher_type;
+        using trapdoor_type = typename Registry::trapdoor_type;
+        using secret_type = typename Registry::secret_type;
+        using key_type = typename Registry::key_type;
+
+        /**
+         * Opens the registry file filename. Returns nullopt if it is not a
+         * registry file of Registry (e.g., its MagicBits differ) or it is
+         * truncated.
+         */
+        static optional<cipher_type_registry_view> open(string const & filename)
+        {
+            mapped_file f;
+            if (!f.open(filename) || f.size() < sizeof(registry_file_header))
+                return nullopt;
+
+            registry_file_header h;
+            std::memcpy(&h, f.data(), sizeof(h));
+            if (!h.valid() ||
+                h.magic_bits != uint64_t(Registry::metadata().magic_bits()) ||
+                h.slot_count == 0 || (h.slot_count & (h.slot_count - 1)) != 0 ||
+                h.count > h.slot_count / 2 ||
+                h.entries_offset + h.count * sizeof(registry_file_entry) > f.size() ||
+                h.label_table_offset + h.slot_count * sizeof(uint32_t) > f.size() ||
+                h.cipher_table_offset + h.slot_count * sizeof(uint32_t) > f.size() ||
+                h.labels_offset + h.labels_size > f.size())
+                return nullopt;
+
+            f.advise(MADV_RANDOM);
+            return cipher_type_registry_view(std::move(f), h);
+        }
+
+        // checks the checksum, which reads the whole file.
+        bool verify() const
+        {
+            return ahs::hash_bytes(string_view(file_.data() + sizeof(registry_file_header),
+                file_.size() - sizeof(registry_file_header))) == h_.checksum;
+        }
+
+        size_t size() const { return size_t(h_.count); }
+        trapdoor_type cipher_of_secret() const { return trapdoor_type(h_.secret_hash); }
+
+        bool is_secret(secret_type s) const
+        {
+            return is_key(Registry::key(s));
+        }
+
+        bool is_key(key_type const & k) const
+        {
+            return cipher_of_secret() == k.check();
+        }
+
+        // the cipher type of label.
+        optional<cipher_type> find(string_view label) const
+        {
+            uint64_t const h = detail::registry_label_hash(label);
+            uint32_t const check = uint32_t(h >> 32);
+            uint64_t j = h & mask();
+            for (uint64_t n = 0; n < h_.slot_count; ++n, j = (j + 1) & mask())
+            {
+                uint32_t const e = slot(h_.label_table_offset, j);
+                if (e == 0 || e > h_.count)
+                    break;
+                auto const x = entry(e - 1);
+                if (x.label_check == check && label_of(x) == label)
+                    return cipher_type(x.cipher);
+            }
+            return nullopt;
+        }
+
+        // convert a cipher type denoted by t to its plaintext type.
+        optional<string_view> plaintext(cipher_type t, secret_type s) const
+        {
+            if (!is_secret(s))
+                return nullopt;
+            return label_of(t);
+        }
+
+        template <typename T>
+        bool is_type(cipher_type t, secret_type s) const
+        {
+            return Registry::template type_cipher<T>(Registry::type_tag_key(s)) == t;
+        }
+
+        template <typename T>
+        bool is_type(cipher_type t, type_key const & k) const
+        {
+            return Registry::template type_cipher<T>(k) == t;
+        }
+
+        // determine if ciphertype denotes a cipher type.
+        // returns a second-order positive approximate Boolean with a
+        // false positive rate 2^-H where H := sizeof(hash_type).
+        bool is_any_type(cipher_type t, secret_type s) const
+        {
+            if (!is_secret(s))
+                return false;
+            return label_of(t).has_value();
+        }
+
+        // calls f(label, cipher type) for each type, in insertion order.
+        template <typename F>
+        void for_each(F f) const
+        {
+            for (uint64_t i = 0; i < h_.count; ++i)
+            {
+                auto const x = entry(i);
+                f(label_of(x), cipher_type(x.cipher));
+            }
+        }
+
+    private:
+        cipher_type_registry_view(mapped_file f, registry_file_header h) :
+            file_(std::move(f)), h_(h) {}
+
+        uint64_t mask() const { return h_.slot_count - 1; }
+
+        uint32_t slot(uint64_t table_offset, uint64_t j) const
+        {
+            uint32_t e;
+            std::memcpy(&e, file_.data() + table_offset + j * sizeof(uint32_t), sizeof(e));
+            return e;
+        }
+
+        registry_file_entry entry(uint64_t i) const
+        {
+            registry_file_entry e;
+            std::memcpy(&e, file_.data() + h_.entries_offset + i * sizeof(registry_file_entry), sizeof(e));
+            return e;
+        }
+
+        string_view label_of(registry_file_entry const & e) const
+        {
+            if (e.label_offset + e.label_size > h_.labels_size)
+                return {};
+            return string_view(file_.data() + h_.labels_offset + e.label_offset, e.label_size);
+        }
+
+        // the label of the first entry of cipher type c.
+        optional<string_view> label_of(cipher_type c) const
+        {
+            // the probes are bounded, in case the file is corrupt.
+            uint64_t j = detail::registry_cipher_hash(uint64_t(c)) & mask();
+            for (uint64_t n = 0; n < h_.slot_count; ++n, j = (j + 1) & mask())
+            {
+                uint32_t const e = slot(h_.cipher_table_offset, j);
+                if (e == 0 || e > h_.count)
+                    break;
+                auto const x = entry(e - 1);
+                if (x.cipher == uint64_t(c))
+                    return label_of(x);
+            }
+            return nullopt;
+        }
+
+        mapped_file file_;
+        registry_file_header h_;
+    };
+}
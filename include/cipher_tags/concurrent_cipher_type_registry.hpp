@@ -0,0 +1,154 @@
+#pragma once
+
+/**
+ * A cipher_type_registry (see cipher_type_registry.hpp) that many threads
+ * may read while others insert types, for services that look up types on
+ * every request.
+ *
+ * Readers never lock. The registry is published as an immutable snapshot
+ * through an atomic pointer; a reader pins the registry's epoch domain (see
+ * epoch.hpp), loads the pointer and reads the snapshot, so a lookup costs a
+ * store and a fence on a cache line of the reader's thread plus the lookup
+ * itself, and readers do not contend with each other or with writers. A writer copies the current snapshot, inserts into the copy and
+ * swaps the pointer, and the previous snapshot is deleted once no reader
+ * holds it. So an insert costs O(n) in the number of types; to insert
+ * many, pass them to a single update(), which copies once and is seen by
+ * readers all at once. Writers are serialized by a mutex.
+ */
+
+#include <string>
+#include <optional>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <utility>
+#include "cipher_type_registry.hpp"
+#include "../epoch.hpp"
+
+using std::string;
+using std::optional;
+using std::nullopt;
+
+namespace alex::cipher
+{
+    template <size_t MagicBits, typename KeyedHash = siphash24>
+    class concurrent_cipher_type_registry
+    {
+    public:
+        using registry_type = cipher_type_registry<MagicBits, KeyedHash>;
+        using trapdoor_type = typename registry_type::trapdoor_type;
+        using cipher_type = typename registry_type::cipher_type;
+        using secret_type = typename registry_type::secret_type;
+        using key_type = typename registry_type::key_type;
+
+        explicit concurrent_cipher_type_registry(registry_type r) :
+            current_(new registry_type(std::move(r))) {}
+
+        explicit concurrent_cipher_type_registry(secret_type secret) :
+            concurrent_cipher_type_registry(registry_type(secret)) {}
+
+        concurrent_cipher_type_registry(concurrent_cipher_type_registry const &) = delete;
+        concurrent_cipher_type_registry & operator=(concurrent_cipher_type_registry const &) = delete;
+
+        // there must be no readers.
+        ~concurrent_cipher_type_registry()
+        {
+            delete current_.load();
+        }
+
+        /**
+         * Returns f(registry) for the current snapshot of the registry, which
+         * f must not keep after it returns. Never blocks. To look up many
+         * types, look them up in one read.
+         */
+        template <typename F>
+        decltype(auto) read(F f) const
+        {
+            auto g = epochs_.pin();
+            return f(*current_.load());
+        }
+
+        optional<string> plaintext(cipher_type t, secret_type s) const
+        {
+            return read([&](registry_type const & r) { return r.plaintext(t, s); });
+        }
+
+        bool is_any_type(cipher_type t, secret_type s) const
+        {
+            return read([&](registry_type const & r) { return r.is_any_type(t, s); });
+        }
+
+        // a type check needs no snapshot; see cipher_type_registry::is_type.
+        template <typename T>
+        static bool is_type(cipher_type t, type_key const & k)
+        {
+            return registry_type::template type_cipher<T>(k) == t;
+        }
+
+        trapdoor_type cipher_of_secret() const
+        {
+            return read([](registry_type const & r) { return r.cipher_of_secret(); });
+        }
+
+        size_t size() const
+        {
+            return read([](registry_type const & r) { return size_t(r.size()); });
+        }
+
+        bool save(string const & filename) const
+        {
+            return read([&](registry_type const & r) { return r.save(filename); });
+        }
+
+        /**
+         * Calls f(registry) on a copy of the current snapshot and, if it
+         * returns true, publishes the copy. Returns the result of f.
+         */
+        template <typename F>
+        bool update(F f)
+        {
+            std::lock_guard g(mutex_);
+            // owned until published, so the copy is freed if f throws.
+            auto next = std::make_unique<registry_type>(*current_.load());
+            if (!f(*next))
+                return false;
+            publish(next.release());
+            return true;
+        }
+
+        template <typename T>
+        bool insert(string type, key_type const & k)
+        {
+            return update([&](registry_type & r) { return r.template insert<T>(std::move(type), k); });
+        }
+
+        template <typename T>
+        bool insert(string type, secret_type s)
+        {
+            return insert<T>(std::move(type), registry_type::key(s));
+        }
+
+        bool insert(string type, key_type const & k)
+        {
+            return update([&](registry_type & r) { return r.insert(std::move(type), k); });
+        }
+
+        bool insert(string type, secret_type s)
+        {
+            return insert(std::move(type), registry_type::key(s));
+        }
+
+    private:
+        // makes r the current snapshot. the mutex must be held.
+        void publish(registry_type const * r)
+        {
+            if (auto old = current_.exchange(r))
+                epochs_.retire(old);
+            epochs_.reclaim();
+        }
+
+        mutable epoch_domain epochs_;
+        std::mutex mutex_;
+        std::atomic<registry_type const *> current_;
+    };
+}
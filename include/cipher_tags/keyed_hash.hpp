@@ -0,0 +1,314 @@
+#pragma once
+
+/**
+ * Keyed hash functions for generating cipher tags.
+ *
+ * A cipher tag is a keyed hash of a label or a value, where the key is
+ * derived from a secret. Tags are persisted (e.g., in a serialized
+ * cipher_type_registry) and compared by other programs, so the hash must
+ * not depend on the compiler or the platform, as std::hash does; and
+ * without the secret, a tag must not tell us anything about what it tags,
+ * so the hash must be a pseudorandom function of its key.
+ *
+ * A keyed hash family H provides
+ *     H(secret, tweak)           absorbs the secret into a key state, once
+ *     h(bytes), h(uint64_t)      the tag of a byte string or an integer
+ *     h.hash_many(xs, n, out)    the tags of n strings or integers
+ *     h.check()                  a value that identifies the key without
+ *                                revealing it (see cipher_of_secret)
+ *
+ * siphash24 is the default: SipHash-2-4, a pseudorandom function with a
+ * 128-bit key designed for short inputs, which is what labels and values
+ * are. The integer x is hashed as the 8 bytes of x in little-endian order.
+ *
+ * hash_many hashes several inputs at once, one per lane of a vector
+ * register (8 with AVX-512, 4 with AVX2), so bulk tagging is limited by
+ * the SIMD throughput rather than by the latency of the rounds of a single
+ * hash. Without either (e.g., a build without -mavx2 or -march=native),
+ * it hashes one input at a time. Each lane computes exactly the scalar
+ * hash, so the tags do not depend on which path computed them.
+ *
+ * On one core, hash_many tags 8-byte values at about 0.55 GB/s (15 ns a
+ * tag) with the flags of src/Makefile, -O2 and no -m flags, which is the
+ * scalar rate; with -march=native (AVX-512), at about 1.8 GB/s (4 ns a
+ * tag). So bulk tagging needs a build with -mavx2 or -march=native to run
+ * at more than the scalar rate (see cipher_type_registry_bench.cpp).
+ */
+
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+#include <cstring>
+#include "../ahs/ahs_hash.hpp"
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+using std::string_view;
+using std::uint64_t;
+using std::size_t;
+
+namespace alex::cipher
+{
+    namespace detail
+    {
+        // the message block r of s: 8 bytes, or the final block, which holds
+        // the remaining bytes and the length of s in its top byte.
+        inline uint64_t sip_block(string_view s, size_t r)
+        {
+            size_t const full = s.size() / 8;
+            if (r < full)
+                return ahs::load_le64(s.data() + 8 * r);
+
+            size_t const rest = s.size() % 8;
+            uint64_t const length = uint64_t(s.size()) << 56;
+            if (rest == 0)
+                return length;
+            // the last 8 bytes of s, shifted down past the bytes of the
+            // previous block, rather than a load of each byte.
+            if (full != 0)
+                return (ahs::load_le64(s.data() + s.size() - 8) >> (8 * (8 - rest))) | length;
+            return ahs::load_le(s.data(), rest) | length;
+        }
+
+        template <typename V>
+        inline void sip_round(V & v0, V & v1, V & v2, V & v3)
+        {
+            v0 = V::add(v0, v1); v1 = V::template rotl<13>(v1); v1 = V::xor_(v1, v0); v0 = V::template rotl<32>(v0);
+            v2 = V::add(v2, v3); v3 = V::template rotl<16>(v3); v3 = V::xor_(v3, v2);
+            v0 = V::add(v0, v3); v3 = V::template rotl<21>(v3); v3 = V::xor_(v3, v0);
+            v2 = V::add(v2, v1); v1 = V::template rotl<17>(v1); v1 = V::xor_(v1, v2); v2 = V::template rotl<32>(v2);
+        }
+
+        // a single 64-bit lane.
+        struct lane1
+        {
+            static constexpr size_t lanes = 1;
+            uint64_t x;
+
+            static lane1 load(uint64_t const * p) { return {*p}; }
+            void store(uint64_t * p) const { *p = x; }
+            static lane1 set1(uint64_t a) { return {a}; }
+            static lane1 add(lane1 a, lane1 b) { return {a.x + b.x}; }
+            static lane1 xor_(lane1 a, lane1 b) { return {a.x ^ b.x}; }
+            template <int R> static lane1 rotl(lane1 a) { return {ahs::rotl64(a.x, R)}; }
+            static lane1 select(lane1 m, lane1 a, lane1 b) { return {(a.x & m.x) | (b.x & ~m.x)}; }
+        };
+
+#if defined(__AVX2__)
+        struct lanes_avx2
+        {
+            static constexpr size_t lanes = 4;
+            __m256i x;
+
+            static lanes_avx2 load(uint64_t const * p) { return {_mm256_loadu_si256(reinterpret_cast<__m256i const *>(p))}; }
+            void store(uint64_t * p) const { _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), x); }
+            static lanes_avx2 set1(uint64_t a) { return {_mm256_set1_epi64x(static_cast<long long>(a))}; }
+            static lanes_avx2 add(lanes_avx2 a, lanes_avx2 b) { return {_mm256_add_epi64(a.x, b.x)}; }
+            static lanes_avx2 xor_(lanes_avx2 a, lanes_avx2 b) { return {_mm256_xor_si256(a.x, b.x)}; }
+            template <int R> static lanes_avx2 rotl(lanes_avx2 a)
+            {
+                if constexpr (R == 32)
+                    return {_mm256_shuffle_epi32(a.x, 0xb1)};
+                else
+                    return {_mm256_or_si256(_mm256_slli_epi64(a.x, R), _mm256_srli_epi64(a.x, 64 - R))};
+            }
+            static lanes_avx2 select(lanes_avx2 m, lanes_avx2 a, lanes_avx2 b) { return {_mm256_blendv_epi8(b.x, a.x, m.x)}; }
+        };
+#endif
+
+#if defined(__AVX512F__)
+        struct lanes_avx512
+        {
+            static constexpr size_t lanes = 8;
+            __m512i x;
+
+            static lanes_avx512 load(uint64_t const * p) { return {_mm512_loadu_si512(p)}; }
+            void store(uint64_t * p) const { _mm512_storeu_si512(p, x); }
+            static lanes_avx512 set1(uint64_t a) { return {_mm512_set1_epi64(static_cast<long long>(a))}; }
+            static lanes_avx512 add(lanes_avx512 a, lanes_avx512 b) { return {_mm512_add_epi64(a.x, b.x)}; }
+            static lanes_avx512 xor_(lanes_avx512 a, lanes_avx512 b) { return {_mm512_xor_si512(a.x, b.x)}; }
+            template <int R> static lanes_avx512 rotl(lanes_avx512 a) { return {_mm512_mask_rol_epi64(a.x, 0xff, a.x, R)}; }
+            static lanes_avx512 select(lanes_avx512 m, lanes_avx512 a, lanes_avx512 b) { return {_mm512_ternarylogic_epi64(m.x, a.x, b.x, 0xca)}; }
+        };
+
+        using lanes = lanes_avx512;
+#elif defined(__AVX2__)
+        using lanes = lanes_avx2;
+#else
+        using lanes = lane1;
+#endif
+    }
+
+    class siphash24
+    {
+    public:
+        // the key (k0, k1) itself.
+        constexpr siphash24(uint64_t k0, uint64_t k1) :
+            v0_(k0 ^ 0x736f6d6570736575ULL), v1_(k1 ^ 0x646f72616e646f6dULL),
+            v2_(k0 ^ 0x6c7967656e657261ULL), v3_(k1 ^ 0x7465646279746573ULL) {}
+
+        // the key derived from secret, which may have any length. distinct
+        // tweaks give independent keys for the same secret.
+        explicit siphash24(string_view secret, uint64_t tweak = 0) :
+            siphash24(derive_a()(secret), derive_b()(secret) ^ tweak) {}
+
+        uint64_t operator()(string_view s) const
+        {
+            uint64_t v0 = v0_, v1 = v1_, v2 = v2_, v3 = v3_;
+            size_t const blocks = s.size() / 8 + 1;
+            for (size_t r = 0; r < blocks; ++r)
+                compress(v0, v1, v2, v3, detail::sip_block(s, r));
+            return finish(v0, v1, v2, v3);
+        }
+
+        uint64_t operator()(uint64_t x) const
+        {
+            uint64_t v0 = v0_, v1 = v1_, v2 = v2_, v3 = v3_;
+            compress(v0, v1, v2, v3, x);
+            compress(v0, v1, v2, v3, uint64_t(8) << 56);
+            return finish(v0, v1, v2, v3);
+        }
+
+        // out[i] = (*this)(xs[i]) for i in [0,n).
+        void hash_many(string_view const * xs, size_t n, uint64_t * out) const
+        {
+            using V = detail::lanes;
+            size_t i = 0;
+            if constexpr (V::lanes > 1)
+            {
+                for (; i < n - n % V::lanes; i += V::lanes)
+                    hash_lanes<V>(xs + i, out + i);
+            }
+            for (; i < n; ++i)
+                out[i] = (*this)(xs[i]);
+        }
+
+        void hash_many(uint64_t const * xs, size_t n, uint64_t * out) const
+        {
+            using V = detail::lanes;
+            size_t i = 0;
+            if constexpr (V::lanes > 1)
+            {
+                V const length = V::set1(uint64_t(8) << 56);
+                for (; i < n - n % V::lanes; i += V::lanes)
+                {
+                    V v0 = V::set1(v0_), v1 = V::set1(v1_), v2 = V::set1(v2_), v3 = V::set1(v3_);
+                    compress(v0, v1, v2, v3, V::load(xs + i));
+                    compress(v0, v1, v2, v3, length);
+                    finish(v0, v1, v2, v3).store(out + i);
+                }
+            }
+            for (; i < n; ++i)
+                out[i] = (*this)(xs[i]);
+        }
+
+        // identifies the key, but is computed with a fixed key, so it
+        // is unrelated to the tags of the key.
+        uint64_t check() const
+        {
+            char k[32];
+            for (int i = 0; i < 4; ++i)
+            {
+                uint64_t const v = i == 0 ? v0_ : i == 1 ? v1_ : i == 2 ? v2_ : v3_;
+                for (int b = 0; b < 8; ++b)
+                    k[8 * i + b] = char(v >> (8 * b));
+            }
+            return derive_check()(string_view(k, sizeof(k)));
+        }
+
+    private:
+        // fixed keys (digits of pi) for deriving a key from a secret and
+        // the check value of a key.
+        static constexpr siphash24 derive_a() { return siphash24(0x243f6a8885a308d3ULL, 0x13198a2e03707344ULL); }
+        static constexpr siphash24 derive_b() { return siphash24(0xa4093822299f31d0ULL, 0x082efa98ec4e6c89ULL); }
+        static constexpr siphash24 derive_check() { return siphash24(0x452821e638d01377ULL, 0xbe5466cf34e90c6cULL); }
+
+        template <typename V, typename M>
+        static void compress(V & v0, V & v1, V & v2, V & v3, M m)
+        {
+            if constexpr (std::is_same_v<V, uint64_t>)
+            {
+                detail::lane1 a{v0}, b{v1}, c{v2}, d{v3};
+                d.x ^= m;
+                detail::sip_round(a, b, c, d);
+                detail::sip_round(a, b, c, d);
+                a.x ^= m;
+                v0 = a.x; v1 = b.x; v2 = c.x; v3 = d.x;
+            }
+            else
+            {
+                v3 = V::xor_(v3, m);
+                detail::sip_round(v0, v1, v2, v3);
+                detail::sip_round(v0, v1, v2, v3);
+                v0 = V::xor_(v0, m);
+            }
+        }
+
+        template <typename V>
+        static V finish(V v0, V v1, V v2, V v3)
+        {
+            if constexpr (std::is_same_v<V, uint64_t>)
+            {
+                detail::lane1 a{v0}, b{v1}, c{v2 ^ 0xff}, d{v3};
+                for (int i = 0; i < 4; ++i)
+                    detail::sip_round(a, b, c, d);
+                return a.x ^ b.x ^ c.x ^ d.x;
+            }
+            else
+            {
+                v2 = V::xor_(v2, V::set1(0xff));
+                for (int i = 0; i < 4; ++i)
+                    detail::sip_round(v0, v1, v2, v3);
+                return V::xor_(V::xor_(v0, v1), V::xor_(v2, v3));
+            }
+        }
+
+        // hashes V::lanes strings, one per lane. the lanes take their
+        // blocks in step; a lane whose string has no more blocks keeps
+        // its state until the longest string is done.
+        template <typename V>
+        void hash_lanes(string_view const * xs, uint64_t * out) const
+        {
+            constexpr size_t L = V::lanes;
+            size_t blocks[L];
+            size_t min_blocks = ~size_t(0), max_blocks = 0;
+            for (size_t l = 0; l < L; ++l)
+            {
+                blocks[l] = xs[l].size() / 8 + 1;
+                min_blocks = std::min(min_blocks, blocks[l]);
+                max_blocks = std::max(max_blocks, blocks[l]);
+            }
+
+            V v0 = V::set1(v0_), v1 = V::set1(v1_), v2 = V::set1(v2_), v3 = V::set1(v3_);
+            alignas(64) uint64_t m[L], active[L];
+            for (size_t r = 0; r < max_blocks; ++r)
+            {
+                for (size_t l = 0; l < L; ++l)
+                {
+                    bool const a = r < blocks[l];
+                    m[l] = a ? detail::sip_block(xs[l], r) : 0;
+                    active[l] = a ? ~uint64_t(0) : 0;
+                }
+
+                if (r < min_blocks)
+                {
+                    compress(v0, v1, v2, v3, V::load(m));
+                    continue;
+                }
+                V n0 = v0, n1 = v1, n2 = v2, n3 = v3;
+                compress(n0, n1, n2, n3, V::load(m));
+                V const a = V::load(active);
+                v0 = V::select(a, n0, v0);
+                v1 = V::select(a, n1, v1);
+                v2 = V::select(a, n2, v2);
+                v3 = V::select(a, n3, v3);
+            }
+            finish(v0, v1, v2, v3).store(out);
+        }
+
+        uint64_t v0_, v1_, v2_, v3_;
+    };
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+/**
+ * label_cipher_table is a flat, dual-indexed table of (label, cipher type)
+ * pairs, e.g., the type labels of a cipher_type_registry and their cipher
+ * tags.
+ *
+ * The pairs are stored contiguously, in the order of insertion, which is
+ * the order of iteration. Two open-addressed hash indexes (linear probing,
+ * at most half full) refer to the pairs by position: one by the hash of the
+ * label and one by the cipher type. So both
+ *     label -> cipher type
+ * and
+ *     cipher type -> label
+ * are O(1) expected, and an insert costs no node allocation (the label's
+ * string aside) and amortized O(1) index growth.
+ *
+ * Distinct labels may have the same cipher type (e.g., two labels for the
+ * same type, or a hash collision); the cipher index then finds the label
+ * that was inserted first.
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <optional>
+#include <functional>
+#include <cstdint>
+#include "../ahs/ahs_hash.hpp"
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::pair;
+using std::optional;
+using std::nullopt;
+using std::size_t;
+using std::uint32_t;
+using std::uint64_t;
+
+namespace alex::cipher
+{
+    template <typename C = size_t>
+    class label_cipher_table
+    {
+    public:
+        using cipher_type = C;
+        using value_type = pair<string, cipher_type>;
+        using const_iterator = typename vector<value_type>::const_iterator;
+
+        label_cipher_table() = default;
+
+        // sets the cipher type of label. returns true if label is new.
+        bool insert_or_assign(string label, cipher_type c)
+        {
+            if (size_t i = find_label_slot(label); !by_label_.empty() && by_label_[i] != no_entry)
+            {
+                uint32_t const e = by_label_[i] - 1;
+                if (entries_[e].second != c)
+                {
+                    erase_cipher(e);
+                    entries_[e].second = c;
+                    insert_cipher(e);
+                }
+                return false;
+            }
+
+            if (2 * (entries_.size() + 1) > by_label_.size())
+                rehash(std::max<size_t>(16, 2 * by_label_.size()));
+
+            entries_.emplace_back(std::move(label), c);
+            uint32_t const e = uint32_t(entries_.size() - 1);
+            by_label_[find_label_slot(entries_[e].first)] = e + 1;
+            insert_cipher(e);
+            return true;
+        }
+
+        // the cipher type of label.
+        optional<cipher_type> find(string_view label) const
+        {
+            if (entries_.empty())
+                return nullopt;
+            uint32_t const e = by_label_[find_label_slot(label)];
+            return e == no_entry ? nullopt : optional<cipher_type>(entries_[e - 1].second);
+        }
+
+        // the (first inserted) label of cipher type c.
+        optional<string_view> label_of(cipher_type c) const
+        {
+            if (entries_.empty())
+                return nullopt;
+
+            uint32_t best = no_entry;
+            for (size_t i = cipher_home(c); by_cipher_[i] != no_entry; i = (i + 1) & mask())
+            {
+                uint32_t const e = by_cipher_[i];
+                if (entries_[e - 1].second == c && (best == no_entry || e < best))
+                    best = e;
+            }
+            return best == no_entry ? nullopt : optional<string_view>(entries_[best - 1].first);
+        }
+
+        bool contains_cipher(cipher_type c) const
+        {
+            if (entries_.empty())
+                return false;
+            for (size_t i = cipher_home(c); by_cipher_[i] != no_entry; i = (i + 1) & mask())
+            {
+                if (entries_[by_cipher_[i] - 1].second == c)
+                    return true;
+            }
+            return false;
+        }
+
+        const_iterator begin() const { return entries_.begin(); }
+        const_iterator end() const { return entries_.end(); }
+        size_t size() const { return entries_.size(); }
+        bool empty() const { return entries_.empty(); }
+
+        void reserve(size_t n)
+        {
+            entries_.reserve(n);
+            size_t slots = 16;
+            while (slots < 2 * n)
+                slots *= 2;
+            if (slots > by_label_.size())
+                rehash(slots);
+        }
+
+    private:
+        // slot values are positions in entries_ plus one.
+        static constexpr uint32_t no_entry = 0;
+
+        size_t mask() const { return by_label_.size() - 1; }
+
+        size_t label_home(string_view label) const
+        {
+            return size_t(ahs::mix64(std::hash<string_view>{}(label))) & mask();
+        }
+
+        size_t cipher_home(cipher_type c) const
+        {
+            return size_t(ahs::mix64(uint64_t(c))) & mask();
+        }
+
+        // the slot of label, or the empty slot where it would go.
+        size_t find_label_slot(string_view label) const
+        {
+            if (by_label_.empty())
+                return 0;
+            size_t i = label_home(label);
+            while (by_label_[i] != no_entry && entries_[by_label_[i] - 1].first != label)
+                i = (i + 1) & mask();
+            return i;
+        }
+
+        void insert_cipher(uint32_t e)
+        {
+            size_t i = cipher_home(entries_[e].second);
+            while (by_cipher_[i] != no_entry)
+                i = (i + 1) & mask();
+            by_cipher_[i] = e + 1;
+        }
+
+        // removes entry e from the cipher index by backward-shift deletion,
+        // which keeps every probe sequence unbroken without tombstones.
+        void erase_cipher(uint32_t e)
+        {
+            size_t i = cipher_home(entries_[e].second);
+            while (by_cipher_[i] != e + 1)
+                i = (i + 1) & mask();
+
+            for (size_t j = (i + 1) & mask(); by_cipher_[j] != no_entry; j = (j + 1) & mask())
+            {
+                // the entry at j may move to i unless its home lies
+                // cyclically in (i, j].
+                size_t const h = cipher_home(entries_[by_cipher_[j] - 1].second);
+                bool const stays = i <= j ? (i < h && h <= j) : (i < h || h <= j);
+                if (!stays)
+                {
+                    by_cipher_[i] = by_cipher_[j];
+                    i = j;
+                }
+            }
+            by_cipher_[i] = no_entry;
+        }
+
+        void rehash(size_t slots)
+        {
+            by_label_.assign(slots, no_entry);
+            by_cipher_.assign(slots, no_entry);
+            for (uint32_t e = 0; e < entries_.size(); ++e)
+            {
+                by_label_[find_label_slot(entries_[e].first)] = e + 1;
+                insert_cipher(e);
+            }
+        }
+
+        vector<value_type> entries_;
+        vector<uint32_t> by_label_;
+        vector<uint32_t> by_cipher_;
+    };
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+/**
+ * Compile-time fingerprints of C++ types, for cipher tags of statically
+ * known types.
+ *
+ * type_fingerprint<T>() is a 64-bit constant computed at compile time from
+ * the canonical name of T, cipher_type_name<T>::value:
+ *
+ *  - integral and floating-point types are named by their signedness and
+ *    width (e.g., "int32", "uint64", "float64"), since compilers spell them
+ *    differently (e.g., "long int" and "long") and the width of long varies
+ *    by platform; char, wchar_t and bool keep their names;
+ *  - strings are "string" and "string_view";
+ *  - any other type is named as the compiler spells it in
+ *    __PRETTY_FUNCTION__ (or __FUNCSIG__), which may differ across
+ *    compilers. Specialize cipher_type_name for types whose tags are
+ *    persisted or shared with programs built by another compiler.
+ *
+ * Composite tags fold their structure at compile time: the fingerprint of
+ * cipher_tag_product<A,B>, cipher_tag_sum<A,B> or cipher_tag_fn<A,B> is a
+ * hash of its kind and the fingerprints of A and B.
+ *
+ * static_type_cipher<T>(k) combines the fingerprint with a type_key, which
+ * is derived from the secret once, in a single multiply-xor step: the
+ * 128-bit product of (fingerprint ^ k.a) and k.m, folded to 64 bits. So a
+ * type check against a type_key is a few instructions and a compare. It is
+ * much weaker than the keyed hash of the registry (an adversary who knows
+ * the types of many tags may learn about the key), which is the tradeoff
+ * for type tags that are checked in a hot loop.
+ */
+
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <limits>
+#include <cstdint>
+#include "../ahs/ahs_hash.hpp"
+
+using std::string_view;
+using std::uint64_t;
+
+namespace alex::cipher
+{
+    template <typename A, typename B> struct cipher_tag_product;
+    template <typename A, typename B> struct cipher_tag_sum;
+    template <typename A, typename B> struct cipher_tag_fn;
+
+    namespace detail
+    {
+        // the name of T as the compiler spells it.
+        template <typename T>
+        constexpr string_view raw_type_name()
+        {
+#if defined(__clang__) || defined(__GNUC__)
+            // e.g., "... raw_type_name() [with T = foo; ...]" (gcc) or
+            // "... raw_type_name() [T = foo]" (clang).
+            constexpr string_view f = __PRETTY_FUNCTION__;
+            constexpr auto begin = f.find("T = ") + 4;
+            constexpr auto semi = f.find(';', begin);
+            constexpr auto end = semi == string_view::npos ? f.rfind(']') : semi;
+            return f.substr(begin, end - begin);
+#elif defined(_MSC_VER)
+            // e.g., "... raw_type_name<foo>(void)".
+            constexpr string_view f = __FUNCSIG__;
+            constexpr auto begin = f.find("raw_type_name<") + 14;
+            constexpr auto end = f.rfind(">(void)");
+            return f.substr(begin, end - begin);
+#else
+            static_assert(sizeof(T) == 0, "specialize cipher_type_name for this compiler");
+            return {};
+#endif
+        }
+
+        // the names of arithmetic types by signedness and width.
+        template <typename T>
+        constexpr string_view arithmetic_type_name()
+        {
+            constexpr auto bits = sizeof(T) * 8;
+            if constexpr (std::is_same_v<T, bool>)
+                return "bool";
+            // the signedness of char and the width and signedness of
+            // wchar_t depend on the platform.
+            else if constexpr (std::is_same_v<T, char>)
+                return "char";
+            else if constexpr (std::is_same_v<T, wchar_t>)
+                return "wchar";
+            else if constexpr (std::is_floating_point_v<T>)
+            {
+                if constexpr (bits == 32) return "float32";
+                else if constexpr (bits == 64) return "float64";
+                else if constexpr (bits == 80 || bits == 96 || bits == 128)
+                    return std::numeric_limits<T>::digits == 64 ? "float80" : "float128";
+                else return raw_type_name<T>();
+            }
+            else if constexpr (std::is_signed_v<T>)
+            {
+                if constexpr (bits == 8) return "int8";
+                else if constexpr (bits == 16) return "int16";
+                else if constexpr (bits == 32) return "int32";
+                else if constexpr (bits == 64) return "int64";
+                else return "int128";
+            }
+            else
+            {
+                if constexpr (bits == 8) return "uint8";
+                else if constexpr (bits == 16) return "uint16";
+                else if constexpr (bits == 32) return "uint32";
+                else if constexpr (bits == 64) return "uint64";
+                else return "uint128";
+            }
+        }
+
+        // FNV-1a.
+        constexpr uint64_t fnv1a(string_view s)
+        {
+            uint64_t h = 0xcbf29ce484222325ULL;
+            for (char c : s)
+            {
+                h ^= uint64_t(static_cast<unsigned char>(c));
+                h *= 0x100000001b3ULL;
+            }
+            return h;
+        }
+
+        constexpr uint64_t fold(uint64_t kind, uint64_t a, uint64_t b)
+        {
+            return ahs::mix64((a * 0x9e3779b97f4a7c15ULL) ^ ahs::rotl64(b, 31) ^
+                kind * 0xc2b2ae3d27d4eb4fULL);
+        }
+    }
+
+    template <typename T>
+    struct cipher_type_name
+    {
+        static constexpr string_view value = []
+        {
+            using U = std::remove_cv_t<T>;
+            if constexpr (std::is_arithmetic_v<U>)
+                return detail::arithmetic_type_name<U>();
+            else if constexpr (std::is_same_v<U, std::string>)
+                return string_view("string");
+            else if constexpr (std::is_same_v<U, string_view>)
+                return string_view("string_view");
+            else
+                return detail::raw_type_name<U>();
+        }();
+    };
+
+    template <typename T>
+    struct type_fingerprint_of
+    {
+        static constexpr uint64_t value = ahs::mix64(detail::fnv1a(cipher_type_name<T>::value));
+    };
+
+    template <typename A, typename B>
+    struct type_fingerprint_of<cipher_tag_product<A,B>>
+    {
+        static constexpr uint64_t value = detail::fold(1, type_fingerprint_of<A>::value, type_fingerprint_of<B>::value);
+    };
+
+    template <typename A, typename B>
+    struct type_fingerprint_of<cipher_tag_sum<A,B>>
+    {
+        static constexpr uint64_t value = detail::fold(2, type_fingerprint_of<A>::value, type_fingerprint_of<B>::value);
+    };
+
+    template <typename A, typename B>
+    struct type_fingerprint_of<cipher_tag_fn<A,B>>
+    {
+        static constexpr uint64_t value = detail::fold(3, type_fingerprint_of<A>::value, type_fingerprint_of<B>::value);
+    };
+
+    template <typename T>
+    constexpr uint64_t type_fingerprint()
+    {
+        return type_fingerprint_of<T>::value;
+    }
+
+    // the runtime part of a static type tag, derived from a keyed hash
+    // (see keyed_hash.hpp) once.
+    struct type_key
+    {
+        uint64_t a;
+        uint64_t m;
+
+        template <typename KeyedHash>
+        explicit type_key(KeyedHash const & k) :
+            a(k(uint64_t(0x7479706561ULL))), m(k(uint64_t(0x747970656dULL)) | 1) {}
+    };
+
+    constexpr uint64_t static_type_cipher(uint64_t fingerprint, type_key const & k)
+    {
+        auto const p = static_cast<unsigned __int128>(fingerprint ^ k.a) * k.m;
+        return uint64_t(p) ^ uint64_t(p >> 64);
+    }
+
+    template <typename T>
+    constexpr uint64_t static_type_cipher(type_key const & k)
+    {
+        return static_type_cipher(type_fingerprint<T>(), k);
+    }
+}
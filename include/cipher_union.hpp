@@ -1,3 +1,5 @@
+#pragma once
+
 /**
  * The sum type is an algebraic type that takes two types X and Y and produces
  * another type X + Y such that values of this type either come from X or Y.
@@ -25,19 +27,30 @@
  * under the Curry–Howard correspondence.
  */
 
-struct cipher_sum_type
-{
-    size_t cipher_type_left;
-    size_t cipher_type_right;
-
-    size_t cipher_type; // we do not know what the type is
-    size_t cipher_value;
-}
+#include <cstddef>
 
-// suppose we have a function
-//     f : cipher_sum_type -> cipher_value
+using std::size_t;
 
-auto get_value(cipher_sum_type x)
+namespace alex::cipher
 {
-    return cipher_tag_fn()   
-}
\ No newline at end of file
+    struct cipher_sum_type
+    {
+        size_t cipher_type_left;
+        size_t cipher_type_right;
+
+        size_t cipher_type; // we do not know what the type is
+        size_t cipher_value;
+    };
+
+    // suppose we have a function
+    //     f : cipher_sum_type -> cipher_value
+    // by case analysis: f x = left(value) if x came from the left type, and
+    // right(value) otherwise. see cipher_sum_dispatch.hpp for the same over
+    // a batch of values.
+    template <typename L, typename R>
+    auto case_of(cipher_sum_type const & x, L left, R right)
+    {
+        return x.cipher_type == x.cipher_type_left ?
+            left(x.cipher_value) : right(x.cipher_value);
+    }
+}
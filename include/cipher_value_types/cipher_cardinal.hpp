@@ -1,4 +1,4 @@
-
+#pragma once
 
 /**
  * cipher_cardinal<N> is a cipher type
@@ -10,10 +10,48 @@
  * and
  *     == : cipher_cardinal<N> -> cipher_cardinal<N> -> cipher_bool
  * may be modeled as cipher binary relations over cipher_cardinal<N>.
+ *
+ * cipher_cardinal_coder<N,K,H> encodes x by a chain of K applications of
+ * the hash h, xored with h(s) for the secret s. A chain is a sequence of
+ * dependent hashes, so a single one runs at the latency of h, not its
+ * throughput. encode_many encodes a column instead: h(s) is computed once,
+ * and the chains of many values are run side by side, which keeps the
+ * multipliers busy, and over threads for a large column. If H provides
+ * chain(xs, n, k), which applies itself k times to each of n values, that
+ * is used; cardinal_hash, the default, runs 64 chains in 8 AVX-512
+ * registers, 32 in 8 AVX2 registers, or else 8 in general registers.
+ *
+ * cipher_cardinal_decoder inverts a chain by searching the domain;
+ * cipher_cardinal_table is a precomputed decoder, which trades memory for
+ * the number of chains per cipher.
  */
 
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <optional>
+#include <cstddef>
+#include <cstdint>
+#include <bit>
+#include <utility>
+#include <type_traits>
+#include "../ahs/ahs_hash.hpp"
+#include "../ahs/perfect_hash.hpp"
+#if defined(__AVX2__) || defined(__AVX512DQ__)
+#include <immintrin.h>
+#endif
+
+using std::vector;
+using std::thread;
+using std::optional;
+using std::nullopt;
+using std::size_t;
+using std::uint64_t;
+using std::uint32_t;
+using std::uint16_t;
+
 template <size_t N>
-class cipher_cardinal
+struct cipher_cardinal
 {
     // A trapdoor of a natural number is a one-way transformation.
     // A natural number x that is a cipher is a two-way transformation
@@ -24,43 +62,501 @@ class cipher_cardinal
     // the key hash is a hash of the secret key,
     // which faciliates a form of dynamic type checking.
     size_t key_hash;
+};
 
+// ahs::mix64, a bijection of 64-bit words, with chains of it run in SIMD
+// lanes.
+struct cardinal_hash
+{
+    size_t operator()(size_t x) const
+    {
+        return size_t(alex::ahs::mix64(uint64_t(x)));
+    }
+
+    // applies the hash k times to each of the n values of xs.
+    void chain(uint64_t * xs, size_t n, size_t k) const
+    {
+        // a hash has a latency of about 12 instructions (two multiplies),
+        // so there are enough independent chains in flight to cover it.
+        constexpr size_t ways = 8;
+        size_t i = 0;
+#if defined(__AVX512DQ__)
+        __m512i const m1 = _mm512_set1_epi64(static_cast<long long>(0xff51afd7ed558ccdULL));
+        __m512i const m2 = _mm512_set1_epi64(static_cast<long long>(0xc4ceb9fe1a85ec53ULL));
+        // (the mask forms avoid a spurious warning of gcc 12.)
+        auto const mix = [](__m512i a) { return _mm512_xor_si512(a, _mm512_maskz_srli_epi64(0xff, a, 33)); };
+        for (; i + 8 * ways <= n; i += 8 * ways)
+        {
+            __m512i v[ways];
+            for (size_t r = 0; r < ways; ++r)
+                v[r] = _mm512_loadu_si512(xs + i + 8 * r);
+            for (size_t j = 0; j < k; ++j)
+            {
+                for (size_t r = 0; r < ways; ++r)
+                    v[r] = mix(_mm512_mullo_epi64(mix(_mm512_mullo_epi64(mix(v[r]), m1)), m2));
+            }
+            for (size_t r = 0; r < ways; ++r)
+                _mm512_storeu_si512(xs + i + 8 * r, v[r]);
+        }
+#elif defined(__AVX2__)
+        // AVX2 has no 64-bit multiply; it is three 32-bit ones.
+        auto const mul = [](__m256i a, __m256i lo, __m256i hi)
+        {
+            __m256i const cross = _mm256_add_epi64(
+                _mm256_mul_epu32(_mm256_srli_epi64(a, 32), lo), _mm256_mul_epu32(a, hi));
+            return _mm256_add_epi64(_mm256_mul_epu32(a, lo), _mm256_slli_epi64(cross, 32));
+        };
+        auto const mix = [](__m256i a) { return _mm256_xor_si256(a, _mm256_srli_epi64(a, 33)); };
+        __m256i const m1lo = _mm256_set1_epi64x(0xed558ccdLL), m1hi = _mm256_set1_epi64x(0xff51afd7LL);
+        __m256i const m2lo = _mm256_set1_epi64x(0x1a85ec53LL), m2hi = _mm256_set1_epi64x(0xc4ceb9feLL);
+        for (; i + 4 * ways <= n; i += 4 * ways)
+        {
+            __m256i v[ways];
+            for (size_t r = 0; r < ways; ++r)
+                v[r] = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(xs + i + 4 * r));
+            for (size_t j = 0; j < k; ++j)
+            {
+                for (size_t r = 0; r < ways; ++r)
+                    v[r] = mix(mul(mix(mul(mix(v[r]), m1lo, m1hi)), m2lo, m2hi));
+            }
+            for (size_t r = 0; r < ways; ++r)
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(xs + i + 4 * r), v[r]);
+        }
+#endif
+        for (; i + ways <= n; i += ways)
+        {
+            uint64_t v[ways];
+            for (size_t r = 0; r < ways; ++r)
+                v[r] = xs[i + r];
+            for (size_t j = 0; j < k; ++j)
+            {
+                for (size_t r = 0; r < ways; ++r)
+                    v[r] = alex::ahs::mix64(v[r]);
+            }
+            for (size_t r = 0; r < ways; ++r)
+                xs[i + r] = v[r];
+        }
+        for (; i < n; ++i)
+        {
+            for (size_t j = 0; j < k; ++j)
+                xs[i] = alex::ahs::mix64(xs[i]);
+        }
+    }
 };
 
-template <size_t N, size_t K, typename H>
+// applies h k times to each of the n values of xs, by h.chain if H has it.
+template <typename H>
+void cardinal_chain(H const & h, uint64_t * xs, size_t n, size_t k)
+{
+    if constexpr (requires { h.chain(xs, n, k); })
+        h.chain(xs, n, k);
+    else
+    {
+        // independent chains, interleaved, which the compiler may
+        // vectorize if h is simple enough.
+        constexpr size_t lanes = 8;
+        size_t i = 0;
+        for (; i + lanes <= n; i += lanes)
+        {
+            for (size_t j = 0; j < k; ++j)
+                for (size_t l = 0; l < lanes; ++l)
+                    xs[i + l] = uint64_t(h(size_t(xs[i + l])));
+        }
+        for (; i < n; ++i)
+        {
+            for (size_t j = 0; j < k; ++j)
+                xs[i] = uint64_t(h(size_t(xs[i])));
+        }
+    }
+}
+
+/**
+ * Calls f(begin, end) on ranges that cover [0,n), each on its own thread,
+ * using up to threads threads (0 to choose by the number of hashes, n
+ * chains of k). A column of fewer than 512 values is not split.
+ */
+template <typename F>
+void cardinal_parallel(size_t n, size_t k, unsigned threads, F f)
+{
+    if (threads == 0)
+    {
+        constexpr size_t hashes_per_thread = size_t(1) << 26;
+        threads = static_cast<unsigned>(std::clamp<size_t>(
+            n * std::max<size_t>(k, 1) / hashes_per_thread, 1, std::max(1u, thread::hardware_concurrency())));
+    }
+    if (threads <= 1 || n < 512)
+    {
+        f(size_t(0), n);
+        return;
+    }
+    vector<thread> ts;
+    size_t const per = (n + threads - 1) / threads;
+    for (size_t b = 0; b < n; b += per)
+        ts.emplace_back(f, b, std::min(n, b + per));
+    for (auto & t : ts)
+        t.join();
+}
+
+template <size_t N, size_t K, typename H = cardinal_hash>
 struct cipher_cardinal_coder
 {
+    // the number of values of a chunk of encode_many.
+    static constexpr size_t chunk_size = 256;
+
     template <typename S>
     cipher_cardinal<N> operator()(size_t x, S s) const
+    {
+        return encode(x, h(s));
+    }
+
+    // encodes x, given the secret term h(s).
+    cipher_cardinal<N> encode(size_t x, size_t hs) const
     {
         for (size_t i = 0; i < K; ++i)
-            x = h(x);        
-        return x ^ h(s);
+            x = h(x);
+        return cipher_cardinal<N>{x ^ hs, h(hs)};
+    }
+
+    /**
+     * Sets out[i] to the cipher of xs[i] (whose key hash is the same for
+     * every value, key_hash(s)), for each of the n values, using up to
+     * threads threads (0 to choose by n and K).
+     */
+    template <typename S>
+    void encode_many(size_t const * xs, size_t n, S s, size_t * out, unsigned threads = 0) const
+    {
+        size_t const hs = h(s);
+        cardinal_parallel(n, K, threads, [&](size_t begin, size_t end)
+        {
+            uint64_t block[chunk_size];
+            for (size_t i = begin; i < end; i += chunk_size)
+            {
+                size_t const m = std::min(chunk_size, end - i);
+                for (size_t j = 0; j < m; ++j)
+                    block[j] = uint64_t(xs[i + j]);
+                cardinal_chain(h, block, m, K);
+                for (size_t j = 0; j < m; ++j)
+                    out[i + j] = size_t(block[j]) ^ hs;
+            }
+        });
+    }
+
+    // the key hash of the ciphers of s.
+    template <typename S>
+    size_t key_hash(S s) const
+    {
+        return h(h(s));
     }
 
     H h;
 };
 
+/**
+ * Decodes a cipher_cardinal<N> by searching {0,...,N-1} for the value whose
+ * chain matches, which takes up to N chains of K hashes. To decode many,
+ * see cipher_cardinal_table.
+ */
+template <size_t N, size_t K, typename H = cardinal_hash>
 struct cipher_cardinal_decoder
 {
     template <typename S>
-    cipher_cardinal<N> operator()(size_t x, S s) const
+    optional<size_t> operator()(cipher_cardinal<N> c, S s) const
     {
-        for (size_t i = 0; i < K; ++i)
-            x = h(x);        
-        return x ^ h(s);
+        size_t const target = c.cipher ^ h(s);
+        for (size_t x = 0; x < N; ++x)
+        {
+            size_t y = x;
+            for (size_t i = 0; i < K; ++i)
+                y = h(y);
+            if (y == target)
+                return x;
+        }
+        return nullopt;
     }
 
     H h;
 };
-   
-
 
-template <>
-struct cipher_less_than<cipher_cardinal>
+/**
+ * A precomputed decoder of cipher_cardinal<N>, for a domain {0,...,N-1}
+ * that may be enumerated once: make evaluates the chain h^K(x) of every x.
+ * A cipher of x under s is h^K(x) ^ h(s), so the table does not depend on
+ * the secret, and one table decodes the ciphers of every secret.
+ *
+ * p := position(h^K(x)) is a minimal perfect hash of the chains (see
+ * ahs/perfect_hash.hpp), so x -> p is a permutation of the domain. With
+ * interval 1, the table is its inverse: entry p holds h^K(x) and x, and a
+ * cipher is decoded by a hash and a probe, at 16 bytes per value.
+ *
+ * With an interval c > 1, it only stores every c-th value of each cycle of
+ * the permutation, a checkpoint, with the checkpoint before it. A cipher
+ * of x, whose successor p is known without x, is decoded by walking from p
+ * to the next checkpoint, then from the checkpoint before that one to x,
+ * and checking the chain of x: at most c chains of K hashes, and a probe.
+ * The table takes about (8 + 64 / c) bits per value, and decode_many runs
+ * the chains of many ciphers side by side, as encode_many does.
+ */
+template <size_t N, size_t K, typename H = cardinal_hash>
+class cipher_cardinal_table
 {
-    cipher_bool less_than(cipher_cardinal lhs, cipher_cardinal rhs)
+public:
+    using index_type = std::conditional_t<(N <= (size_t(1) << 32)), uint32_t, uint64_t>;
+
+    // make(0) builds a full table for up to full_table_limit values, and
+    // else takes the interval default_interval.
+    static constexpr size_t full_table_limit = size_t(1) << 22;
+    static constexpr size_t default_interval = 16;
+
+    // the number of ciphers decoded side by side by decode_many.
+    static constexpr size_t block_size = 256;
+
+    /**
+     * Builds the table of checkpoint interval interval (0 to choose by N),
+     * using up to threads threads to evaluate the chains. Returns nullopt if
+     * two values of the domain have the same chain, so that their ciphers
+     * may not be decoded.
+     */
+    static optional<cipher_cardinal_table> make(size_t interval = 0, unsigned threads = 0, H h = H{})
+    {
+        cipher_cardinal_table t;
+        t.h_ = h;
+        t.interval_ = interval != 0 ? interval : N <= full_table_limit ? 1 : default_interval;
+
+        vector<uint64_t> ys(N);
+        cardinal_parallel(N, K, threads, [&](size_t begin, size_t end)
+        {
+            for (size_t x = begin; x < end; ++x)
+                ys[x] = uint64_t(x);
+            cardinal_chain(t.h_, ys.data() + begin, end - begin, K);
+        });
+        auto position = alex::ahs::minimal_perfect_hash::build(ys);
+        if (!position)
+            return nullopt;
+        t.position_ = std::move(*position);
+
+        if (t.interval_ == 1)
+        {
+            vector<uint64_t> ps(N);
+            t.position_(ys.data(), N, ps.data());
+            t.entries_.resize(N);
+            for (size_t x = 0; x < N; ++x)
+                t.entries_[ps[x]] = entry{ys[x], index_type(x)};
+            return t;
+        }
+
+        // ys becomes the permutation, x -> position(h^K(x)).
+        t.position_(ys.data(), N, ys.data());
+        size_t const words = (N + 63) / 64;
+        vector<uint64_t> visited(words, 0);
+        t.checkpoints_.assign(words, 0);
+        vector<std::pair<uint64_t, checkpoint>> marks;
+        for (uint64_t x0 = 0; x0 < N; ++x0)
+        {
+            if ((visited[x0 / 64] >> (x0 % 64)) & 1)
+                continue;
+            uint64_t x = x0, last = x0;
+            size_t at = 0, last_at = 0;
+            do
+            {
+                visited[x / 64] |= uint64_t(1) << (x % 64);
+                if (at % t.interval_ == 0)
+                {
+                    t.checkpoints_[x / 64] |= uint64_t(1) << (x % 64);
+                    if (at != 0)
+                        marks.emplace_back(x, checkpoint{index_type(last), index_type(at - last_at)});
+                    last = x;
+                    last_at = at;
+                }
+                x = ys[x];
+                ++at;
+            } while (x != x0);
+            marks.emplace_back(x0, checkpoint{index_type(last), index_type(at - last_at)});
+        }
+
+        t.ranks_.resize(words);
+        index_type rank = 0;
+        for (size_t w = 0; w < words; ++w)
+        {
+            t.ranks_[w] = rank;
+            rank += index_type(std::popcount(t.checkpoints_[w]));
+        }
+        t.previous_.resize(marks.size());
+        for (auto const & [x, c] : marks)
+            t.previous_[t.rank(x)] = c;
+        return t;
+    }
+
+    size_t interval() const { return interval_; }
+
+    // the size of the table in bytes.
+    size_t bytes() const
+    {
+        return position_.bytes() + entries_.size() * sizeof(entry) +
+            checkpoints_.size() * sizeof(uint64_t) + ranks_.size() * sizeof(index_type) +
+            previous_.size() * sizeof(checkpoint);
+    }
+
+    template <typename S>
+    optional<size_t> operator()(cipher_cardinal<N> c, S s) const
+    {
+        uint64_t const y = uint64_t(c.cipher ^ h_(s));
+        uint64_t z = position_(y);
+        if (interval_ == 1)
+        {
+            entry const & e = entries_[z];
+            if (e.chain != y)
+                return nullopt;
+            return size_t(e.x);
+        }
+
+        size_t d = 0;
+        for (; !is_checkpoint(z); ++d)
+            z = position_(chain(z));
+        checkpoint const & q = previous_[rank(z)];
+        uint64_t w = q.previous;
+        for (size_t i = d + 1; i < q.gap; ++i)
+            w = position_(chain(w));
+        if (chain(w) != y)
+            return nullopt;
+        return size_t(w);
+    }
+
+    /**
+     * Sets out[i] to the value of the cipher cs[i] under s, or to N if it
+     * is not a cipher of s, for each of the n ciphers, using up to threads
+     * threads (0 to choose by n and the interval). Returns the number of
+     * ciphers that are not ciphers of s.
+     */
+    template <typename S>
+    size_t decode_many(size_t const * cs, size_t n, S s, size_t * out, unsigned threads = 0) const
+    {
+        uint64_t const hs = uint64_t(h_(s));
+        size_t const hashes = interval_ == 1 ? 0 : K * interval_;
+        cardinal_parallel(n, hashes, threads, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i += block_size)
+                decode_block(cs + i, std::min(block_size, end - i), hs, out + i);
+        });
+        return size_t(std::count(out, out + n, N));
+    }
+
+private:
+    struct entry
+    {
+        uint64_t chain;
+        index_type x;
+    };
+
+    struct checkpoint
+    {
+        // the checkpoint before, gap values back on the cycle.
+        index_type previous;
+        index_type gap;
+    };
+
+    uint64_t chain(uint64_t x) const
+    {
+        for (size_t i = 0; i < K; ++i)
+            x = uint64_t(h_(size_t(x)));
+        return x;
+    }
+
+    bool is_checkpoint(uint64_t x) const
+    {
+        return (checkpoints_[x / 64] >> (x % 64)) & 1;
+    }
+
+    // the number of checkpoints before x.
+    size_t rank(uint64_t x) const
+    {
+        uint64_t const below = (uint64_t(1) << (x % 64)) - 1;
+        return size_t(ranks_[x / 64]) + size_t(std::popcount(checkpoints_[x / 64] & below));
+    }
+
+    void decode_block(size_t const * cs, size_t n, uint64_t hs, size_t * out) const
     {
+        uint64_t ys[block_size], zs[block_size];
+        for (size_t i = 0; i < n; ++i)
+            ys[i] = uint64_t(cs[i]) ^ hs;
+        position_(ys, n, zs);
+
+        if (interval_ == 1)
+        {
+            for (size_t i = 0; i < n; ++i)
+                __builtin_prefetch(entries_.data() + zs[i]);
+            for (size_t i = 0; i < n; ++i)
+            {
+                entry const & e = entries_[zs[i]];
+                out[i] = e.chain == ys[i] ? size_t(e.x) : N;
+            }
+            return;
+        }
 
+        // as operator(), in lockstep: a round takes one step of each cipher
+        // that is not decoded yet. a cipher walks to its checkpoint (steps
+        // counts its steps), then walks from the checkpoint before it, with
+        // steps counting down the chains that are left.
+        size_t steps[block_size];
+        bool back[block_size];
+        uint16_t active[block_size];
+        uint64_t chains[block_size], positions[block_size];
+        auto settle = [&](size_t i)
+        {
+            if (!is_checkpoint(zs[i]))
+                return;
+            checkpoint const & q = previous_[rank(zs[i])];
+            zs[i] = q.previous;
+            steps[i] = size_t(q.gap) - steps[i];
+            back[i] = true;
+        };
+        for (size_t i = 0; i < n; ++i)
+        {
+            steps[i] = 0;
+            back[i] = false;
+            active[i] = uint16_t(i);
+            settle(i);
+        }
+
+        for (size_t m = n; m != 0; )
+        {
+            for (size_t a = 0; a < m; ++a)
+                chains[a] = zs[active[a]];
+            cardinal_chain(h_, chains, m, K);
+            position_(chains, m, positions);
+
+            size_t kept = 0;
+            for (size_t a = 0; a < m; ++a)
+            {
+                size_t const i = active[a];
+                if (!back[i])
+                {
+                    zs[i] = positions[a];
+                    ++steps[i];
+                    settle(i);
+                }
+                else if (--steps[i] == 0)
+                {
+                    out[i] = chains[a] == ys[i] ? size_t(zs[i]) : N;
+                    continue;
+                }
+                else
+                    zs[i] = positions[a];
+                active[kept++] = uint16_t(i);
+            }
+            m = kept;
+        }
     }
+
+    H h_{};
+    size_t interval_ = 1;
+    alex::ahs::minimal_perfect_hash position_;
+
+    // interval 1: entry p is the value at position p.
+    vector<entry> entries_;
+
+    // interval c: a bit per value, set for the checkpoints, the number of
+    // checkpoints before each word, and the checkpoint before each one.
+    vector<uint64_t> checkpoints_;
+    vector<index_type> ranks_;
+    vector<checkpoint> previous_;
 };
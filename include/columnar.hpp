@@ -0,0 +1,737 @@
+#pragma once
+
+/**
+ * A columnar binary file format for arrays of 64-bit values, e.g., the
+ * values and secrets of a column of cipher tags, laid out to be used
+ * directly from a memory mapping (see mapped_file.hpp).
+ *
+ * Each column is stored in one of five encodings:
+ *
+ *  - plain: the values, 8 bytes each. A plain column is read in place, as a
+ *    span over the mapped bytes.
+ *  - bit_packed: each value in bits bits, the width of the largest value,
+ *    e.g., for cipher codes of a fixed width.
+ *  - frame_of_reference: blocks of for_block_size values, each stored as
+ *    its minimum and the bit-packed differences from it, in the width of
+ *    its largest difference. Values that are clustered, or constant (e.g.,
+ *    the secrets of a column of tags), take a few bits each.
+ *  - varint: LEB128, 7 bits per byte, so small values take a byte. It has
+ *    no random access.
+ *  - split_halves: the high and the low 32-bit halves of the values (see
+ *    serialize.hpp), as two bit-packed arrays, each in the width of its
+ *    largest half. Values with a narrow field in each half, e.g., a secret
+ *    in the high half and a code in the low one, take the widths of the
+ *    two fields rather than 32 bits and the width of the high one.
+ *
+ * column_file_writer::add picks the smallest by default.
+ *
+ * The file format,
+ * ---
+ * column_file_header     (128 bytes)
+ * directory              (column_count column_file_entry)
+ * columns                (each at an offset that is a multiple of 8)
+ *
+ * A bit-packed column (and the packed part of a frame-of-reference column,
+ * and each half of a split-halves column) is followed by 8 zero bytes, so
+ * that a value is read with one unaligned 8-byte load and a shift. A
+ * frame-of-reference column begins with a block table, a pair (minimum,
+ * offset << 8 | bits) per block.
+ *
+ * Every encoding takes at least a bit per value (a bit-packed column of
+ * zeros is padded to a bit each), so open() rejects a column whose count
+ * is more than 8 times its size, and decoding a column allocates at most
+ * 64 times the size of the file.
+ *
+ * The checksum is ahs::hash_bytes of the columns, seeded with the hash of
+ * the directory. It is checked by verify(), not by open(), which would
+ * read the whole file.
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <span>
+#include <bit>
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include "ahs/ahs_hash.hpp"
+#include "mapped_file.hpp"
+#include "serialize.hpp"
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::optional;
+using std::nullopt;
+using std::span;
+using std::size_t;
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+
+namespace alex
+{
+    enum class column_encoding : uint8_t
+    {
+        plain,
+        bit_packed,
+        frame_of_reference,
+        varint,
+        split_halves,
+        // the smallest of the above, when writing.
+        automatic = 0xff
+    };
+
+    constexpr size_t for_block_size = 128;
+
+    namespace detail
+    {
+        // the number of bits of the largest of the n values of xs.
+        inline unsigned bit_width_of(uint64_t const * xs, size_t n)
+        {
+            uint64_t all = 0;
+            for (size_t i = 0; i < n; ++i)
+                all |= xs[i];
+            return unsigned(std::bit_width(all));
+        }
+
+        inline uint64_t low_bits(unsigned bits)
+        {
+            return bits == 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+        }
+
+        // the bytes of n values of the given width, plus the 8 bytes of
+        // padding.
+        inline size_t bit_packed_size(size_t n, unsigned bits)
+        {
+            return (n * bits + 7) / 8 + 8;
+        }
+
+        // the bytes of a bit-packed column (or half column) of n values,
+        // which takes at least a bit per value even if they are all 0, so
+        // that the count of a column is bounded by its size.
+        inline size_t bit_packed_column_size(size_t n, unsigned bits)
+        {
+            return bit_packed_size(n, std::max(bits, 1u));
+        }
+
+        /**
+         * Appends the n values of xs, less base, in bits bits each, to out,
+         * followed by the padding.
+         */
+        template <typename U>
+        void bit_pack(U const * xs, size_t n, uint64_t base, unsigned bits, string & out)
+        {
+            size_t const start = out.size();
+            out.resize(start + bit_packed_size(n, bits), '\0');
+            if (bits == 0)
+                return;
+
+            char * const p = out.data() + start;
+            uint64_t acc = 0;
+            unsigned used = 0;
+            size_t at = 0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                uint64_t const v = xs[i] - base;
+                acc |= v << used;
+                if (used + bits >= 64)
+                {
+                    std::memcpy(p + at, &acc, 8);
+                    at += 8;
+                    // the bits of v that did not fit.
+                    acc = used == 0 ? 0 : v >> (64 - used);
+                    used = used + bits - 64;
+                }
+                else
+                    used += bits;
+            }
+            if (used != 0)
+                std::memcpy(p + at, &acc, (used + 7) / 8);
+        }
+
+        // appends a bit-packed column of the n values of xs, of width bits.
+        template <typename U>
+        void bit_pack_column(U const * xs, size_t n, unsigned bits, string & out)
+        {
+            size_t const start = out.size();
+            bit_pack(xs, n, 0, bits, out);
+            out.resize(start + bit_packed_column_size(n, bits), '\0');
+        }
+
+        // value i of a bit-packed array at p, whose padding may be read.
+        inline uint64_t bit_unpack_one(char const * p, size_t i, unsigned bits)
+        {
+            size_t const bit = i * bits;
+            uint64_t const w = ahs::load_le64(p + bit / 8);
+            unsigned const shift = unsigned(bit % 8);
+            if (shift + bits <= 64)
+                return (w >> shift) & low_bits(bits);
+            // a value of more than 56 bits may span 9 bytes.
+            uint64_t const rest = uint64_t(uint8_t(p[bit / 8 + 8]));
+            return ((w >> shift) | (rest << (64 - shift))) & low_bits(bits);
+        }
+
+        // adds the n values of a bit-packed array at p to base and stores
+        // them in out, whose values must hold them.
+        template <typename U>
+        void bit_unpack(char const * p, size_t n, uint64_t base, unsigned bits, U * out)
+        {
+            if (bits == 0)
+            {
+                std::fill(out, out + n, U(base));
+                return;
+            }
+            if (bits <= 56)
+            {
+                // the common case: one load and a shift per value.
+                uint64_t const mask = low_bits(bits);
+                for (size_t i = 0, bit = 0; i < n; ++i, bit += bits)
+                    out[i] = U(base + ((ahs::load_le64(p + bit / 8) >> (bit % 8)) & mask));
+                return;
+            }
+            for (size_t i = 0; i < n; ++i)
+                out[i] = U(base + bit_unpack_one(p, i, bits));
+        }
+
+        inline void varint_encode(uint64_t const * xs, size_t n, string & out)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                uint64_t v = xs[i];
+                while (v >= 0x80)
+                {
+                    out.push_back(char(uint8_t(v) | 0x80));
+                    v >>= 7;
+                }
+                out.push_back(char(v));
+            }
+        }
+
+        // returns false if the n values do not fit in [p, end).
+        inline bool varint_decode(char const * p, char const * end, size_t n, uint64_t * out)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                uint64_t v = 0;
+                for (unsigned shift = 0; ; shift += 7)
+                {
+                    if (p == end || shift > 63)
+                        return false;
+                    uint8_t const b = uint8_t(*p++);
+                    v |= uint64_t(b & 0x7f) << shift;
+                    if (b < 0x80)
+                        break;
+                }
+                out[i] = v;
+            }
+            return true;
+        }
+
+        // a block of a frame-of-reference column.
+        struct for_block
+        {
+            uint64_t min;
+            // the offset of its packed values from the end of the block
+            // table, shifted left by 8, and their width.
+            uint64_t offset_bits;
+        };
+
+        inline size_t for_block_count(size_t n)
+        {
+            return (n + for_block_size - 1) / for_block_size;
+        }
+
+        // the sizes of a column in each encoding.
+        struct encoded_sizes
+        {
+            size_t plain;
+            size_t bit_packed;
+            size_t frame_of_reference;
+            size_t varint;
+            size_t split_halves;
+
+            // computed in one pass over the values.
+            encoded_sizes(uint64_t const * xs, size_t n) :
+                plain(n * sizeof(uint64_t)), bit_packed(0),
+                frame_of_reference(for_block_count(n) * sizeof(for_block) + 8), varint(0),
+                split_halves(0)
+            {
+                uint64_t all = 0;
+                uint32_t all_lo = 0;
+                for (size_t b = 0; b < n; b += for_block_size)
+                {
+                    size_t const m = std::min(for_block_size, n - b);
+                    uint64_t lo = xs[b], hi = xs[b];
+                    for (size_t i = b; i < b + m; ++i)
+                    {
+                        lo = std::min(lo, xs[i]);
+                        hi = std::max(hi, xs[i]);
+                        all |= xs[i];
+                        all_lo |= uint32_t(xs[i]);
+                        // 1 byte per 7 bits, and 1 for 0.
+                        varint += (size_t(std::bit_width(xs[i] | 1)) + 6) / 7;
+                    }
+                    frame_of_reference += (m * size_t(std::bit_width(hi - lo)) + 7) / 8;
+                }
+                bit_packed = bit_packed_column_size(n, unsigned(std::bit_width(all)));
+                split_halves = bit_packed_column_size(n, unsigned(std::bit_width(all >> 32))) +
+                    bit_packed_column_size(n, unsigned(std::bit_width(all_lo)));
+            }
+        };
+
+        inline void for_encode(uint64_t const * xs, size_t n, string & out)
+        {
+            size_t const table = out.size();
+            out.resize(table + for_block_count(n) * sizeof(for_block), '\0');
+            string packed;
+            for (size_t b = 0, k = 0; b < n; b += for_block_size, ++k)
+            {
+                size_t const m = std::min(for_block_size, n - b);
+                auto const [lo, hi] = std::minmax_element(xs + b, xs + b + m);
+                unsigned const bits = unsigned(std::bit_width(*hi - *lo));
+                for_block const blk{*lo, (uint64_t(packed.size()) << 8) | bits};
+                std::memcpy(out.data() + table + k * sizeof(for_block), &blk, sizeof(blk));
+
+                // a block of for_block_size values fills whole bytes, so
+                // only the last block is padded.
+                bit_pack(xs + b, m, *lo, bits, packed);
+                packed.resize(packed.size() - 8);
+            }
+            packed.append(8, '\0');
+            out += packed;
+        }
+
+        // the halves of the n values of xs, in the widths hi_bits and
+        // lo_bits of their largest.
+        inline void split_encode(uint64_t const * xs, size_t n, unsigned & hi_bits, unsigned & lo_bits, string & out)
+        {
+            vector<uint32_t> hi(n), lo(n);
+            unpack_many(xs, n, hi.data(), lo.data());
+            uint32_t all_hi = 0, all_lo = 0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                all_hi |= hi[i];
+                all_lo |= lo[i];
+            }
+            hi_bits = unsigned(std::bit_width(all_hi));
+            lo_bits = unsigned(std::bit_width(all_lo));
+            bit_pack_column(hi.data(), n, hi_bits, out);
+            bit_pack_column(lo.data(), n, lo_bits, out);
+        }
+
+        inline void split_decode(char const * p, size_t n, unsigned hi_bits, unsigned lo_bits, uint64_t * out)
+        {
+            // a chunk of a multiple of 8 values starts on a byte.
+            constexpr size_t chunk = 1024;
+            uint32_t hi[chunk], lo[chunk];
+            char const * const lo_p = p + bit_packed_column_size(n, hi_bits);
+            for (size_t i = 0; i < n; i += chunk)
+            {
+                size_t const m = std::min(chunk, n - i);
+                bit_unpack(p + i * hi_bits / 8, m, 0, hi_bits, hi);
+                bit_unpack(lo_p + i * lo_bits / 8, m, 0, lo_bits, lo);
+                pack_many(hi, lo, m, out + i);
+            }
+        }
+
+        inline for_block for_block_at(char const * p, size_t k)
+        {
+            for_block blk;
+            std::memcpy(&blk, p + k * sizeof(for_block), sizeof(blk));
+            return blk;
+        }
+    }
+
+    struct column_file_header
+    {
+        static constexpr char const * magic_bytes() { return "ALXCOL\0"; }
+        static constexpr uint32_t current_version() { return 1; }
+
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved0;
+
+        uint64_t column_count;
+        uint64_t directory_offset;
+        uint64_t checksum;
+        uint64_t reserved[11];
+
+        bool valid() const
+        {
+            return std::memcmp(magic, magic_bytes(), sizeof(magic)) == 0 &&
+                   version == current_version();
+        }
+    };
+
+    static_assert(sizeof(column_file_header) == 128);
+
+    struct column_file_entry
+    {
+        uint64_t offset;
+        // the size of the encoded column in bytes.
+        uint64_t size;
+        // the number of values.
+        uint64_t count;
+        column_encoding encoding;
+        // the width of a bit-packed column, or of the high halves of a
+        // split-halves column.
+        uint8_t bits;
+        // the width of the low halves of a split-halves column.
+        uint8_t low_bits;
+        uint8_t reserved[5];
+    };
+
+    static_assert(sizeof(column_file_entry) == 32);
+
+    /**
+     * Builds a column file, column by column, in memory, and writes it.
+     */
+    class column_file_writer
+    {
+    public:
+        // the size in bytes of the n values of xs in encoding e.
+        static size_t encoded_size(uint64_t const * xs, size_t n, column_encoding e)
+        {
+            return encoded_size(detail::encoded_sizes(xs, n), e);
+        }
+
+        // the encoding in which the n values of xs are smallest.
+        static column_encoding best_encoding(uint64_t const * xs, size_t n)
+        {
+            return best_encoding(detail::encoded_sizes(xs, n));
+        }
+
+        /**
+         * Appends a column of the n values of xs. Returns its index.
+         */
+        size_t add(uint64_t const * xs, size_t n, column_encoding e = column_encoding::automatic)
+        {
+            detail::encoded_sizes const sizes(xs, n);
+            if (e == column_encoding::automatic)
+                e = best_encoding(sizes);
+
+            // columns are 8-byte aligned, relative to the end of the
+            // directory, which is too.
+            body_.resize((body_.size() + 7) & ~size_t(7), '\0');
+            body_.reserve(body_.size() + encoded_size(sizes, e));
+
+            column_file_entry c;
+            std::memset(&c, 0, sizeof(c));
+            c.offset = body_.size();
+            c.count = n;
+            c.encoding = e;
+            switch (e)
+            {
+            case column_encoding::plain:
+                body_.append(reinterpret_cast<char const *>(xs), n * sizeof(uint64_t));
+                break;
+            case column_encoding::bit_packed:
+                c.bits = uint8_t(detail::bit_width_of(xs, n));
+                detail::bit_pack_column(xs, n, c.bits, body_);
+                break;
+            case column_encoding::frame_of_reference:
+                detail::for_encode(xs, n, body_);
+                break;
+            case column_encoding::varint:
+                detail::varint_encode(xs, n, body_);
+                break;
+            case column_encoding::split_halves:
+            {
+                unsigned hi_bits, lo_bits;
+                detail::split_encode(xs, n, hi_bits, lo_bits, body_);
+                c.bits = uint8_t(hi_bits);
+                c.low_bits = uint8_t(lo_bits);
+                break;
+            }
+            case column_encoding::automatic:
+                break;
+            }
+            c.size = body_.size() - c.offset;
+            columns_.push_back(c);
+            return columns_.size() - 1;
+        }
+
+        size_t size() const { return columns_.size(); }
+
+        // writes the file filename. returns false on failure.
+        bool write(string const & filename) const
+        {
+            column_file_header h;
+            std::memset(&h, 0, sizeof(h));
+            std::memcpy(h.magic, column_file_header::magic_bytes(), sizeof(h.magic));
+            h.version = column_file_header::current_version();
+            h.column_count = columns_.size();
+            h.directory_offset = sizeof(column_file_header);
+
+            uint64_t const data_offset = h.directory_offset + columns_.size() * sizeof(column_file_entry);
+            vector<column_file_entry> directory = columns_;
+            for (auto & c : directory)
+                c.offset += data_offset;
+
+            string const dir(reinterpret_cast<char const *>(directory.data()),
+                directory.size() * sizeof(column_file_entry));
+            h.checksum = ahs::hash_bytes(body_, ahs::hash_bytes(dir));
+
+            string const tmp = filename + ".tmp";
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<char const *>(&h), sizeof(h));
+            out.write(dir.data(), std::streamsize(dir.size()));
+            out.write(body_.data(), std::streamsize(body_.size()));
+            out.close();
+            if (!out)
+            {
+                std::remove(tmp.c_str());
+                return false;
+            }
+            return std::rename(tmp.c_str(), filename.c_str()) == 0;
+        }
+
+    private:
+        static size_t encoded_size(detail::encoded_sizes const & sizes, column_encoding e)
+        {
+            switch (e)
+            {
+            case column_encoding::plain:
+                return sizes.plain;
+            case column_encoding::bit_packed:
+                return sizes.bit_packed;
+            case column_encoding::frame_of_reference:
+                return sizes.frame_of_reference;
+            case column_encoding::varint:
+                return sizes.varint;
+            case column_encoding::split_halves:
+                return sizes.split_halves;
+            case column_encoding::automatic:
+                return encoded_size(sizes, best_encoding(sizes));
+            }
+            return 0;
+        }
+
+        static column_encoding best_encoding(detail::encoded_sizes const & sizes)
+        {
+            column_encoding best = column_encoding::plain;
+            size_t size = sizes.plain;
+            for (auto e : {column_encoding::bit_packed, column_encoding::frame_of_reference, column_encoding::varint,
+                           column_encoding::split_halves})
+            {
+                if (encoded_size(sizes, e) < size)
+                {
+                    best = e;
+                    size = encoded_size(sizes, e);
+                }
+            }
+            return best;
+        }
+
+        vector<column_file_entry> columns_;
+        string body_;
+    };
+
+    /**
+     * A read-only view of a mapped column file. Spans of plain columns are
+     * views of the mapping, which live as long as the view.
+     */
+    class column_file_view
+    {
+    public:
+        /**
+         * Opens the column file filename. Returns nullopt if it is not a
+         * column file or it is truncated.
+         */
+        static optional<column_file_view> open(string const & filename)
+        {
+            mapped_file f;
+            if (!f.open(filename) || f.size() < sizeof(column_file_header))
+                return nullopt;
+
+            column_file_header h;
+            std::memcpy(&h, f.data(), sizeof(h));
+            if (!h.valid() || h.directory_offset != sizeof(column_file_header) ||
+                h.column_count > (f.size() - h.directory_offset) / sizeof(column_file_entry))
+                return nullopt;
+
+            vector<column_file_entry> columns(h.column_count);
+            std::memcpy(columns.data(), f.data() + h.directory_offset, columns.size() * sizeof(column_file_entry));
+            for (auto const & c : columns)
+            {
+                if (c.offset > f.size() || c.size > f.size() - c.offset || c.offset % 8 != 0 ||
+                    !valid_size(c))
+                    return nullopt;
+            }
+
+            f.advise(MADV_SEQUENTIAL);
+            return column_file_view(std::move(f), std::move(columns), h.checksum);
+        }
+
+        // checks the checksum, which reads the whole file.
+        bool verify() const
+        {
+            size_t const dir = columns_.size() * sizeof(column_file_entry);
+            size_t const data = sizeof(column_file_header) + dir;
+            return ahs::hash_bytes(string_view(file_.data() + data, file_.size() - data),
+                ahs::hash_bytes(string_view(file_.data() + sizeof(column_file_header), dir))) == checksum_;
+        }
+
+        size_t column_count() const { return columns_.size(); }
+        size_t count(size_t column) const { return size_t(columns_[column].count); }
+        column_encoding encoding(size_t column) const { return columns_[column].encoding; }
+
+        // the encoded bytes of column.
+        span<char const> bytes(size_t column) const
+        {
+            auto const & c = columns_[column];
+            return span<char const>(file_.data() + c.offset, size_t(c.size));
+        }
+
+        // the values of a plain column, in place; nullopt for any other
+        // encoding.
+        optional<span<uint64_t const>> plain(size_t column) const
+        {
+            auto const & c = columns_[column];
+            if (c.encoding != column_encoding::plain)
+                return nullopt;
+            // the mapping is page-aligned and columns are 8-byte aligned.
+            return span<uint64_t const>(reinterpret_cast<uint64_t const *>(file_.data() + c.offset), size_t(c.count));
+        }
+
+        /**
+         * Decodes column into out, which has room for count(column)
+         * values. Returns false if the column is corrupt.
+         */
+        bool decode(size_t column, uint64_t * out) const
+        {
+            auto const & c = columns_[column];
+            char const * const p = file_.data() + c.offset;
+            size_t const n = size_t(c.count);
+            switch (c.encoding)
+            {
+            case column_encoding::plain:
+                // out may be null for an empty column.
+                if (n != 0)
+                    std::memcpy(out, p, n * sizeof(uint64_t));
+                return true;
+            case column_encoding::bit_packed:
+                detail::bit_unpack(p, n, 0, c.bits, out);
+                return true;
+            case column_encoding::frame_of_reference:
+            {
+                size_t const blocks = detail::for_block_count(n);
+                char const * const packed = p + blocks * sizeof(detail::for_block);
+                for (size_t k = 0; k < blocks; ++k)
+                {
+                    auto const blk = detail::for_block_at(p, k);
+                    size_t const m = std::min(for_block_size, n - k * for_block_size);
+                    if (!valid_block(c, blk, m))
+                        return false;
+                    detail::bit_unpack(packed + (blk.offset_bits >> 8), m, blk.min,
+                        unsigned(blk.offset_bits & 0xff), out + k * for_block_size);
+                }
+                return true;
+            }
+            case column_encoding::varint:
+                return detail::varint_decode(p, p + c.size, n, out);
+            case column_encoding::split_halves:
+                detail::split_decode(p, n, c.bits, c.low_bits, out);
+                return true;
+            case column_encoding::automatic:
+                break;
+            }
+            return false;
+        }
+
+        vector<uint64_t> decode(size_t column) const
+        {
+            vector<uint64_t> out(count(column));
+            if (!decode(column, out.data()))
+                out.clear();
+            return out;
+        }
+
+        // value i of column, or nullopt for a varint column (or a corrupt
+        // one).
+        optional<uint64_t> get(size_t column, size_t i) const
+        {
+            auto const & c = columns_[column];
+            char const * const p = file_.data() + c.offset;
+            switch (c.encoding)
+            {
+            case column_encoding::plain:
+                return ahs::load_le64(p + i * sizeof(uint64_t));
+            case column_encoding::bit_packed:
+                return c.bits == 0 ? 0 : detail::bit_unpack_one(p, i, c.bits);
+            case column_encoding::frame_of_reference:
+            {
+                size_t const k = i / for_block_size;
+                auto const blk = detail::for_block_at(p, k);
+                size_t const m = std::min(for_block_size, size_t(c.count) - k * for_block_size);
+                if (!valid_block(c, blk, m))
+                    return nullopt;
+                unsigned const bits = unsigned(blk.offset_bits & 0xff);
+                char const * const packed = p + detail::for_block_count(size_t(c.count)) * sizeof(detail::for_block);
+                return blk.min + (bits == 0 ? 0 :
+                    detail::bit_unpack_one(packed + (blk.offset_bits >> 8), i % for_block_size, bits));
+            }
+            case column_encoding::split_halves:
+            {
+                uint32_t const hi = c.bits == 0 ? 0 : uint32_t(detail::bit_unpack_one(p, i, c.bits));
+                char const * const lo_p = p + detail::bit_packed_column_size(size_t(c.count), c.bits);
+                uint32_t const lo = c.low_bits == 0 ? 0 : uint32_t(detail::bit_unpack_one(lo_p, i, c.low_bits));
+                return pack<pair<uint32_t,uint32_t>, uint64_t>{}({hi, lo});
+            }
+            default:
+                return nullopt;
+            }
+        }
+
+    private:
+        column_file_view(mapped_file f, vector<column_file_entry> columns, uint64_t checksum) :
+            file_(std::move(f)), columns_(std::move(columns)), checksum_(checksum) {}
+
+        // whether the size of a column is consistent with its count, so that
+        // decoding it stays in the file.
+        static bool valid_size(column_file_entry const & c)
+        {
+            switch (c.encoding)
+            {
+            case column_encoding::plain:
+                return c.count <= c.size / sizeof(uint64_t);
+            case column_encoding::bit_packed:
+                // a width of 0 stores no bits, whatever the count.
+                return c.bits <= 64 && c.count <= c.size * 8 &&
+                    detail::bit_packed_column_size(size_t(c.count), c.bits) <= c.size;
+            case column_encoding::frame_of_reference:
+                return c.count <= c.size * 8 &&
+                    detail::for_block_count(size_t(c.count)) * sizeof(detail::for_block) + 8 <= c.size;
+            case column_encoding::varint:
+                return c.count <= c.size;
+            case column_encoding::split_halves:
+                return c.bits <= 32 && c.low_bits <= 32 &&
+                    c.count <= c.size * 8 &&
+                    detail::bit_packed_column_size(size_t(c.count), c.bits) +
+                    detail::bit_packed_column_size(size_t(c.count), c.low_bits) <= c.size;
+            default:
+                return false;
+            }
+        }
+
+        // whether the m values of a block, and their padding, are in the
+        // column.
+        static bool valid_block(column_file_entry const & c, detail::for_block const & blk, size_t m)
+        {
+            uint64_t const table = detail::for_block_count(size_t(c.count)) * sizeof(detail::for_block);
+            unsigned const bits = unsigned(blk.offset_bits & 0xff);
+            return bits <= 64 &&
+                table + (blk.offset_bits >> 8) + detail::bit_packed_size(m, bits) <= c.size;
+        }
+
+        mapped_file file_;
+        vector<column_file_entry> columns_;
+        uint64_t checksum_;
+    };
+}
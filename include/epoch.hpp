@@ -0,0 +1,267 @@
+#pragma once
+
+/**
+ * Epoch-based reclamation, for data structures that readers traverse
+ * without locks while a writer replaces parts of them.
+ *
+ * A reader pins the domain for the duration of a read,
+ * ---
+ * auto g = domain.pin();
+ * auto p = current.load();    // use *p until g is destroyed
+ *
+ * and a writer, after unlinking an object (e.g., by swapping the pointer to
+ * it), retires it instead of deleting it,
+ * ---
+ * auto old = current.exchange(next);
+ * domain.retire(old);
+ *
+ * A retired object is deleted by reclaim() once every reader that might
+ * have seen it has unpinned the domain.
+ *
+ * The domain has a global epoch and a record per reader thread, each on a
+ * cache line of its own. A thread claims a record the first time it pins
+ * the domain (from the records that exited threads released, or a new one
+ * added to the domain's list) and keeps it in a thread_local cache. So
+ * pinning stores the current epoch in the thread's record, followed by a
+ * fence, and unpinning clears it: a read takes no read-modify-write, and
+ * readers never wait for writers or for each other, however many there
+ * are. A thread may pin a domain it has pinned already; only the outermost
+ * pin publishes an epoch. A guard is released on the thread that pinned.
+ *
+ * Retiring an object advances the epoch and tags the object with the new
+ * epoch; readers that pinned it (or later) loaded the pointer after it was
+ * unlinked. So the object may be deleted once no record holds an earlier
+ * epoch.
+ */
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+using std::atomic;
+using std::vector;
+using std::shared_ptr;
+using std::size_t;
+using std::uint64_t;
+
+namespace alex
+{
+    class epoch_domain
+    {
+        // the record of a reader thread. only that thread writes epoch and
+        // depth; in_use is claimed when a thread registers and cleared when
+        // it exits.
+        struct alignas(64) record
+        {
+            atomic<uint64_t> epoch{0};
+            atomic<bool> in_use{true};
+            size_t depth = 0;
+            record * next = nullptr;
+        };
+
+        // the records of a domain, shared with the thread_local caches of
+        // the threads that use them, so that a thread that outlives the
+        // domain can still release its record.
+        struct record_list
+        {
+            atomic<record *> head{nullptr};
+            atomic<bool> closed{false};
+
+            record_list() = default;
+            record_list(record_list const &) = delete;
+            record_list & operator=(record_list const &) = delete;
+
+            ~record_list()
+            {
+                for (record * r = head.load(); r != nullptr; )
+                    delete std::exchange(r, r->next);
+            }
+
+            // a released record, or a new one if there is none.
+            record * acquire()
+            {
+                for (record * r = head.load(); r != nullptr; r = r->next)
+                {
+                    bool free = false;
+                    if (!r->in_use.load(std::memory_order_relaxed) &&
+                        r->in_use.compare_exchange_strong(free, true))
+                        return r;
+                }
+
+                auto * r = new record;
+                r->next = head.load();
+                while (!head.compare_exchange_weak(r->next, r))
+                    ;
+                return r;
+            }
+        };
+
+        // the records of the calling thread, by domain.
+        struct thread_records
+        {
+            struct entry
+            {
+                uint64_t domain;
+                shared_ptr<record_list> list;
+                record * r;
+            };
+
+            vector<entry> entries;
+
+            ~thread_records()
+            {
+                for (auto & e : entries)
+                    e.r->in_use.store(false, std::memory_order_release);
+            }
+        };
+
+    public:
+        // a pin of the domain, released on destruction.
+        class guard
+        {
+        public:
+            guard(guard && rhs) noexcept : r_(std::exchange(rhs.r_, nullptr)) {}
+
+            guard(guard const &) = delete;
+            guard & operator=(guard const &) = delete;
+            guard & operator=(guard &&) = delete;
+
+            ~guard()
+            {
+                if (r_ != nullptr && --r_->depth == 0)
+                    r_->epoch.store(0, std::memory_order_release);
+            }
+
+        private:
+            friend class epoch_domain;
+            explicit guard(record * r) : r_(r) {}
+
+            record * r_;
+        };
+
+        epoch_domain() : id_(next_id()), records_(std::make_shared<record_list>()) {}
+        epoch_domain(epoch_domain const &) = delete;
+        epoch_domain & operator=(epoch_domain const &) = delete;
+
+        // deletes the retired objects. there must be no readers.
+        ~epoch_domain()
+        {
+            records_->closed.store(true, std::memory_order_release);
+            for (auto & r : retired_)
+                r.second();
+        }
+
+        guard pin()
+        {
+            record * const r = local_record();
+            if (r->depth++ != 0)
+                return guard(r);
+
+            // the epoch may advance before the record is seen by a writer,
+            // so it is published until it is the current one.
+            uint64_t e = epoch_.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                r->epoch.store(e, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                uint64_t const now = epoch_.load(std::memory_order_relaxed);
+                if (now == e)
+                    return guard(r);
+                e = now;
+            }
+        }
+
+        // retires an object that readers can no longer reach, to be deleted
+        // by f.
+        void retire(std::function<void()> f)
+        {
+            std::lock_guard g(mutex_);
+            retired_.emplace_back(epoch_.fetch_add(1) + 1, std::move(f));
+        }
+
+        template <typename T>
+        void retire(T const * p)
+        {
+            retire([p] { delete p; });
+        }
+
+        // deletes the retired objects that no reader can hold. returns the
+        // number of objects deleted.
+        size_t reclaim()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            uint64_t oldest = UINT64_MAX;
+            for (record const * r = records_->head.load(); r != nullptr; r = r->next)
+            {
+                uint64_t e = r->epoch.load();
+                if (e != 0 && e < oldest)
+                    oldest = e;
+            }
+
+            vector<std::function<void()>> done;
+            {
+                std::lock_guard g(mutex_);
+                auto keep = retired_.begin();
+                for (auto & r : retired_)
+                {
+                    if (r.first <= oldest)
+                        done.push_back(std::move(r.second));
+                    else
+                        *keep++ = std::move(r);
+                }
+                retired_.erase(keep, retired_.end());
+            }
+            for (auto & f : done)
+                f();
+            return done.size();
+        }
+
+        // the number of objects waiting to be reclaimed.
+        size_t pending() const
+        {
+            std::lock_guard g(mutex_);
+            return retired_.size();
+        }
+
+    private:
+        static uint64_t next_id()
+        {
+            static atomic<uint64_t> id{0};
+            return ++id;
+        }
+
+        // the calling thread's record, claimed on its first pin. entries of
+        // destroyed domains are dropped when a record is claimed.
+        record * local_record()
+        {
+            thread_local thread_records local;
+            for (auto const & e : local.entries)
+                if (e.domain == id_)
+                    return e.r;
+
+            std::erase_if(local.entries, [](auto const & e)
+            {
+                if (!e.list->closed.load(std::memory_order_acquire))
+                    return false;
+                e.r->in_use.store(false, std::memory_order_release);
+                return true;
+            });
+            record * const r = records_->acquire();
+            local.entries.push_back({id_, records_, r});
+            return r;
+        }
+
+        // epoch 0 marks a record that is not pinned.
+        atomic<uint64_t> epoch_{1};
+        uint64_t const id_;
+        shared_ptr<record_list> records_;
+
+        mutable std::mutex mutex_;
+        vector<std::pair<uint64_t,std::function<void()>>> retired_;
+    };
+}
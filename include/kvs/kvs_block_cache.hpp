@@ -0,0 +1,158 @@
+#pragma once
+
+/**
+ * A size-bounded LRU cache of decompressed blocks, shared by the lookups of
+ * one or more block segments (see kvs_blocks.hpp).
+ *
+ * A block is identified by the id of its segment and its number in the
+ * segment. The cache is split into shards by the hash of the id, each with
+ * its own lock, LRU list and share of the memory budget, so that lookups in
+ * different threads rarely contend. A block that is in use is held by a
+ * shared_ptr, so evicting it only drops the cache's reference.
+ *
+ * The cache counts its hits and misses; hit_rate() is their ratio.
+ */
+
+#include <string>
+#include <list>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <optional>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+#include "../ahs/ahs_hash.hpp"
+
+using std::string;
+using std::list;
+using std::shared_ptr;
+using std::optional;
+using std::nullopt;
+using std::unordered_map;
+using std::uint64_t;
+
+namespace alex::kvs
+{
+    class block_cache
+    {
+    public:
+        using block = shared_ptr<string const>;
+
+        struct block_id
+        {
+            uint64_t segment;
+            uint64_t number;
+
+            bool operator==(block_id const &) const = default;
+        };
+
+        explicit block_cache(uint64_t capacity_bytes, size_t shards = 16) :
+            shards_(std::max<size_t>(shards, 1)),
+            shard_capacity_(capacity_bytes / std::max<size_t>(shards, 1)) {}
+
+        block_cache(block_cache const &) = delete;
+        block_cache & operator=(block_cache const &) = delete;
+
+        // a fresh id for a segment that shares the cache.
+        uint64_t new_segment_id()
+        {
+            return next_segment_++;
+        }
+
+        /**
+         * Returns the block id, calling load() to make it on a miss. load
+         * returns nullopt on failure, which is returned and not cached.
+         */
+        template <typename F>
+        optional<block> get(block_id id, F load)
+        {
+            auto & s = shard_of(id);
+            {
+                std::lock_guard g(s.mutex);
+                if (auto it = s.map.find(id); it != s.map.end())
+                {
+                    s.lru.splice(s.lru.begin(), s.lru, it->second);
+                    ++hits_;
+                    return it->second->second;
+                }
+            }
+
+            // decompress without holding the lock. two threads that miss the
+            // same block may both load it; the second insert is dropped.
+            ++misses_;
+            optional<string> data = load();
+            if (!data)
+                return nullopt;
+            block b = std::make_shared<string const>(std::move(*data));
+
+            std::lock_guard g(s.mutex);
+            if (s.map.find(id) != s.map.end() || b->size() > shard_capacity_)
+                return b;
+            s.lru.emplace_front(id, b);
+            s.map.emplace(id, s.lru.begin());
+            s.size += b->size();
+            while (s.size > shard_capacity_)
+            {
+                auto const & victim = s.lru.back();
+                s.size -= victim.second->size();
+                s.map.erase(victim.first);
+                s.lru.pop_back();
+            }
+            return b;
+        }
+
+        uint64_t hits() const { return hits_; }
+        uint64_t misses() const { return misses_; }
+
+        double hit_rate() const
+        {
+            uint64_t const h = hits_, m = misses_;
+            return h + m == 0 ? 0.0 : double(h) / double(h + m);
+        }
+
+        // the bytes of the cached blocks.
+        uint64_t size() const
+        {
+            uint64_t n = 0;
+            for (auto & s : shards_)
+            {
+                std::lock_guard g(s.mutex);
+                n += s.size;
+            }
+            return n;
+        }
+
+        uint64_t capacity() const { return shard_capacity_ * shards_.size(); }
+
+    private:
+        struct id_hash
+        {
+            size_t operator()(block_id const & id) const
+            {
+                return size_t(ahs::mix64(id.segment * 0x9e3779b97f4a7c15ULL ^ id.number));
+            }
+        };
+
+        struct shard
+        {
+            mutable std::mutex mutex;
+            list<std::pair<block_id,block>> lru;
+            unordered_map<block_id, list<std::pair<block_id,block>>::iterator, id_hash> map;
+            uint64_t size = 0;
+        };
+
+        shard & shard_of(block_id const & id)
+        {
+            return shards_[(id_hash{}(id) >> 32) % shards_.size()];
+        }
+
+        std::vector<shard> shards_;
+        uint64_t shard_capacity_;
+        std::atomic<uint64_t> next_segment_{0};
+        std::atomic<uint64_t> hits_{0}, misses_{0};
+    };
+}
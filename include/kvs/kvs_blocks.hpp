@@ -0,0 +1,363 @@
+#pragma once
+
+/**
+ * A block-compressed segment of a key-value store.
+ *
+ * The records of the segment are sorted by key and written in the
+ * key-value format, one "key<tab>value" line each, into blocks of about
+ * block_size (uncompressed) bytes, which are compressed with zlib. The
+ * block index gives the offset and sizes of each block and its first key,
+ * so the block of a key is found by a binary search of the first keys and
+ * a lookup reads and decompresses one block. Text values typically compress
+ * to a third or a quarter of their size, and so do the reads of a cold
+ * lookup.
+ *
+ * Decompressed blocks are kept in a block_cache (see kvs_block_cache.hpp),
+ * which may be shared by several segments.
+ *
+ * A segment is a read-only snapshot of a store, built from it with
+ * build_block_segment (kvs --build-blocks) and read on its own (kvs
+ * --blocks). The store itself (kvs_store.hpp) neither writes segments when
+ * it compacts nor reads them: its gets, sets and compactions use the text
+ * file, its log and its index, and a segment does not see writes made
+ * after it was built.
+ *
+ * The file format,
+ * ---
+ * block_header     (128 bytes)
+ * blocks           (zlib streams)
+ * block index      (block_count block_entry)
+ * first keys       (the first key of each block, concatenated)
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <zlib.h>
+#include "kvs_format.hpp"
+#include "kvs_block_cache.hpp"
+#include "../mapped_file.hpp"
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::shared_ptr;
+using std::optional;
+using std::nullopt;
+using std::uint64_t;
+using std::uint32_t;
+
+namespace alex::kvs
+{
+    struct block_header
+    {
+        static constexpr char const * magic_bytes() { return "KVSBLK\0"; }
+        static constexpr uint32_t current_version() { return 1; }
+
+        char magic[8];
+        uint32_t version;
+        uint32_t block_size;
+
+        uint64_t block_count;
+        uint64_t records;
+
+        // the total size of the blocks, uncompressed and compressed.
+        uint64_t raw_size;
+        uint64_t compressed_size;
+
+        uint64_t blocks_offset;
+        uint64_t index_offset;
+        uint64_t keys_offset;
+        uint64_t keys_size;
+        uint64_t reserved[6];
+
+        bool valid() const
+        {
+            return std::memcmp(magic, magic_bytes(), sizeof(magic)) == 0 &&
+                   version == current_version();
+        }
+    };
+
+    static_assert(sizeof(block_header) == 128);
+
+    struct block_entry
+    {
+        uint64_t offset;
+        uint32_t size;
+        uint32_t raw_size;
+        uint64_t key_offset;
+        uint32_t key_size;
+        uint32_t reserved;
+    };
+
+    static_assert(sizeof(block_entry) == 32);
+
+    class block_segment
+    {
+    public:
+        /**
+         * Opens the block segment filename, whose blocks are cached in cache.
+         * Returns nullopt if it is not a block segment. cache must outlive
+         * the segment.
+         */
+        static optional<block_segment> open(string const & filename, block_cache & cache)
+        {
+            mapped_file f;
+            if (!f.open(filename) || f.size() < sizeof(block_header))
+                return nullopt;
+
+            block_header h;
+            std::memcpy(&h, f.data(), sizeof(h));
+            if (!h.valid() ||
+                h.blocks_offset + h.compressed_size > f.size() ||
+                h.index_offset + h.block_count * sizeof(block_entry) > f.size() ||
+                h.keys_offset + h.keys_size > f.size())
+                return nullopt;
+
+            f.advise(MADV_RANDOM);
+            return block_segment(std::move(f), h, cache);
+        }
+
+        // the record of key, or nullopt if there is none. the record refers
+        // to block, which the caller keeps.
+        optional<record> find(string_view key, block_cache::block & block) const
+        {
+            auto i = block_of(key);
+            if (!i)
+                return nullopt;
+            auto b = load(*i);
+            if (!b)
+                return nullopt;
+            block = *b;
+            return find_in(**b, key);
+        }
+
+        optional<string> get(string_view key) const
+        {
+            block_cache::block b;
+            auto r = find(key, b);
+            return r ? optional<string>(r->value) : nullopt;
+        }
+
+        // the values of keys, in order. the keys are grouped by block, so
+        // that each block is looked up in the cache once.
+        vector<optional<string>> get(vector<string_view> const & keys) const
+        {
+            vector<std::pair<uint64_t,size_t>> order;
+            order.reserve(keys.size());
+            for (size_t i = 0; i < keys.size(); ++i)
+            {
+                if (auto b = block_of(keys[i]))
+                    order.emplace_back(*b, i);
+            }
+            std::sort(order.begin(), order.end());
+
+            vector<optional<string>> values(keys.size());
+            optional<block_cache::block> b;
+            for (size_t j = 0; j < order.size(); ++j)
+            {
+                if (j == 0 || order[j].first != order[j - 1].first)
+                    b = load(order[j].first);
+                if (!b)
+                    continue;
+                if (auto r = find_in(**b, keys[order[j].second]))
+                    values[order[j].second] = string(r->value);
+            }
+            return values;
+        }
+
+        // calls f(record) for each record, in the order of the keys.
+        template <typename F>
+        void for_each(F f) const
+        {
+            for (uint64_t i = 0; i < h_.block_count; ++i)
+            {
+                auto b = load(i);
+                if (!b)
+                    return;
+                for_each_record(**b, [&](record const & r, uint64_t) { f(r); });
+            }
+        }
+
+        block_header const & header() const { return h_; }
+
+    private:
+        block_segment(mapped_file f, block_header h, block_cache & cache) :
+            file_(std::make_shared<mapped_file>(std::move(f))), h_(h),
+            cache_(&cache), id_(cache.new_segment_id()) {}
+
+        block_entry entry(uint64_t i) const
+        {
+            block_entry e;
+            std::memcpy(&e, file_->data() + h_.index_offset + i * sizeof(block_entry), sizeof(e));
+            return e;
+        }
+
+        string_view first_key(uint64_t i) const
+        {
+            auto const e = entry(i);
+            if (e.key_offset + e.key_size > h_.keys_size)
+                return {};
+            return string_view(file_->data() + h_.keys_offset + e.key_offset, e.key_size);
+        }
+
+        // the block that would hold key: the last block whose first key is
+        // not greater than key.
+        optional<uint64_t> block_of(string_view key) const
+        {
+            uint64_t lo = 0, hi = h_.block_count;
+            while (lo < hi)
+            {
+                uint64_t mid = lo + (hi - lo) / 2;
+                if (first_key(mid) <= key)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            return lo == 0 ? nullopt : optional<uint64_t>(lo - 1);
+        }
+
+        optional<block_cache::block> load(uint64_t i) const
+        {
+            return cache_->get(block_cache::block_id{id_, i}, [&]() -> optional<string>
+            {
+                auto const e = entry(i);
+                if (e.offset + e.size > h_.compressed_size)
+                    return nullopt;
+
+                string raw(e.raw_size, '\0');
+                uLongf n = e.raw_size;
+                auto const * src = reinterpret_cast<Bytef const *>(
+                    file_->data() + h_.blocks_offset + e.offset);
+                if (::uncompress(reinterpret_cast<Bytef *>(raw.data()), &n, src, e.size) != Z_OK ||
+                    n != e.raw_size)
+                    return nullopt;
+                return raw;
+            });
+        }
+
+        // the record of key in a block. the lines are sorted, so the scan
+        // stops at the first greater key.
+        static optional<record> find_in(string_view block, string_view key)
+        {
+            optional<record> found;
+            char const * p = block.data();
+            char const * const end = p + block.size();
+            while (p < end)
+            {
+                auto const * nl = static_cast<char const *>(std::memchr(p, '\n', size_t(end - p)));
+                char const * e = nl ? nl : end;
+                auto r = parse_record(string_view(p, size_t(e - p)));
+                if (r && r->key >= key)
+                {
+                    if (r->key == key)
+                        found = r;
+                    break;
+                }
+                p = e + 1;
+            }
+            return found;
+        }
+
+        shared_ptr<mapped_file const> file_;
+        block_header h_;
+        block_cache * cache_;
+        uint64_t id_;
+    };
+
+    /**
+     * Writes the records to the block segment filename, in blocks of about
+     * block_size bytes compressed at zlib level (1-9). If a key occurs more
+     * than once, its first record is kept. Returns false on failure.
+     */
+    inline bool build_block_segment(
+        string const & filename,
+        vector<record> records,
+        uint32_t block_size = 32 << 10,
+        int level = 6)
+    {
+        std::stable_sort(records.begin(), records.end(),
+            [](record const & a, record const & b) { return a.key < b.key; });
+        records.erase(std::unique(records.begin(), records.end(),
+            [](record const & a, record const & b) { return a.key == b.key; }), records.end());
+
+        block_header h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, block_header::magic_bytes(), sizeof(h.magic));
+        h.version = block_header::current_version();
+        h.block_size = block_size;
+        h.records = records.size();
+        h.blocks_offset = sizeof(block_header);
+
+        string const tmp = filename + ".tmp";
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<char const *>(&h), sizeof(h));
+
+        // no failure leaves the temporary file behind.
+        auto fail = [&]
+        {
+            out.close();
+            std::remove(tmp.c_str());
+            return false;
+        };
+
+        vector<block_entry> entries;
+        string keys, raw, packed;
+        auto flush = [&](string_view first)
+        {
+            uLongf n = ::compressBound(uLong(raw.size()));
+            packed.resize(n);
+            if (::compress2(reinterpret_cast<Bytef *>(packed.data()), &n,
+                    reinterpret_cast<Bytef const *>(raw.data()), uLong(raw.size()), level) != Z_OK)
+                return false;
+
+            block_entry e{};
+            e.offset = h.compressed_size;
+            e.size = uint32_t(n);
+            e.raw_size = uint32_t(raw.size());
+            e.key_offset = keys.size();
+            e.key_size = uint32_t(first.size());
+            entries.push_back(e);
+            keys += first;
+
+            out.write(packed.data(), std::streamsize(n));
+            h.raw_size += raw.size();
+            h.compressed_size += n;
+            raw.clear();
+            return true;
+        };
+
+        string first;
+        for (auto const & r : records)
+        {
+            if (raw.empty())
+                first = r.key;
+            raw.append(r.key).append(1, '\t').append(r.value).append(1, '\n');
+            if (raw.size() >= block_size && !flush(first))
+                return fail();
+        }
+        if (!raw.empty() && !flush(first))
+            return fail();
+
+        h.block_count = entries.size();
+        h.index_offset = h.blocks_offset + h.compressed_size;
+        h.keys_offset = h.index_offset + entries.size() * sizeof(block_entry);
+        h.keys_size = keys.size();
+        out.write(reinterpret_cast<char const *>(entries.data()),
+            std::streamsize(entries.size() * sizeof(block_entry)));
+        out.write(keys.data(), std::streamsize(keys.size()));
+        out.seekp(0);
+        out.write(reinterpret_cast<char const *>(&h), sizeof(h));
+        out.close();
+        if (!out || std::rename(tmp.c_str(), filename.c_str()) != 0)
+            return fail();
+        return true;
+    }
+}
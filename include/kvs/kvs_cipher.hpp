@@ -0,0 +1,422 @@
+#pragma once
+
+/**
+ * A cipher key-value store: an immutable map from the trapdoors of keys to
+ * values, which stores neither the keys nor their trapdoors.
+ *
+ * The trapdoor of a key k under a secret s is the 64-bit keyed hash
+ *     t(k) = SipHash-2-4(trapdoor_key(s), k),
+ * where trapdoor_key(s) is a 128-bit key derived from s by SipHash under
+ * fixed keys (see cipher_tags/keyed_hash.hpp). SipHash is a pseudorandom
+ * function, so without s, a trapdoor cannot be computed for a key, and the
+ * store does not reveal which keys it maps (it is non-iterable).
+ *
+ * The store is a static function (a retrieval data structure) built with
+ * the layout and peeling of a binary fuse filter (see ahs/binary_fuse_filter.hpp):
+ * each trapdoor is mapped to three entries of a table of w-bit entries,
+ * whose xor is
+ *     (offset << r) | fingerprint(t),
+ * where offset is the position of the value in the value area and the
+ * fingerprint has r bits. The table has about 1.13 entries per key, and w
+ * is just wide enough for the offsets and the fingerprint, so the map costs
+ * about 1.13 (log2 V + r) bits per key plus the values themselves (V is the
+ * size of the value area). The keys are not stored at all.
+ *
+ * A lookup is one hash and three reads of the table (in three consecutive
+ * segments of it) followed by a read of the value. A key that is not in the
+ * map yields an entry with the wrong fingerprint, except with probability
+ * 2^-r, in which case it yields some other value.
+ *
+ * Each value is stored as its length (a varint) and its bytes, xor'ed with a
+ * keystream derived from its trapdoor, so a value may only be read given
+ * its key (and the secret).
+ *
+ * The file format,
+ * ---
+ * cipher_header    (128 bytes)
+ * table            (table_words little-endian 64-bit words)
+ * values           (values_size bytes)
+ *
+ * To reject a wrong secret, the header stores a check value: the
+ * pseudorandom function of a fixed label under another key derived from s
+ * (with another tweak), which reveals nothing of the trapdoor key. As for
+ * any key derived from a password, a weak secret may still be guessed by
+ * testing candidates against the check value.
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <bit>
+#include <cstdio>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include "kvs_format.hpp"
+#include "../mapped_file.hpp"
+#include "../ahs/ahs_hash.hpp"
+#include "../ahs/binary_fuse_filter.hpp"
+#include "../cipher_tags/keyed_hash.hpp"
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::optional;
+using std::nullopt;
+using std::uint64_t;
+using std::uint32_t;
+using std::uint8_t;
+
+namespace alex::kvs
+{
+    struct cipher_header
+    {
+        static constexpr char const * magic_bytes() { return "KVSCIPH"; }
+        static constexpr uint32_t current_version() { return 1; }
+
+        char magic[8];
+        uint32_t version;
+
+        // bits per table entry and bits of fingerprint per entry.
+        uint32_t width;
+        uint32_t fingerprint_bits;
+        uint32_t segment_length;
+        uint32_t segment_count;
+        uint32_t reserved0;
+
+        uint64_t seed;
+        uint64_t entries;
+
+        // secret_check of the secret, to reject a wrong one.
+        uint64_t secret_check;
+
+        uint64_t table_offset;
+        uint64_t table_words;
+        uint64_t values_offset;
+        uint64_t values_size;
+        uint64_t reserved[5];
+
+        bool valid() const
+        {
+            return std::memcmp(magic, magic_bytes(), sizeof(magic)) == 0 &&
+                   version == current_version() &&
+                   width >= fingerprint_bits && width >= 1 && width <= 64 &&
+                   segment_length != 0 && (segment_length & (segment_length - 1)) == 0;
+        }
+
+        ahs::binary_fuse_layout layout() const
+        {
+            return ahs::binary_fuse_layout{seed, segment_length, segment_count};
+        }
+    };
+
+    static_assert(sizeof(cipher_header) == 128);
+
+    // the tweaks of the keys derived from a secret.
+    constexpr uint64_t trapdoor_tweak = 1;
+    constexpr uint64_t check_tweak = 2;
+
+    // the trapdoor key of a secret, which keys the trapdoors of the keys.
+    inline cipher::siphash24 trapdoor_key(string_view secret)
+    {
+        return cipher::siphash24(secret, trapdoor_tweak);
+    }
+
+    inline uint64_t trapdoor(string_view key, cipher::siphash24 const & trapdoor_key)
+    {
+        return trapdoor_key(key);
+    }
+
+    // identifies the secret: a pseudorandom function of a fixed label under
+    // a key derived from the secret independently of its trapdoor key.
+    inline uint64_t secret_check(string_view secret)
+    {
+        return cipher::siphash24(secret, check_tweak)(string_view("alex::kvs cipher store"));
+    }
+
+    // xors the bytes of a value with the keystream of trapdoor t.
+    inline void apply_keystream(char * p, size_t n, uint64_t t)
+    {
+        for (size_t i = 0; i < n; i += 8)
+        {
+            uint64_t k = ahs::mix64(t + (i / 8 + 1) * 0x9e3779b97f4a7c15ULL);
+            for (size_t j = i; j < n && j < i + 8; ++j, k >>= 8)
+                p[j] ^= char(k & 0xff);
+        }
+    }
+
+    // a table of w-bit entries packed into 64-bit words.
+    struct packed_entries
+    {
+        uint64_t const * words;
+        uint32_t width;
+
+        uint64_t mask() const { return width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1; }
+
+        // the table has a word of padding at its end, so reading the word
+        // after an entry's first word is always safe.
+        uint64_t operator[](uint64_t i) const
+        {
+            uint64_t const bit = i * width;
+            uint64_t const w = bit / 64;
+            unsigned const s = unsigned(bit % 64);
+            uint64_t v = words[w] >> s;
+            if (s != 0)
+                v |= words[w + 1] << (64 - s);
+            return v & mask();
+        }
+
+        void prefetch(uint64_t i) const
+        {
+            __builtin_prefetch(words + i * width / 64);
+        }
+
+        static void set(vector<uint64_t> & words, uint32_t width, uint64_t i, uint64_t v)
+        {
+            uint64_t const bit = i * width;
+            uint64_t const w = bit / 64;
+            unsigned const s = unsigned(bit % 64);
+            uint64_t const m = packed_entries{nullptr, width}.mask();
+            words[w] = (words[w] & ~(m << s)) | (v << s);
+            if (s != 0 && s + width > 64)
+                words[w + 1] = (words[w + 1] & ~(m >> (64 - s))) | (v >> (64 - s));
+        }
+    };
+
+    class cipher_store
+    {
+    public:
+        /**
+         * Opens the cipher store file filename with the given secret.
+         * Returns nullopt if the file is not a cipher store or the secret is
+         * not the one it was built with.
+         */
+        static optional<cipher_store> open(string const & filename, string_view secret)
+        {
+            mapped_file f;
+            if (!f.open(filename) || f.size() < sizeof(cipher_header))
+                return nullopt;
+
+            cipher_header h;
+            std::memcpy(&h, f.data(), sizeof(h));
+            if (!h.valid() || h.secret_check != secret_check(secret))
+                return nullopt;
+            // the table, its word of padding included, and the values are in
+            // the file. written so that no field of a corrupt header
+            // overflows the arithmetic.
+            if (h.table_offset > f.size() || h.table_words > (f.size() - h.table_offset) / 8 ||
+                h.values_offset > f.size() || h.values_size > f.size() - h.values_offset ||
+                h.table_words == 0 ||
+                h.layout().array_length() > (h.table_words - 1) * 64 / h.width)
+                return nullopt;
+
+            f.advise(MADV_RANDOM);
+            return cipher_store(std::move(f), h, trapdoor_key(secret));
+        }
+
+        // the value of key, or nullopt if key is (most likely) not in the
+        // store.
+        optional<string> get(string_view key) const
+        {
+            uint64_t const t = trapdoor(key, key_);
+            uint64_t p[3];
+            h_.layout().positions(h_.layout().rehash(t), p);
+            return decode(t, table()[p[0]] ^ table()[p[1]] ^ table()[p[2]]);
+        }
+
+        // the values of keys, in order. the table entries of a group of keys
+        // are prefetched before any of them is read.
+        vector<optional<string>> get(vector<string_view> const & keys) const
+        {
+            constexpr size_t group = 16;
+            vector<optional<string>> values(keys.size());
+            uint64_t t[group], p[group][3];
+            auto const l = h_.layout();
+            auto const tab = table();
+            for (size_t i = 0; i < keys.size(); i += group)
+            {
+                size_t const m = std::min(group, keys.size() - i);
+                key_.hash_many(keys.data() + i, m, t);
+                for (size_t j = 0; j < m; ++j)
+                {
+                    l.positions(l.rehash(t[j]), p[j]);
+                    for (int k = 0; k < 3; ++k)
+                        tab.prefetch(p[j][k]);
+                }
+                for (size_t j = 0; j < m; ++j)
+                    values[i + j] = decode(t[j], tab[p[j][0]] ^ tab[p[j][1]] ^ tab[p[j][2]]);
+            }
+            return values;
+        }
+
+        uint64_t size() const { return h_.entries; }
+        cipher_header const & header() const { return h_; }
+
+    private:
+        cipher_store(mapped_file f, cipher_header h, cipher::siphash24 key) :
+            file_(std::make_shared<mapped_file>(std::move(f))), h_(h), key_(key) {}
+
+        packed_entries table() const
+        {
+            return packed_entries{
+                reinterpret_cast<uint64_t const *>(file_->data() + h_.table_offset), h_.width};
+        }
+
+        static uint64_t fingerprint(uint64_t t, uint32_t bits)
+        {
+            return bits == 0 ? 0 : (t >> 32 ^ t) & ((uint64_t(1) << bits) - 1);
+        }
+
+        optional<string> decode(uint64_t t, uint64_t entry) const
+        {
+            if ((entry ^ fingerprint(t, h_.fingerprint_bits)) & ((uint64_t(1) << h_.fingerprint_bits) - 1))
+                return nullopt;
+
+            uint64_t offset = entry >> h_.fingerprint_bits;
+            char const * const values = file_->data() + h_.values_offset;
+
+            // the length of the value, a varint.
+            uint64_t n = 0;
+            for (unsigned s = 0; ; s += 7)
+            {
+                if (offset >= h_.values_size || s > 63)
+                    return nullopt;
+                uint8_t const b = uint8_t(values[offset++]);
+                n |= uint64_t(b & 0x7f) << s;
+                if ((b & 0x80) == 0)
+                    break;
+            }
+            if (n > h_.values_size - offset)
+                return nullopt;
+
+            string v(values + offset, n);
+            apply_keystream(v.data(), v.size(), t);
+            return v;
+        }
+
+        std::shared_ptr<mapped_file const> file_;
+        cipher_header h_;
+        cipher::siphash24 key_;
+    };
+
+    /**
+     * Builds a cipher store of records under secret and writes it to
+     * filename. If a key occurs more than once, its first record is stored.
+     * fingerprint_bits trades the size of the store for the rate at which
+     * absent keys are mistaken for present ones. Returns false on failure.
+     */
+    inline bool build_cipher_store(
+        string const & filename,
+        vector<record> const & records,
+        string_view secret,
+        uint32_t fingerprint_bits = 16)
+    {
+        if (fingerprint_bits > 32)
+            return false;
+        auto const k = trapdoor_key(secret);
+
+        // the value area, and the trapdoor and offset of each distinct key.
+        string values;
+        vector<uint64_t> ts;
+        vector<uint64_t> offsets;
+        std::unordered_set<uint64_t> seen;
+        for (auto const & r : records)
+        {
+            uint64_t const t = trapdoor(r.key, k);
+            if (!seen.insert(t).second)
+                continue;
+            ts.push_back(t);
+            offsets.push_back(values.size());
+
+            for (uint64_t n = r.value.size(); ; n >>= 7)
+            {
+                values += char((n & 0x7f) | (n >= 0x80 ? 0x80 : 0));
+                if (n < 0x80)
+                    break;
+            }
+            size_t const at = values.size();
+            values += r.value;
+            apply_keystream(values.data() + at, r.value.size(), t);
+        }
+
+        uint32_t const offset_bits = uint32_t(std::bit_width(values.size()));
+        uint32_t const width = std::max<uint32_t>(1, offset_bits + fingerprint_bits);
+        if (width > 64)
+            return false;
+
+        for (uint64_t seed = 0; seed < 100; ++seed)
+        {
+            auto const l = ahs::binary_fuse_layout::for_size(ts.size(), ahs::mix64(seed + 1));
+
+            vector<uint64_t> hs(ts.size());
+            for (size_t i = 0; i < ts.size(); ++i)
+                hs[i] = l.rehash(ts[i]);
+
+            auto order = ahs::peel(l, hs);
+            if (!order)
+                continue;
+
+            // the entry of each rehashed trapdoor.
+            std::unordered_map<uint64_t,uint64_t> entry;
+            entry.reserve(ts.size());
+            for (size_t i = 0; i < ts.size(); ++i)
+            {
+                uint64_t const fp = fingerprint_bits == 0 ? 0 :
+                    (ts[i] >> 32 ^ ts[i]) & ((uint64_t(1) << fingerprint_bits) - 1);
+                entry[hs[i]] = offsets[i] << fingerprint_bits | fp;
+            }
+
+            vector<uint64_t> words((l.array_length() * width + 63) / 64 + 1, 0);
+            packed_entries const tab{words.data(), width};
+            uint64_t p[3];
+            for (auto const & [h, j] : *order)
+            {
+                l.positions(h, p);
+                uint64_t v = entry[h];
+                for (int i = 0; i < 3; ++i)
+                {
+                    if (i != j)
+                        v ^= tab[p[i]];
+                }
+                packed_entries::set(words, width, p[j], v);
+            }
+
+            cipher_header h;
+            std::memset(&h, 0, sizeof(h));
+            std::memcpy(h.magic, cipher_header::magic_bytes(), sizeof(h.magic));
+            h.version = cipher_header::current_version();
+            h.width = width;
+            h.fingerprint_bits = fingerprint_bits;
+            h.segment_length = l.segment_length;
+            h.segment_count = l.segment_count;
+            h.seed = l.seed;
+            h.entries = ts.size();
+            h.secret_check = secret_check(secret);
+            h.table_offset = sizeof(cipher_header);
+            h.table_words = words.size();
+            h.values_offset = h.table_offset + words.size() * 8;
+            h.values_size = values.size();
+
+            // no failure leaves the temporary file behind.
+            string const tmp = filename + ".tmp";
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<char const *>(&h), sizeof(h));
+            out.write(reinterpret_cast<char const *>(words.data()),
+                std::streamsize(words.size() * 8));
+            out.write(values.data(), std::streamsize(values.size()));
+            out.close();
+            if (!out || std::rename(tmp.c_str(), filename.c_str()) != 0)
+            {
+                std::remove(tmp.c_str());
+                return false;
+            }
+            return true;
+        }
+        return false;
+    }
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+/**
+ * The key-value file format,
+ * ---
+ * key1     value1
+ * key2     value2
+ *      .
+ *      .
+ *      .
+ * keyn     valuen
+ *
+ * i.e., one record per line, where the key is the first whitespace-delimited
+ * token of the line and the value is the rest of the line with surrounding
+ * whitespace removed. Blank lines are ignored.
+ *
+ * The functions here work on the bytes of a (memory-mapped) key-value file
+ * rather than on a stream, so that a record may be located by its offset
+ * and read without parsing the lines before it.
+ */
+
+#include <string_view>
+#include <cstring>
+#include <cstdint>
+#include <optional>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using std::string_view;
+using std::optional;
+using std::nullopt;
+using std::uint64_t;
+using std::size_t;
+
+namespace alex::kvs
+{
+    struct record
+    {
+        string_view key;
+        string_view value;
+    };
+
+    inline bool is_space(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+    }
+
+    // the position of the first whitespace character in [p, p + n), or n if
+    // there is none. tests 16 bytes at a time with SSE2.
+    inline size_t find_space(char const * p, size_t n)
+    {
+        size_t i = 0;
+#if defined(__SSE2__)
+        __m128i const space = _mm_set1_epi8(' ');
+        // '\t', '\n', '\v', '\f' and '\r' are 9 to 13: c - 9 < 5 (unsigned),
+        // which is a signed compare after biasing by -128.
+        __m128i const bias = _mm_set1_epi8(char(-128 - 9));
+        __m128i const limit = _mm_set1_epi8(char(-128 + 5));
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i c = _mm_loadu_si128(reinterpret_cast<__m128i const *>(p + i));
+            __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(c, space),
+                _mm_cmplt_epi8(_mm_add_epi8(c, bias), limit));
+            int m = _mm_movemask_epi8(ws);
+            if (m != 0)
+                return i + size_t(__builtin_ctz(unsigned(m)));
+        }
+#endif
+        for (; i < n; ++i)
+        {
+            if (is_space(p[i]))
+                return i;
+        }
+        return n;
+    }
+
+    // parses a line (without its newline) into a record. returns nullopt
+    // for a blank line.
+    inline optional<record> parse_record(string_view line)
+    {
+        size_t i = 0;
+        while (i < line.size() && is_space(line[i]))
+            ++i;
+        if (i == line.size())
+            return nullopt;
+
+        size_t j = i + find_space(line.data() + i, line.size() - i);
+        record r{line.substr(i, j - i), {}};
+
+        while (j < line.size() && is_space(line[j]))
+            ++j;
+        size_t k = line.size();
+        while (k > j && is_space(line[k - 1]))
+            --k;
+        r.value = line.substr(j, k - j);
+        return r;
+    }
+
+    // the line that starts at offset in data, without its newline.
+    inline string_view line_at(string_view data, uint64_t offset)
+    {
+        if (offset >= data.size())
+            return {};
+        auto const * p = data.data() + offset;
+        auto const * nl = static_cast<char const *>(std::memchr(p, '\n', data.size() - offset));
+        return string_view(p, nl ? size_t(nl - p) : data.size() - offset);
+    }
+
+    // calls f(line, offset) for each line in data. lines are found with
+    // memchr, which the C library implements with vector instructions.
+    template <typename F>
+    void for_each_line(string_view data, F f)
+    {
+        char const * const begin = data.data();
+        char const * const end = begin + data.size();
+        char const * p = begin;
+        while (p < end)
+        {
+            auto const * nl = static_cast<char const *>(std::memchr(p, '\n', size_t(end - p)));
+            char const * e = nl ? nl : end;
+            f(string_view(p, size_t(e - p)), uint64_t(p - begin));
+            p = e + 1;
+        }
+    }
+
+    // calls f(record, offset) for each record in data.
+    template <typename F>
+    void for_each_record(string_view data, F f)
+    {
+        for_each_line(data, [&](string_view line, uint64_t offset)
+        {
+            if (auto r = parse_record(line))
+                f(*r, offset);
+        });
+    }
+
+    // the first record with the given key, by a scan of data.
+    inline optional<record> scan_for(string_view data, string_view key)
+    {
+        char const * const end = data.data() + data.size();
+        char const * p = data.data();
+        while (p < end)
+        {
+            auto const * nl = static_cast<char const *>(std::memchr(p, '\n', size_t(end - p)));
+            char const * e = nl ? nl : end;
+            auto r = parse_record(string_view(p, size_t(e - p)));
+            if (r && r->key == key)
+                return r;
+            p = e + 1;
+        }
+        return nullopt;
+    }
+}
@@ -0,0 +1,294 @@
+#pragma once
+
+/**
+ * A parallel bulk loader of key-value files.
+ *
+ * import_file(input, data_file) replaces the key-value store data_file by
+ * the records of input: it writes the records, normalized to one
+ * "key<tab>value" line each, to data_file and builds its index (see
+ * kvs_index.hpp). Every phase is split across threads:
+ *
+ *  1. the input (memory-mapped) is split into chunks at line boundaries.
+ *     each thread parses a chunk (lines are found with memchr and keys with
+ *     find_space, both vectorized), hashes its keys and buckets the records
+ *     by the index partition of their hash;
+ *  2. a prefix sum of the normalized sizes of the chunks gives each chunk
+ *     its offset in the output, and each thread writes its chunk there
+ *     with pwrite;
+ *  3. each index partition, and the part of the Bloom filter that only its
+ *     keys map to, is built by one thread from the buckets of the chunks,
+ *     taken in the order of the chunks so that a repeated key keeps its
+ *     first occurrence.
+ *
+ * So loading costs two parses of the input, which are cheap next to
+ * reading it and writing the output and the index, and it is limited by
+ * the bandwidth of the disk rather than by a single thread.
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "kvs_format.hpp"
+#include "kvs_index.hpp"
+#include "kvs_lookup.hpp"
+#include "kvs_store.hpp"
+#include "../mapped_file.hpp"
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::thread;
+using std::atomic;
+using std::optional;
+using std::nullopt;
+using std::uint64_t;
+
+namespace alex::kvs
+{
+    struct import_stats
+    {
+        uint64_t records = 0;
+        uint64_t keys = 0;
+        uint64_t bytes_in = 0;
+        uint64_t bytes_out = 0;
+        double seconds = 0;
+    };
+
+    // called about once a second (and at the end of each phase) with the
+    // name of the phase and its progress.
+    using import_progress = std::function<void(string_view phase, uint64_t done, uint64_t total)>;
+
+    namespace detail
+    {
+        // runs f(i) for i in [0,n) on up to threads threads, while the
+        // calling thread reports done() out of total to progress.
+        template <typename F, typename D>
+        void run_parallel(size_t n, unsigned threads, F f, string_view phase,
+            D done, uint64_t total, import_progress const & progress)
+        {
+            atomic<size_t> next{0};
+            atomic<unsigned> running{threads};
+            vector<thread> ts;
+            for (unsigned t = 0; t < threads; ++t)
+            {
+                ts.emplace_back([&]
+                {
+                    for (size_t i; (i = next++) < n; )
+                        f(i);
+                    --running;
+                });
+            }
+
+            auto last = std::chrono::steady_clock::now();
+            while (running != 0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                auto now = std::chrono::steady_clock::now();
+                if (progress && now - last >= std::chrono::seconds(1))
+                {
+                    progress(phase, done(), total);
+                    last = now;
+                }
+            }
+            for (auto & t : ts)
+                t.join();
+            if (progress)
+                progress(phase, total, total);
+        }
+    }
+
+    /**
+     * Replaces the key-value store data_file (its base, index and log) by
+     * the records of the key-value file input, using up to threads threads
+     * (0 for one per core). Returns nullopt on failure.
+     */
+    inline optional<import_stats> import_file(
+        string const & input,
+        string const & data_file,
+        unsigned threads = 0,
+        import_progress const & progress = {},
+        uint64_t seed = 0)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        if (threads == 0)
+            threads = std::max(1u, thread::hardware_concurrency());
+
+        mapped_file in;
+        if (!in.open(input))
+            return nullopt;
+        in.advise(MADV_SEQUENTIAL);
+        string_view const data(in.data(), in.size());
+
+        // several chunks per thread, so that threads that finish early
+        // take on more.
+        auto const chunks = split_lines(data, size_t(threads) * 4);
+        uint64_t const partitions = std::bit_ceil(uint64_t(threads) * 4);
+
+        // 1. parse.
+        vector<vector<vector<index_slot>>> buckets(chunks.size());
+        vector<uint64_t> out_size(chunks.size(), 0);
+        atomic<uint64_t> parsed{0};
+        detail::run_parallel(chunks.size(), threads, [&](size_t c)
+        {
+            auto & b = buckets[c];
+            b.resize(partitions);
+            uint64_t pos = 0;
+            for_each_record(chunks[c], [&](record const & r, uint64_t)
+            {
+                uint64_t const h = key_hash(r.key, seed);
+                b[ahs::reduce(h, partitions)].push_back(index_slot{h, pos});
+                pos += r.key.size() + r.value.size() + 2;
+            });
+            out_size[c] = pos;
+            parsed += chunks[c].size();
+        }, "parse", [&] { return parsed.load(); }, data.size(), progress);
+
+        // 2. write.
+        vector<uint64_t> base(chunks.size() + 1, 0);
+        for (size_t c = 0; c < chunks.size(); ++c)
+            base[c + 1] = base[c] + out_size[c];
+        uint64_t const total = base.back();
+
+        // a name of its own, so that concurrent imports of the same store
+        // do not write to the same file.
+        string tmp = data_file + ".import.XXXXXX";
+        int fd = ::mkstemp(tmp.data());
+        if (fd < 0)
+            return nullopt;
+        if (::fchmod(fd, 0644) != 0 || ::ftruncate(fd, off_t(total)) != 0)
+        {
+            ::close(fd);
+            std::remove(tmp.c_str());
+            return nullopt;
+        }
+
+        atomic<uint64_t> written{0};
+        atomic<bool> failed{false};
+        detail::run_parallel(chunks.size(), threads, [&](size_t c)
+        {
+            constexpr size_t buffer_size = size_t(1) << 20;
+            string buf;
+            buf.reserve(buffer_size + 4096);
+            uint64_t at = base[c];
+            auto flush = [&]
+            {
+                for (size_t done = 0; done < buf.size(); )
+                {
+                    auto n = ::pwrite(fd, buf.data() + done, buf.size() - done, off_t(at + done));
+                    if (n <= 0)
+                    {
+                        failed = true;
+                        return;
+                    }
+                    done += size_t(n);
+                }
+                at += buf.size();
+                written += buf.size();
+                buf.clear();
+            };
+            for_each_record(chunks[c], [&](record const & r, uint64_t)
+            {
+                buf.append(r.key).append(1, '\t').append(r.value).append(1, '\n');
+                if (buf.size() >= buffer_size)
+                    flush();
+            });
+            flush();
+        }, "write", [&] { return written.load(); }, total, progress);
+        in.close();
+
+        if (::close(fd) != 0 || failed)
+        {
+            std::remove(tmp.c_str());
+            return nullopt;
+        }
+
+        // 3. index. the partition of a hash, reduce(h, partitions), is also
+        // the partition of its home slot and, since the Bloom filter has a
+        // multiple of partitions blocks, of its block of the Bloom filter.
+        mapped_file out(tmp);
+        string_view const out_data(out.data(), out.size());
+        uint64_t records = 0;
+        for (auto const & b : buckets)
+            for (auto const & p : b)
+                records += p.size();
+
+        auto const l = index_layout::for_size(records, partitions);
+        vector<index_slot> table(l.slot_count, index_slot{0, 0});
+        auto const sized = ahs::blocked_bloom_filter::for_fpr(records, 0.01);
+        ahs::blocked_bloom_filter bloom(
+            (sized.block_count() + partitions - 1) / partitions * partitions, sized.k());
+
+        atomic<uint64_t> keys{0}, indexed{0};
+        detail::run_parallel(partitions, threads, [&](size_t p)
+        {
+            uint64_t n = 0;
+            for (size_t c = 0; c < buckets.size(); ++c)
+            {
+                for (auto e : buckets[c][p])
+                {
+                    e.offset += base[c];
+                    if (insert_slot(table.data(), l, out_data, e))
+                    {
+                        bloom.insert(e.hash);
+                        ++n;
+                    }
+                }
+                indexed += buckets[c][p].size();
+                vector<index_slot>().swap(buckets[c][p]);
+            }
+            keys += n;
+        }, "index", [&] { return indexed.load(); }, records, progress);
+
+        auto stamp = file_stamp(tmp);
+        if (!stamp || !write_index(tmp, *stamp, seed, keys, l, bloom, table))
+        {
+            std::remove(tmp.c_str());
+            return nullopt;
+        }
+
+        // replace the store, and discard its log, while no writer is
+        // appending to it. without the lock, a writer could append to the
+        // log after it is discarded, so the import fails instead.
+        int lock_fd = ::open(lock_filename(data_file).c_str(), O_RDWR | O_CREAT, 0644);
+        bool ok = false;
+        if (lock_fd >= 0)
+        {
+            file_lock lock(lock_fd, LOCK_EX);
+            if (lock.held() && std::rename(tmp.c_str(), data_file.c_str()) == 0)
+            {
+                std::remove(log_filename(data_file).c_str());
+                ok = std::rename(index_filename(tmp).c_str(), index_filename(data_file).c_str()) == 0;
+            }
+        }
+        if (lock_fd >= 0)
+            ::close(lock_fd);
+        if (!ok)
+        {
+            std::remove(tmp.c_str());
+            std::remove(index_filename(tmp).c_str());
+            return nullopt;
+        }
+
+        import_stats s;
+        s.records = records;
+        s.keys = keys;
+        s.bytes_in = data.size();
+        s.bytes_out = total;
+        s.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return s;
+    }
+}
@@ -0,0 +1,335 @@
+#pragma once
+
+/**
+ * An immutable on-disk hash index of a key-value file.
+ *
+ * The index of the key-value file "f" is the file "f.idx":
+ * ---
+ * index_header (128 bytes)
+ * Bloom filter (bloom_blocks cache lines)
+ * hash table   (slot_count slots of 16 bytes)
+ *
+ * The hash table is open-addressed with linear probing. A slot holds the
+ * 64-bit hash of a key (0 marks an empty slot) and the offset of the key's
+ * line in the key-value file. Since the hash is only a fingerprint of the
+ * key, a hit is confirmed by comparing the key on that line.
+ *
+ * The Bloom filter (a blocked Bloom filter, the same as an AHS "bloom"
+ * backend) answers most lookups of absent keys from a single cache line,
+ * without probing the table. So, with the index mapped into memory, a
+ * lookup touches a page of the filter, a page of the table and the line in
+ * the key-value file.
+ *
+ * The table is split into 2^p partitions of equal size. A key's partition
+ * is given by its home slot, and its probe sequence wraps around within the
+ * partition, so partitions may be built independently (e.g., in parallel).
+ *
+ * The header records the size and modification time of the key-value file
+ * the index was built from; an index of a different file is stale and is
+ * not used.
+ *
+ * If a key occurs on more than one line, the index refers to its first
+ * occurrence, as does a scan of the file.
+ */
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <optional>
+#include <fstream>
+#include <algorithm>
+#include <bit>
+#include <sys/stat.h>
+#include "kvs_format.hpp"
+#include "../mapped_file.hpp"
+#include "../ahs/ahs_hash.hpp"
+#include "../ahs/blocked_bloom.hpp"
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::optional;
+using std::nullopt;
+using std::ofstream;
+using std::uint64_t;
+using std::uint32_t;
+using std::int64_t;
+
+namespace alex::kvs
+{
+    struct index_header
+    {
+        static constexpr char const * magic_bytes() { return "KVSIDX\0"; }
+        static constexpr uint32_t current_version() { return 1; }
+
+        char magic[8];
+        uint32_t version;
+        uint32_t bloom_k;
+
+        // the key-value file this index was built from.
+        uint64_t data_size;
+        int64_t data_mtime_ns;
+
+        uint64_t seed;
+        uint64_t entries;
+        uint64_t slot_count;
+        uint64_t partitions;
+        uint64_t bloom_blocks;
+        uint64_t bloom_offset;
+        uint64_t table_offset;
+        uint64_t reserved[5];
+
+        bool valid() const
+        {
+            return std::memcmp(magic, magic_bytes(), sizeof(magic)) == 0 &&
+                   version == current_version();
+        }
+    };
+
+    static_assert(sizeof(index_header) == 128);
+
+    struct index_slot
+    {
+        uint64_t hash;
+        uint64_t offset;
+    };
+
+    inline string index_filename(string const & data_file)
+    {
+        return data_file + ".idx";
+    }
+
+    // the size and modification time of a file, or nullopt if it does not
+    // exist.
+    inline optional<std::pair<uint64_t,int64_t>> file_stamp(string const & filename)
+    {
+        struct stat st;
+        if (::stat(filename.c_str(), &st) != 0)
+            return nullopt;
+        return std::make_pair(uint64_t(st.st_size),
+            int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec);
+    }
+
+    // the hash of a key in the index. never 0, which marks an empty slot.
+    inline uint64_t key_hash(string_view key, uint64_t seed)
+    {
+        uint64_t h = ahs::hash_bytes(key, seed);
+        return h == 0 ? 1 : h;
+    }
+
+    struct index_layout
+    {
+        uint64_t slot_count;
+        uint64_t partitions;
+
+        uint64_t partition_slots() const { return slot_count / partitions; }
+
+        uint64_t home(uint64_t h) const { return ahs::reduce(h, slot_count); }
+
+        uint64_t partition_of(uint64_t h) const { return home(h) / partition_slots(); }
+
+        // the next slot of a probe sequence, wrapping around in the partition.
+        uint64_t next(uint64_t s) const
+        {
+            uint64_t const n = partition_slots();
+            return (s + 1) % n == 0 ? s + 1 - n : s + 1;
+        }
+
+        // a table with at most half of its slots in use.
+        static index_layout for_size(uint64_t entries, uint64_t partitions = 1)
+        {
+            uint64_t per = std::bit_ceil(std::max<uint64_t>(2 * entries / partitions + 1, 8));
+            return index_layout{per * partitions, partitions};
+        }
+    };
+
+    class index
+    {
+    public:
+        // opens the index of data, the mapped bytes of the key-value file
+        // data_file. returns nullopt if there is no index or it is stale.
+        // data must outlive the index.
+        static optional<index> open(string const & data_file, string_view data)
+        {
+            mapped_file f;
+            if (!f.open(index_filename(data_file)) || f.size() < sizeof(index_header))
+                return nullopt;
+
+            index_header h;
+            std::memcpy(&h, f.data(), sizeof(h));
+            if (!h.valid())
+                return nullopt;
+
+            auto stamp = file_stamp(data_file);
+            if (!stamp || stamp->first != h.data_size || stamp->second != h.data_mtime_ns ||
+                h.data_size != data.size())
+                return nullopt;
+
+            // the table and the filter are non-empty and in the file,
+            // checked so that a corrupt offset or count cannot overflow.
+            if (h.slot_count == 0 || h.bloom_blocks == 0 ||
+                h.table_offset > f.size() ||
+                h.slot_count > (f.size() - h.table_offset) / sizeof(index_slot) ||
+                h.bloom_offset > f.size() || h.bloom_blocks > (f.size() - h.bloom_offset) / 64 ||
+                h.partitions == 0 || h.slot_count % h.partitions != 0)
+                return nullopt;
+
+            f.advise(MADV_RANDOM);
+            return index(std::move(f), h, data);
+        }
+
+        // the line of key in the key-value file, or nullopt if key is not in
+        // the file.
+        optional<string_view> find(string_view key) const
+        {
+            return find(key, key_hash(key, h_.seed));
+        }
+
+        optional<string_view> find(string_view key, uint64_t h) const
+        {
+            if (!bloom().contains(h))
+                return nullopt;
+
+            auto const l = layout();
+            for (uint64_t s = l.home(h); ; s = l.next(s))
+            {
+                index_slot const & slot = table()[s];
+                if (slot.hash == 0)
+                    return nullopt;
+                if (slot.hash == h)
+                {
+                    auto line = line_at(data_, slot.offset);
+                    auto r = parse_record(line);
+                    if (r && r->key == key)
+                        return line;
+                }
+            }
+        }
+
+        uint64_t size() const { return h_.entries; }
+        index_header const & header() const { return h_; }
+
+    private:
+        index(mapped_file f, index_header h, string_view data) :
+            file_(std::make_shared<mapped_file>(std::move(f))), h_(h), data_(data) {}
+
+        ahs::blocked_bloom_view bloom() const
+        {
+            return ahs::blocked_bloom_view{
+                reinterpret_cast<uint64_t const *>(file_->data() + h_.bloom_offset),
+                h_.bloom_blocks, h_.bloom_k};
+        }
+
+        index_slot const * table() const
+        {
+            return reinterpret_cast<index_slot const *>(file_->data() + h_.table_offset);
+        }
+
+        index_layout layout() const { return index_layout{h_.slot_count, h_.partitions}; }
+
+        std::shared_ptr<mapped_file const> file_;
+        index_header h_;
+        string_view data_;
+    };
+
+    // inserts the slot e of a line of data into table, unless the table
+    // has its key: a repeated key keeps the slot of its first occurrence.
+    // returns whether e was inserted.
+    inline bool insert_slot(index_slot * table, index_layout const & l, string_view data, index_slot e)
+    {
+        uint64_t s = l.home(e.hash);
+        for (; table[s].hash != 0; s = l.next(s))
+        {
+            if (table[s].hash == e.hash &&
+                parse_record(line_at(data, table[s].offset))->key ==
+                parse_record(line_at(data, e.offset))->key)
+                return false;
+        }
+        table[s] = e;
+        return true;
+    }
+
+    /**
+     * Writes the index of the key-value file data_file, whose size and
+     * modification time are stamp, given its table and Bloom filter.
+     * Returns false on failure.
+     */
+    inline bool write_index(
+        string const & data_file,
+        std::pair<uint64_t,int64_t> stamp,
+        uint64_t seed,
+        uint64_t n,
+        index_layout const & l,
+        ahs::blocked_bloom_filter const & bloom,
+        vector<index_slot> const & table)
+    {
+        index_header h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, index_header::magic_bytes(), sizeof(h.magic));
+        h.version = index_header::current_version();
+        h.data_size = stamp.first;
+        h.data_mtime_ns = stamp.second;
+        h.seed = seed;
+        h.entries = n;
+        h.slot_count = l.slot_count;
+        h.partitions = l.partitions;
+        h.bloom_blocks = bloom.block_count();
+        h.bloom_k = bloom.k();
+        h.bloom_offset = sizeof(index_header);
+        h.table_offset = h.bloom_offset + bloom.bits().size() * sizeof(uint64_t);
+
+        // write to a temporary file and rename it, so that readers never see
+        // a partially written index. no failure leaves the temporary file
+        // behind.
+        string const tmp = index_filename(data_file) + ".tmp";
+        ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<char const *>(&h), sizeof(h));
+        out.write(reinterpret_cast<char const *>(bloom.bits().data()),
+            std::streamsize(bloom.bits().size() * sizeof(uint64_t)));
+        out.write(reinterpret_cast<char const *>(table.data()),
+            std::streamsize(table.size() * sizeof(index_slot)));
+        out.close();
+        if (!out || std::rename(tmp.c_str(), index_filename(data_file).c_str()) != 0)
+        {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Builds the index of the key-value file data_file, whose bytes are
+     * data, and writes it to data_file.idx. Returns false on failure.
+     */
+    inline bool build_index(string const & data_file, string_view data, uint64_t seed = 0)
+    {
+        auto stamp = file_stamp(data_file);
+        if (!stamp)
+            return false;
+
+        vector<index_slot> entries;
+        for_each_record(data, [&](record const & r, uint64_t offset)
+        {
+            entries.push_back(index_slot{key_hash(r.key, seed), offset});
+        });
+
+        auto const l = index_layout::for_size(entries.size());
+        vector<index_slot> table(l.slot_count, index_slot{0, 0});
+        auto bloom = ahs::blocked_bloom_filter::for_fpr(entries.size(), 0.01);
+        uint64_t n = 0;
+        for (auto const & e : entries)
+        {
+            if (insert_slot(table.data(), l, data, e))
+            {
+                bloom.insert(e.hash);
+                ++n;
+            }
+        }
+
+        return write_index(data_file, *stamp, seed, n, l, bloom, table);
+    }
+}
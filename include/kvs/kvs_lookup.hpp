@@ -0,0 +1,156 @@
+#pragma once
+
+/**
+ * Batched lookups of many keys in a key-value file.
+ *
+ * lookup(data, keys) returns, for each key in keys (in the same order), the
+ * line of its first occurrence in data, or nullopt if it does not occur.
+ *
+ * The requested keys are put in one hash table. Then, if the key-value file
+ * has an index, each distinct key is probed in the index. Otherwise, the
+ * file is scanned once: lines are split with memchr (vectorized by the C
+ * library) and the key of each line is looked up in the hash table. Large
+ * files are split at line boundaries into chunks that are scanned by
+ * separate threads; the first occurrence of a key is the one with the
+ * smallest offset over all of the chunks.
+ *
+ * A lookup of m keys in a file of n lines thus costs O(n + m) with a scan
+ * and O(m) with an index.
+ */
+
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <optional>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include "kvs_format.hpp"
+#include "kvs_index.hpp"
+
+using std::string_view;
+using std::vector;
+using std::thread;
+using std::optional;
+using std::nullopt;
+using std::unordered_map;
+using std::uint64_t;
+using std::uint32_t;
+
+namespace alex::kvs
+{
+    // splits data into at most n chunks of about the same size that begin
+    // and end at line boundaries.
+    inline vector<string_view> split_lines(string_view data, size_t n)
+    {
+        vector<string_view> chunks;
+        size_t begin = 0;
+        for (size_t i = 1; i <= n && begin < data.size(); ++i)
+        {
+            size_t end = i == n ? data.size() : std::max(begin, data.size() * i / n);
+            if (end < data.size())
+            {
+                auto const * nl = static_cast<char const *>(
+                    std::memchr(data.data() + end, '\n', data.size() - end));
+                end = nl ? size_t(nl - data.data()) + 1 : data.size();
+            }
+            if (end > begin)
+                chunks.push_back(data.substr(begin, end - begin));
+            begin = end;
+        }
+        return chunks;
+    }
+
+    // the first token of a line, i.e., the key of its record.
+    inline string_view key_of(string_view line)
+    {
+        size_t i = 0;
+        while (i < line.size() && is_space(line[i]))
+            ++i;
+        size_t j = i;
+        while (j < line.size() && !is_space(line[j]))
+            ++j;
+        return line.substr(i, j - i);
+    }
+
+    /**
+     * The line of the first occurrence of each key in data, in the order of
+     * keys. idx, if not null, is the index of data. A scan of data uses up
+     * to threads threads (0 to choose by the size of data).
+     */
+    inline vector<optional<string_view>> lookup(
+        string_view data,
+        vector<string_view> const & keys,
+        index const * idx = nullptr,
+        unsigned threads = 0)
+    {
+        unordered_map<string_view, uint32_t> ids;
+        ids.reserve(keys.size());
+        vector<uint32_t> request_id(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i)
+            request_id[i] = ids.emplace(keys[i], uint32_t(ids.size())).first->second;
+
+        constexpr uint64_t none = UINT64_MAX;
+        vector<uint64_t> first(ids.size(), none);
+
+        if (idx != nullptr)
+        {
+            for (auto const & [k, id] : ids)
+            {
+                if (auto line = idx->find(k))
+                    first[id] = uint64_t(line->data() - data.data());
+            }
+        }
+        else if (!ids.empty())
+        {
+            if (threads == 0)
+            {
+                constexpr size_t bytes_per_thread = size_t(64) << 20;
+                threads = static_cast<unsigned>(std::clamp<size_t>(
+                    data.size() / bytes_per_thread, 1, std::max(1u, thread::hardware_concurrency())));
+            }
+
+            auto chunks = split_lines(data, threads);
+            vector<vector<uint64_t>> found(chunks.size());
+            auto scan = [&](size_t c)
+            {
+                auto & f = found[c];
+                f.assign(ids.size(), none);
+                uint64_t const base = uint64_t(chunks[c].data() - data.data());
+                for_each_line(chunks[c], [&](string_view line, uint64_t offset)
+                {
+                    auto k = key_of(line);
+                    if (k.empty())
+                        return;
+                    auto it = ids.find(k);
+                    if (it != ids.end() && f[it->second] == none)
+                        f[it->second] = base + offset;
+                });
+            };
+
+            if (chunks.size() == 1)
+                scan(0);
+            else
+            {
+                vector<thread> ts;
+                for (size_t c = 0; c < chunks.size(); ++c)
+                    ts.emplace_back(scan, c);
+                for (auto & t : ts)
+                    t.join();
+            }
+
+            for (auto const & f : found)
+                for (size_t i = 0; i < f.size(); ++i)
+                    first[i] = std::min(first[i], f[i]);
+        }
+
+        vector<optional<string_view>> lines(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            if (first[request_id[i]] != none)
+                lines[i] = line_at(data, first[request_id[i]]);
+        }
+        return lines;
+    }
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+/**
+ * An immutable version of a key-value store.
+ *
+ * A snapshot is a base segment (a memory-mapped key-value file and its
+ * index) and a stack of deltas, each the writes of one or more batches. A
+ * lookup tries the deltas from newest to oldest and then the base. Values
+ * are views of the segment or the deltas, valid as long as the snapshot.
+ *
+ * A snapshot is never modified: with(d) returns a new snapshot that shares
+ * the base and deltas of this one and has d on top. To keep the stack short,
+ * d is first merged with the deltas below it that are no larger than it, as
+ * in a binary counter, so there are O(log n) deltas for n writes and each
+ * write is copied O(log n) times.
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <cerrno>
+#include "kvs_format.hpp"
+#include "kvs_index.hpp"
+#include "kvs_lookup.hpp"
+#include "../mapped_file.hpp"
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::shared_ptr;
+using std::optional;
+using std::nullopt;
+using std::unordered_map;
+using std::unordered_set;
+
+namespace alex::kvs
+{
+    // hashes and compares strings and string_views alike, so that a delta
+    // may be searched without copying the key.
+    struct string_hash
+    {
+        using is_transparent = void;
+        size_t operator()(string_view s) const { return std::hash<string_view>{}(s); }
+    };
+
+    // keys written, mapped to their values (or nullopt if deleted).
+    using delta = unordered_map<string, optional<string>, string_hash, std::equal_to<>>;
+
+    // a key-value file, mapped into memory, and its index.
+    struct segment
+    {
+        mapped_file file;
+        optional<index> idx;
+
+        segment() = default;
+        segment(segment const &) = delete;
+        segment & operator=(segment const &) = delete;
+
+        // opens the key-value file data_file; a missing file is empty.
+        // returns nullptr if it cannot be read.
+        static shared_ptr<segment> open(string const & data_file)
+        {
+            auto s = std::make_shared<segment>();
+            if (!s->file.open(data_file) && errno != ENOENT)
+                return nullptr;
+            s->idx = index::open(data_file, s->bytes());
+            return s;
+        }
+
+        string_view bytes() const { return string_view(file.data(), file.size()); }
+    };
+
+    class snapshot
+    {
+    public:
+        snapshot(shared_ptr<segment const> base, vector<shared_ptr<delta const>> deltas = {}) :
+            base_(std::move(base)), deltas_(std::move(deltas)) {}
+
+        // the value of key, or nullopt if there is none.
+        optional<string_view> get(string_view key) const
+        {
+            for (auto d = deltas_.rbegin(); d != deltas_.rend(); ++d)
+            {
+                if (auto it = (*d)->find(key); it != (*d)->end())
+                    return it->second ? optional<string_view>(*it->second) : nullopt;
+            }
+
+            optional<record> r;
+            if (base_->idx)
+            {
+                if (auto line = base_->idx->find(key))
+                    r = parse_record(*line);
+            }
+            else
+                r = scan_for(base_->bytes(), key);
+            return r ? optional<string_view>(r->value) : nullopt;
+        }
+
+        // the values of keys, in order; see kvs_lookup.hpp.
+        vector<optional<string_view>> get(vector<string_view> const & keys, unsigned threads = 0) const
+        {
+            auto lines = lookup(base_->bytes(), keys, base_->idx ? &*base_->idx : nullptr, threads);
+
+            vector<optional<string_view>> values(keys.size());
+            for (size_t i = 0; i < keys.size(); ++i)
+            {
+                bool found = false;
+                for (auto d = deltas_.rbegin(); d != deltas_.rend() && !found; ++d)
+                {
+                    if (auto it = (*d)->find(keys[i]); it != (*d)->end())
+                    {
+                        found = true;
+                        if (it->second)
+                            values[i] = *it->second;
+                    }
+                }
+                if (!found && lines[i])
+                    values[i] = parse_record(*lines[i])->value;
+            }
+            return values;
+        }
+
+        // calls f(record) for each record of the base that has not been
+        // written since, and then for each key set by the deltas.
+        template <typename F>
+        void for_each(F f) const
+        {
+            unordered_set<string_view> written;
+            for (auto const & d : deltas_)
+            {
+                for (auto const & kv : *d)
+                    written.insert(kv.first);
+            }
+
+            for_each_record(base_->bytes(), [&](record const & r, uint64_t)
+            {
+                if (written.find(r.key) == written.end())
+                    f(r);
+            });
+
+            unordered_set<string_view> seen;
+            for (auto d = deltas_.rbegin(); d != deltas_.rend(); ++d)
+            {
+                for (auto const & [k, v] : **d)
+                {
+                    if (seen.insert(k).second && v)
+                        f(record{k, *v});
+                }
+            }
+        }
+
+        // this snapshot with the writes of d on top.
+        snapshot with(delta d) const
+        {
+            auto deltas = deltas_;
+            while (!deltas.empty() && deltas.back()->size() <= d.size())
+            {
+                // d is newer, so it keeps its values.
+                for (auto const & kv : *deltas.back())
+                    d.insert(kv);
+                deltas.pop_back();
+            }
+            deltas.push_back(std::make_shared<delta const>(std::move(d)));
+            return snapshot(base_, std::move(deltas));
+        }
+
+        segment const & base() const { return *base_; }
+        size_t delta_count() const { return deltas_.size(); }
+
+    private:
+        shared_ptr<segment const> base_;
+        vector<shared_ptr<delta const>> deltas_;
+    };
+}
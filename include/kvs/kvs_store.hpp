@@ -0,0 +1,602 @@
+#pragma once
+
+/**
+ * A writable key-value store: a key-value file (the base) and a log of the
+ * writes made since the base was last compacted.
+ *
+ * The log of the key-value file "f" is the file "f.log", one write per line:
+ * ---
+ * +key value       (sets key to value)
+ * -key             (deletes key)
+ *
+ * A write appends to the log and adds its keys to in-memory hash tables of
+ * the keys written by the log, so it costs O(1) (amortized) and never
+ * rewrites the base. A lookup consults those tables and then the base (by
+ * its index, if it has one; see kvs_index.hpp). Opening a store replays its
+ * log.
+ *
+ * Compaction merges the base and the log into a new base, sorted by key,
+ * and builds its index. It runs alongside writers (in this process or in
+ * others), which only wait for it while it renames the new files into
+ * place: writers hold a shared flock on "f.lock" and that last step holds
+ * it exclusively. The writes that were appended to the log while the new
+ * base was written are kept in the new log. Since replaying a write twice
+ * has no effect, a crash between the renames loses nothing.
+ *
+ * Readers never lock. The store publishes its contents as an immutable
+ * snapshot (see kvs_snapshot.hpp) through an atomic pointer; a reader pins
+ * the store's epoch domain (see epoch.hpp), loads the pointer and reads the
+ * snapshot. A write, a compaction or a reload builds the next snapshot and
+ * swaps the pointer, and the previous snapshot is deleted once no reader
+ * holds it. So reads run at the same speed during bulk updates, and a read
+ * sees either all or none of a batch.
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <utility>
+#include <optional>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "kvs_format.hpp"
+#include "kvs_index.hpp"
+#include "kvs_lookup.hpp"
+#include "kvs_snapshot.hpp"
+#include "../mapped_file.hpp"
+#include "../epoch.hpp"
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::unique_ptr;
+using std::optional;
+using std::nullopt;
+using std::pair;
+using std::unordered_map;
+using std::uint64_t;
+
+namespace alex::kvs
+{
+    inline string log_filename(string const & data_file)
+    {
+        return data_file + ".log";
+    }
+
+    inline string lock_filename(string const & data_file)
+    {
+        return data_file + ".lock";
+    }
+
+    // an flock on a file, released on destruction.
+    class file_lock
+    {
+    public:
+        file_lock(int fd, int op) : fd_(fd >= 0 && ::flock(fd, op) == 0 ? fd : -1) {}
+
+        file_lock(file_lock const &) = delete;
+        file_lock & operator=(file_lock const &) = delete;
+
+        ~file_lock()
+        {
+            if (fd_ >= 0)
+                ::flock(fd_, LOCK_UN);
+        }
+
+        // whether the lock was taken.
+        bool held() const { return fd_ >= 0; }
+
+    private:
+        int fd_;
+    };
+
+    // the device and inode of a file, which tell whether a name still refers
+    // to the file that was opened, or nullopt if it does not exist.
+    inline optional<pair<dev_t,ino_t>> file_id(string const & filename)
+    {
+        struct stat st;
+        if (::stat(filename.c_str(), &st) != 0)
+            return nullopt;
+        return std::make_pair(st.st_dev, st.st_ino);
+    }
+
+    // a write: sets key to *value, or deletes key if there is no value.
+    struct mutation
+    {
+        string_view key;
+        optional<string_view> value;
+    };
+
+    // the end of the complete lines of a log. a write that was interrupted
+    // by a crash may leave a partial line after it.
+    inline uint64_t log_end(string_view log)
+    {
+        auto const e = log.rfind('\n');
+        return e == string_view::npos ? 0 : e + 1;
+    }
+
+    // calls f(mutation) for each write in log, in order.
+    template <typename F>
+    void for_each_mutation(string_view log, F f)
+    {
+        for_each_line(log.substr(0, log_end(log)), [&](string_view line, uint64_t)
+        {
+            if (line.empty())
+                return;
+            auto r = parse_record(line.substr(1));
+            if (!r)
+                return;
+            if (line[0] == '+')
+                f(mutation{r->key, r->value});
+            else if (line[0] == '-')
+                f(mutation{r->key, nullopt});
+        });
+    }
+
+    // appends m to a log, or returns false if it cannot be written in the
+    // key-value format.
+    inline bool append_mutation(string & log, mutation const & m)
+    {
+        if (m.key.empty() || std::any_of(m.key.begin(), m.key.end(), is_space))
+            return false;
+        if (m.value && m.value->find('\n') != string_view::npos)
+            return false;
+
+        log += m.value ? '+' : '-';
+        log += m.key;
+        if (m.value)
+        {
+            log += ' ';
+            log += *m.value;
+        }
+        log += '\n';
+        return true;
+    }
+
+    class store
+    {
+    public:
+        /**
+         * Opens the store of the key-value file data_file. If writable, the
+         * key-value file and its log are created if they do not exist.
+         * Returns nullptr on failure.
+         */
+        static unique_ptr<store> open(string const & data_file, bool writable = true)
+        {
+            unique_ptr<store> s(new store(data_file, writable));
+            if (writable)
+            {
+                int fd = ::open(data_file.c_str(), O_RDONLY | O_CREAT, 0644);
+                if (fd < 0)
+                    return nullptr;
+                ::close(fd);
+            }
+
+            s->lock_fd_ = ::open(lock_filename(data_file).c_str(),
+                writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+            if (writable && s->lock_fd_ < 0)
+                return nullptr;
+
+            std::lock_guard g(s->mutex_);
+            if (!s->load())
+                return nullptr;
+            return s;
+        }
+
+        store(store const &) = delete;
+        store & operator=(store const &) = delete;
+
+        ~store()
+        {
+            if (compaction_.joinable())
+                compaction_.join();
+            if (log_fd_ >= 0)
+                ::close(log_fd_);
+            if (lock_fd_ >= 0)
+                ::close(lock_fd_);
+            delete current_.load();
+        }
+
+        /**
+         * Returns f(snapshot) for the current snapshot of the store, which
+         * f must not keep after it returns. Never blocks.
+         */
+        template <typename F>
+        decltype(auto) read(F f) const
+        {
+            auto g = epochs_.pin();
+            return f(*current_.load());
+        }
+
+        // the value of key, or nullopt if there is none.
+        optional<string> get(string_view key) const
+        {
+            return read([&](snapshot const & s)
+            {
+                auto v = s.get(key);
+                return v ? optional<string>(*v) : nullopt;
+            });
+        }
+
+        // the values of keys, in order; see kvs_lookup.hpp.
+        vector<optional<string>> get(vector<string_view> const & keys, unsigned threads = 0) const
+        {
+            return read([&](snapshot const & s)
+            {
+                auto vs = s.get(keys, threads);
+                vector<optional<string>> values(vs.size());
+                for (size_t i = 0; i < vs.size(); ++i)
+                {
+                    if (vs[i])
+                        values[i] = string(*vs[i]);
+                }
+                return values;
+            });
+        }
+
+        // calls f(record) for each record of the base that has not been
+        // written since, and then for each key set by the log.
+        template <typename F>
+        void for_each(F f) const
+        {
+            read([&](snapshot const & s) { s.for_each(f); });
+        }
+
+        bool set(string_view key, string_view value)
+        {
+            return write({mutation{key, value}});
+        }
+
+        bool erase(string_view key)
+        {
+            return write({mutation{key, nullopt}});
+        }
+
+        /**
+         * Appends the writes of batch to the log in a single write(2).
+         * Returns false, writing nothing, if the store is not writable or a
+         * key or value cannot be stored (a key is one token and a value is
+         * one line).
+         */
+        bool write(vector<mutation> const & batch)
+        {
+            if (!writable_)
+                return false;
+
+            string buf;
+            for (auto const & m : batch)
+            {
+                if (!append_mutation(buf, m))
+                    return false;
+            }
+
+            std::lock_guard g(mutex_);
+            for (int attempt = 0; attempt < 8; ++attempt)
+            {
+                {
+                    file_lock l(lock_fd_, LOCK_SH);
+
+                    // another process may have compacted the store since it
+                    // was loaded, in which case the log was replaced.
+                    if (!current() && !load_locked())
+                        return false;
+
+                    if (ends_on_line())
+                    {
+                        for (size_t done = 0; done < buf.size(); )
+                        {
+                            auto n = ::write(log_fd_, buf.data() + done, buf.size() - done);
+                            if (n < 0)
+                                return false;
+                            done += size_t(n);
+                        }
+                        log_size_ += buf.size();
+
+                        delta d;
+                        for_each_mutation(buf, [&](mutation const & m)
+                        {
+                            apply(d, m);
+                        });
+                        publish(new snapshot(current_.load()->with(std::move(d))));
+                        return true;
+                    }
+                }
+
+                // the log ends in a partial line: an append in progress in
+                // another process, or what a crash left.
+                if (!recover())
+                    return false;
+            }
+            return false;
+        }
+
+        // flushes the log to disk.
+        bool sync()
+        {
+            std::lock_guard g(mutex_);
+            return log_fd_ < 0 || ::fdatasync(log_fd_) == 0;
+        }
+
+        uint64_t base_size() const
+        {
+            return read([](snapshot const & s) { return uint64_t(s.base().file.size()); });
+        }
+
+        uint64_t log_size() const
+        {
+            std::lock_guard g(mutex_);
+            return log_size_;
+        }
+
+        // true if the log has grown enough to be worth compacting: to half of
+        // the base, between 1 MiB and 64 MiB, which also bounds the
+        // memory used by the logged writes.
+        bool needs_compaction() const
+        {
+            std::lock_guard g(mutex_);
+            uint64_t const limit = std::clamp<uint64_t>(
+                current_.load()->base().file.size() / 2, 1 << 20, 64 << 20);
+            return log_size_ >= limit;
+        }
+
+        /**
+         * Merges the base and the log into a new, sorted and indexed base.
+         * Returns false if it failed or another compaction of the store
+         * finished first.
+         */
+        bool compact()
+        {
+            if (!writable_)
+                return false;
+
+            // a lock of its own, since flocks on the same open file do not
+            // exclude each other.
+            int lock_fd = ::open(lock_filename(data_file_).c_str(), O_RDWR);
+            if (lock_fd < 0)
+                return false;
+            bool ok = compact(lock_fd);
+            ::close(lock_fd);
+
+            if (ok)
+            {
+                std::lock_guard g(mutex_);
+                file_lock l(lock_fd_, LOCK_SH);
+                load_locked();
+            }
+            return ok;
+        }
+
+        // compacts the store in a thread, unless a compaction is running.
+        void compact_in_background()
+        {
+            std::lock_guard g(compaction_mutex_);
+            if (compacting_.exchange(true))
+                return;
+            if (compaction_.joinable())
+                compaction_.join();
+            compaction_ = std::thread([this]
+            {
+                compact();
+                compacting_ = false;
+            });
+        }
+
+    private:
+        store(string const & data_file, bool writable) :
+            data_file_(data_file), writable_(writable) {}
+
+        static void apply(delta & d, mutation const & m)
+        {
+            if (m.value)
+                d.insert_or_assign(string(m.key), string(*m.value));
+            else
+                d.insert_or_assign(string(m.key), nullopt);
+        }
+
+        // makes s the current snapshot. the mutex must be held.
+        void publish(snapshot const * s)
+        {
+            if (auto old = current_.exchange(s))
+                epochs_.retire(old);
+            epochs_.reclaim();
+        }
+
+        // whether the base and log are the files that are loaded.
+        bool current() const
+        {
+            return file_id(data_file_) == base_id_ && file_id(log_filename(data_file_)) == log_id_;
+        }
+
+        bool load()
+        {
+            if (writable_ && !recover())
+                return false;
+            file_lock l(lock_fd_, LOCK_SH);
+            return load_locked();
+        }
+
+        // whether the loaded log ends on a line, so that an append starts
+        // a line of its own. the lock file must be locked.
+        bool ends_on_line() const
+        {
+            struct stat st;
+            if (::fstat(log_fd_, &st) != 0)
+                return false;
+            char last = '\n';
+            return st.st_size == 0 || (::pread(log_fd_, &last, 1, st.st_size - 1) == 1 && last == '\n');
+        }
+
+        /**
+         * Drops a partial line that a crash left at the end of the log. It
+         * holds the lock file exclusively, so no other process is appending
+         * and a partial line is not a write in progress. (Under a shared
+         * lock, it might be, so a partial line is only ever dropped here.)
+         */
+        bool recover()
+        {
+            file_lock l(lock_fd_, LOCK_EX);
+            string const log_file = log_filename(data_file_);
+            mapped_file log;
+            if (!log.open(log_file))
+                return true;
+            string_view const bytes(log.data(), log.size());
+            if (log_end(bytes) == bytes.size())
+                return true;
+            return ::truncate(log_file.c_str(), off_t(log_end(bytes))) == 0;
+        }
+
+        // (re)loads the base, its index and the log. the lock file must be
+        // locked.
+        bool load_locked()
+        {
+            base_id_ = file_id(data_file_);
+            auto base = segment::open(data_file_);
+            if (!base)
+                return false;
+
+            if (log_fd_ >= 0)
+                ::close(log_fd_);
+            string const log_file = log_filename(data_file_);
+            log_fd_ = ::open(log_file.c_str(), writable_ ? O_RDWR | O_CREAT | O_APPEND : O_RDONLY, 0644);
+            if (writable_ && log_fd_ < 0)
+                return false;
+            log_id_ = file_id(log_file);
+
+            mapped_file log;
+            log.open(log_file);
+            string_view const bytes(log.data(), log.size());
+            log_size_ = bytes.size();
+
+            // a partial line at the end is not replayed, and left alone: it
+            // may be another process's append in progress (see recover).
+            delta d;
+            for_each_mutation(bytes, [&](mutation const & m)
+            {
+                apply(d, m);
+            });
+            snapshot next(std::move(base));
+            publish(new snapshot(d.empty() ? std::move(next) : next.with(std::move(d))));
+            return true;
+        }
+
+        bool compact(int lock_fd)
+        {
+            string const log_file = log_filename(data_file_);
+
+            // a consistent view of the base and the log.
+            mapped_file base, log;
+            optional<pair<dev_t,ino_t>> base_id, log_id;
+            {
+                file_lock l(lock_fd, LOCK_SH);
+                base_id = file_id(data_file_);
+                log_id = file_id(log_file);
+                base.open(data_file_);
+                log.open(log_file);
+            }
+            string_view const base_bytes(base.data(), base.size());
+            string_view const log_bytes(log.data(), log_end(string_view(log.data(), log.size())));
+
+            unordered_map<string_view, optional<string_view>> latest;
+            for_each_mutation(log_bytes, [&](mutation const & m)
+            {
+                latest.insert_or_assign(m.key, m.value);
+            });
+
+            vector<record> records;
+            base.advise(MADV_SEQUENTIAL);
+            for_each_record(base_bytes, [&](record const & r, uint64_t)
+            {
+                if (latest.find(r.key) == latest.end())
+                    records.push_back(r);
+            });
+            for (auto const & [k, v] : latest)
+            {
+                if (v)
+                    records.push_back(record{k, *v});
+            }
+
+            // a key that occurs more than once in the base keeps its first
+            // occurrence, as a lookup does.
+            auto by_key = [](record const & a, record const & b) { return a.key < b.key; };
+            std::stable_sort(records.begin(), records.end(), by_key);
+            records.erase(std::unique(records.begin(), records.end(),
+                [](record const & a, record const & b) { return a.key == b.key; }), records.end());
+
+            string const tmp = data_file_ + ".compact." + std::to_string(::getpid()) + "." +
+                std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+            auto cleanup = [&]
+            {
+                std::remove(tmp.c_str());
+                std::remove(index_filename(tmp).c_str());
+                std::remove((tmp + ".log").c_str());
+                return false;
+            };
+
+            {
+                std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+                for (auto const & r : records)
+                    out << r.key << '\t' << r.value << '\n';
+                if (!out)
+                    return cleanup();
+            }
+            records.clear();
+            {
+                mapped_file segment(tmp);
+                if (!build_index(tmp, string_view(segment.data(), segment.size())))
+                    return cleanup();
+            }
+
+            file_lock l(lock_fd, LOCK_EX);
+            if (file_id(data_file_) != base_id || file_id(log_file) != log_id)
+                return cleanup();
+
+            // the writes appended since the log was read.
+            {
+                mapped_file current(log_file);
+                string_view tail(current.data(), current.size());
+                tail.remove_prefix(std::min(tail.size(), log_bytes.size()));
+                std::ofstream out(tmp + ".log", std::ios::binary | std::ios::trunc);
+                out.write(tail.data(), std::streamsize(tail.size()));
+                if (!out)
+                    return cleanup();
+            }
+
+            // the base goes first: until the log is replaced, the old log is
+            // replayed over the new base, which gives the same store.
+            if (std::rename(tmp.c_str(), data_file_.c_str()) != 0)
+                return cleanup();
+            std::rename(index_filename(tmp).c_str(), index_filename(data_file_).c_str());
+            return std::rename((tmp + ".log").c_str(), log_file.c_str()) == 0;
+        }
+
+        string data_file_;
+        bool writable_;
+        int lock_fd_ = -1;
+
+        // the state of the writer.
+        mutable std::mutex mutex_;
+        optional<pair<dev_t,ino_t>> base_id_;
+        int log_fd_ = -1;
+        optional<pair<dev_t,ino_t>> log_id_;
+        uint64_t log_size_ = 0;
+
+        mutable epoch_domain epochs_;
+        std::atomic<snapshot const *> current_{nullptr};
+
+        std::mutex compaction_mutex_;
+        std::atomic<bool> compacting_{false};
+        std::thread compaction_;
+    };
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+/**
+ * mapped_file is a read-only memory mapping of a file.
+ *
+ * The binary file formats (AHS files, key-value indexes, ...) are laid out
+ * so that they may be used directly from the mapped bytes, i.e., opening a
+ * file costs a system call and a query only touches the pages it needs.
+ */
+
+#include <string>
+#include <cstddef>
+#include <utility>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using std::string;
+using std::size_t;
+using std::exchange;
+
+namespace alex
+{
+    class mapped_file
+    {
+    public:
+        mapped_file() = default;
+
+        explicit mapped_file(string const & filename)
+        {
+            open(filename);
+        }
+
+        mapped_file(mapped_file const &) = delete;
+        mapped_file & operator=(mapped_file const &) = delete;
+
+        mapped_file(mapped_file && rhs) noexcept :
+            data_(exchange(rhs.data_, nullptr)),
+            size_(exchange(rhs.size_, 0)) {}
+
+        mapped_file & operator=(mapped_file && rhs) noexcept
+        {
+            if (this != &rhs)
+            {
+                close();
+                data_ = exchange(rhs.data_, nullptr);
+                size_ = exchange(rhs.size_, 0);
+            }
+            return *this;
+        }
+
+        ~mapped_file() { close(); }
+
+        // returns false if the file could not be opened or mapped. an empty
+        // file is opened successfully but has no data.
+        bool open(string const & filename)
+        {
+            close();
+            int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+
+            struct stat st;
+            if (::fstat(fd, &st) != 0)
+            {
+                ::close(fd);
+                return false;
+            }
+
+            size_ = static_cast<size_t>(st.st_size);
+            if (size_ != 0)
+            {
+                void * p = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+                if (p == MAP_FAILED)
+                {
+                    ::close(fd);
+                    size_ = 0;
+                    return false;
+                }
+                data_ = static_cast<char const *>(p);
+            }
+            ::close(fd);
+            return true;
+        }
+
+        void close()
+        {
+            if (data_ != nullptr)
+                ::munmap(const_cast<char *>(data_), size_);
+            data_ = nullptr;
+            size_ = 0;
+        }
+
+        // hint the kernel about the expected access pattern, e.g.,
+        // MADV_RANDOM for hash probes and MADV_SEQUENTIAL for scans.
+        void advise(int advice) const
+        {
+            if (data_ != nullptr)
+                ::madvise(const_cast<char *>(data_), size_, advice);
+        }
+
+        char const * data() const { return data_; }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+    private:
+        char const * data_ = nullptr;
+        size_t size_ = 0;
+    };
+}
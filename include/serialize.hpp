@@ -1,52 +1,140 @@
+#pragma once
+
+/**
+ * pack and unpack convert between an unsigned integer and the pair of its
+ * halves, the high half first, e.g.,
+ * ---
+ * auto [hi, lo] = unpack<uint64_t, pair<uint32_t,uint32_t>>{}(x);
+ * auto y = pack<pair<uint32_t,uint32_t>, uint64_t>{}({hi, lo});   // y == x
+ *
+ * pack_many and unpack_many do the same for whole arrays of 64-bit values,
+ * whose halves are kept in two arrays (e.g., two columns). They convert 8
+ * values at a time with shuffles under AVX2, and one at a time otherwise.
+ */
+
 #include <utility>
+#include <cstdint>
+#include <cstddef>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
-template <typename X, typename Y>
-struct unpack
-{
-}
+using std::pair;
+using std::size_t;
+using std::uint8_t;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint64_t;
 
-template <typename X, typename Y>
-struct pack
+namespace alex
 {
-}
+    template <typename X, typename Y>
+    struct unpack;
 
-template <>
-struct unpack<uint64_t, pair<uint32_t,uint32_t>>
-{
-    static auto operator()(uint64_t x)
+    template <typename X, typename Y>
+    struct pack;
+
+    template <>
+    struct unpack<uint64_t, pair<uint32_t,uint32_t>>
     {
-        return { x >> 32, x & 0x00000000ffffffff };
-    }
-}
+        pair<uint32_t,uint32_t> operator()(uint64_t x) const
+        {
+            return { uint32_t(x >> 32), uint32_t(x & 0x00000000ffffffff) };
+        }
+    };
 
-template <>
-struct pack<pair<uint32_t,uint32_t>,uint64_t>
-{
-    static auto operator()(pair<uint32_t,uint32_t> x)
+    template <>
+    struct pack<pair<uint32_t,uint32_t>,uint64_t>
     {
-        uint64_t r = x.first;
-        r <<= 32;
-        r |= x.second;
-        return r;
-    }
-}
+        uint64_t operator()(pair<uint32_t,uint32_t> x) const
+        {
+            uint64_t r = x.first;
+            r <<= 32;
+            r |= x.second;
+            return r;
+        }
+    };
 
+    template <>
+    struct unpack<uint32_t, pair<uint16_t,uint16_t>>
+    {
+        pair<uint16_t,uint16_t> operator()(uint32_t x) const
+        {
+            return { uint16_t(x >> 16), uint16_t(x & 0x0000ffff) };
+        }
+    };
 
-template <>
-struct unpack<uint32_t, pair<uint16_t,uint16_t>>
-{
-    static auto operator()(uint32_t x)
+    template <>
+    struct pack<pair<uint16_t,uint16_t>,uint32_t>
+    {
+        uint32_t operator()(pair<uint16_t,uint16_t> x) const
+        {
+            return (uint32_t(x.first) << 16) | x.second;
+        }
+    };
+
+    template <>
+    struct unpack<uint16_t, pair<uint8_t,uint8_t>>
+    {
+        pair<uint8_t,uint8_t> operator()(uint16_t x) const
+        {
+            return { uint8_t(x >> 8), uint8_t(x & 0x00ff) };
+        }
+    };
+
+    template <>
+    struct pack<pair<uint8_t,uint8_t>,uint16_t>
     {
-        return { x >> 16, x & 0x0000ffff };
+        uint16_t operator()(pair<uint8_t,uint8_t> x) const
+        {
+            return uint16_t((uint16_t(x.first) << 8) | x.second);
+        }
+    };
+
+    // splits the n values of xs into their high and low halves.
+    inline void unpack_many(uint64_t const * xs, size_t n, uint32_t * hi, uint32_t * lo)
+    {
+        size_t i = 0;
+#if defined(__AVX2__)
+        // the even 32-bit lanes (low halves) to the low 128 bits, the odd
+        // ones (high halves) to the high 128 bits.
+        __m256i const split = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256i const a = _mm256_permutevar8x32_epi32(
+                _mm256_loadu_si256(reinterpret_cast<__m256i const *>(xs + i)), split);
+            __m256i const b = _mm256_permutevar8x32_epi32(
+                _mm256_loadu_si256(reinterpret_cast<__m256i const *>(xs + i + 4)), split);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(lo + i), _mm256_permute2x128_si256(a, b, 0x20));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(hi + i), _mm256_permute2x128_si256(a, b, 0x31));
+        }
+#endif
+        for (; i < n; ++i)
+        {
+            auto const h = unpack<uint64_t, pair<uint32_t,uint32_t>>{}(xs[i]);
+            hi[i] = h.first;
+            lo[i] = h.second;
+        }
     }
-}
 
-template <>
-struct unpack<uint16_t, pair<uint8_t,uint8_t>>
-{
-    static auto operator()(uint16_t x)
+    // joins the n high and low halves of hi and lo into xs.
+    inline void pack_many(uint32_t const * hi, uint32_t const * lo, size_t n, uint64_t * xs)
     {
-        return { x >> 8, x & 0x00ff };
+        size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 8 <= n; i += 8)
+        {
+            // interleave within each 128-bit half, whose order is restored
+            // by the permutes.
+            __m256i const h = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(hi + i));
+            __m256i const l = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(lo + i));
+            __m256i const a = _mm256_unpacklo_epi32(l, h);
+            __m256i const b = _mm256_unpackhi_epi32(l, h);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(xs + i), _mm256_permute2x128_si256(a, b, 0x20));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(xs + i + 4), _mm256_permute2x128_si256(a, b, 0x31));
+        }
+#endif
+        for (; i < n; ++i)
+            xs[i] = pack<pair<uint32_t,uint32_t>, uint64_t>{}({hi[i], lo[i]});
     }
 }
-
@@ -0,0 +1,149 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdlib>
+#include <boost/program_options.hpp>
+#include "ahs/ahs.hpp"
+
+/**
+ * ahs_build : X* -> AHS[X] constructs an approximate hash set from a
+ * sequence of elements (serializations of values of type X) and writes it
+ * to an AHS file.
+ *
+ * The elements are read from the command line or, if there are none, from
+ * the standard input, e.g.,
+ *     echo apple orange | ahs_build --out fruit --backend fuse --fpr 0.001
+ * and
+ *     ahs_build --out fruit --backend fuse --fpr 0.001 apple orange
+ * are equivalent.
+ *
+ * With the count backend, the multiplicity of each element (the number of
+ * times it occurs in the input) is counted as well; see ahs_count.
+ *
+ * The backend is recorded in the AHS file, so ahs_contains (and the other
+ * AHS programs) need not be told which backend a file uses.
+ *
+ * AHS files that are to be merged later with ahs_union or ahs_intersect
+ * (e.g., per-shard sets) must be built with the same backend, seed and
+ * --capacity.
+ */
+
+using std::cout;
+using std::string;
+using std::cin;
+using std::string_view;
+using std::vector;
+using std::cerr;
+using std::ofstream;
+using alex::ahs::ahs_backend;
+using alex::ahs::backend_from_name;
+using alex::ahs::build_ahs;
+using alex::ahs::build_count_min;
+using alex::ahs::element_hash;
+
+void output_info(string_view prog)
+{
+    cout    << "Approximate hash set construction\n"
+            << "---------------------------------\n"
+            << prog << " : X* -> AHS[X] writes an approximate hash set of the\n"
+            << "input elements to an AHS file. The backend is one of\n"
+            << "    bloom  : blocked Bloom filter (supports union and intersection),\n"
+            << "    cuckoo : cuckoo filter (supports deletes),\n"
+            << "    fuse   : binary fuse filter (static, smallest and fastest),\n"
+            << "    count  : count-min sketch (counts multiplicities, see ahs_count).\n"
+            << "\n"
+            << prog << " accepts command-line arguments or standard input,\n"
+            << "e.g., \"echo apple orange | " << prog << " --out fruit\" is\n"
+            << "equivalent to \"" << prog << " --out fruit apple orange\".\n";
+}
+
+int main(
+    int argc,
+    char const * argv[])
+{
+    namespace po = boost::program_options;
+
+    string out_file, backend;
+    double fpr, error;
+    uint64_t seed, capacity;
+    vector<string> xs;
+
+    // Declare the supported options.
+    po::options_description desc(string(argv[0]) + " [options] X* -> AHS[X]");
+    desc.add_options()
+        ("help", "show help")
+        ("info", "show detailed info")
+        ("out", po::value<string>(&out_file), "AHS file to write")
+        ("backend", po::value<string>(&backend)->default_value("bloom"), "bloom, cuckoo, fuse or count")
+        ("fpr", po::value<double>(&fpr)->default_value(0.01), "target false positive rate")
+        ("error", po::value<double>(&error)->default_value(0.0001), "count: error of a count relative to the total count")
+        ("seed", po::value<uint64_t>(&seed)->default_value(0), "seed of the element hash")
+        ("capacity", po::value<uint64_t>(&capacity)->default_value(0), "size the AHS for this many elements (so that AHS files of the same capacity may be merged)")
+        ("in", po::value<vector<string>>(&xs)->multitoken(), "elements of the set")
+        ;
+
+    po::positional_options_description p;
+    p.add("in", -1);
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(p).run(), vm);
+    po::notify(vm);
+
+    if (vm.count("info"))
+    {
+        output_info(argv[0]);
+        return EXIT_SUCCESS;
+    }
+
+    if (vm.count("help") || out_file.empty())
+    {
+        cout << desc << "\n";
+        return EXIT_SUCCESS;
+    }
+
+    auto b = backend_from_name(backend);
+    if (!b)
+    {
+        cerr << "Error: unknown backend " << backend << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if (!(fpr > 0 && fpr < 1) || !(error > 0 && error < 1))
+    {
+        cerr << "Error: fpr and error must be in (0,1)\n";
+        return EXIT_FAILURE;
+    }
+
+    vector<uint64_t> hs;
+    if (vm.count("in") == 0)
+    {
+        string x;
+        while (cin >> x)
+            hs.push_back(element_hash(x, seed));
+    }
+    else
+    {
+        for (auto const & x : xs)
+            hs.push_back(element_hash(x, seed));
+    }
+
+    auto img = *b == ahs_backend::count_min ?
+        build_count_min(hs, error, seed) :
+        build_ahs(*b, move(hs), fpr, seed, capacity);
+    if (!img)
+    {
+        cerr << "Error: failed to construct the AHS\n";
+        return EXIT_FAILURE;
+    }
+
+    ofstream out(out_file, std::ios::binary);
+    img->write(out);
+    if (!out)
+    {
+        cerr << "Error: failed to write " << out_file << "\n";
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -1,6 +1,25 @@
 #include <iostream>
-#include <stdio.h>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include <cctype>
+#include <boost/program_options.hpp>
+#include "ahs/ahs.hpp"
+
+using std::cout;
+using std::string;
+using std::cin;
+using std::string_view;
+using std::vector;
+using std::cerr;
+using std::unique_ptr;
+using alex::ahs::approximate_hash_set;
+using alex::ahs::backend_name;
+
+string const True     = "1";
+string const False    = "0";
 
 /**
  * 
@@ -71,25 +90,122 @@
  * returns a serialization of Boolean to the standard out:
  *     std::cout << serialize(contains(deserialize(s), deserialize(x)))
  * 
+ * The AHS file is memory-mapped and its header records which data structure
+ * (blocked Bloom filter, cuckoo filter, binary fuse filter) it contains, so
+ * ahs_contains dispatches on the file. AHS files are made by ahs_build.
  */
 
+void output_info(string_view prog)
+{
+    cout    << "Approximate hash set membership\n"
+            << "-------------------------------\n"
+            << prog << " : (AHS[X], X*) -> Bool* tests whether each element\n"
+            << "is a member of the approximate hash set. False negatives do not\n"
+            << "occur; false positives occur with the rate recorded in the AHS file.\n"
+            << "\n"
+            << prog << " accepts elements as command-line arguments or on\n"
+            << "the standard input, e.g., \"echo apple almond | " << prog << " fruit\"\n"
+            << "is equivalent to \"" << prog << " fruit apple almond\".\n"
+            << "\n"
+            << "Ex. 1: \"" << prog << " fruit apple orange almond\" outputs \"1 1 0\"\n";
+}
+
+
 int main(
     int argc,
-    char ** argv)
+    char const * argv[])
 {
-    if (argc == 1)
+    namespace po = boost::program_options;
+    // unsynced, cin buffers its input, so in_avail says whether more of
+    // it has been read.
+    std::ios::sync_with_stdio(false);
+
+    string ahs_file;
+    vector<string> xs;
+
+    // Declare the supported options.
+    po::options_description desc(string(argv[0]) + " [options] (AHS[X], X*) -> Bool*");
+    desc.add_options()
+        ("help", "show help")
+        ("info", "show detailed info")
+        ("header", "show the header of the AHS file")
+        ("ahs-file", po::value<string>(&ahs_file), "AHS file")
+        ("in", po::value<vector<string>>(&xs)->multitoken(), "elements to test for membership")
+        ;
+
+    po::positional_options_description p;
+    p.add("ahs-file", 1);
+    p.add("in", -1);
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(p).run(), vm);
+    po::notify(vm);
+
+    if (vm.count("info"))
     {
-        std::cout << ""
+        output_info(argv[0]);
+        return EXIT_SUCCESS;
     }
-    for (int i = 0; i < 2; ++i)
-        std::cout << argv[i] << '\n';
 
-    std::string el;
+    if (vm.count("help") || ahs_file.empty())
+    {
+        cout << desc << "\n";
+        return EXIT_SUCCESS;
+    }
 
-    if (!std::cin.eof())
+    auto s = approximate_hash_set::open(ahs_file);
+    if (!s)
     {
-        std::cin >> input;
+        cerr << "Error: " << ahs_file << " is not an AHS file\n";
+        return EXIT_FAILURE;
+    }
+
+    if (vm.count("header"))
+    {
+        cout << "backend\t" << backend_name(s->backend()) << "\n"
+             << "cardinality\t" << s->cardinality() << "\n"
+             << "fpr\t" << s->fpr() << "\n";
+        return EXIT_SUCCESS;
+    }
+
+    // answers the queries xs, in one batch.
+    auto answer = [&s](vector<string> const & xs)
+    {
+        vector<string_view> qs(xs.begin(), xs.end());
+        unique_ptr<bool[]> rs(new bool[qs.size()]);
+        s->contains(qs.data(), qs.size(), rs.get());
+        for (size_t i = 0; i < qs.size(); ++i)
+            cout << (rs[i] ? True : False) << "\n";
+    };
 
-        std::cout << input << '\n';
+    if (vm.count("in") != 0)
+    {
+        answer(xs);
+        return EXIT_SUCCESS;
+    }
+
+    // from stdin, answer in batches of up to batch_size, and whenever no
+    // more input is buffered, so that an interactive session or a pipeline
+    // gets each answer as soon as its query is read.
+    constexpr size_t batch_size = 4096;
+    auto more_buffered = []
+    {
+        auto * const b = cin.rdbuf();
+        while (b->in_avail() > 0 && std::isspace(b->sgetc()))
+            b->sbumpc();
+        return b->in_avail() > 0;
+    };
+    string x;
+    while (cin >> x)
+    {
+        xs.push_back(std::move(x));
+        if (xs.size() == batch_size || !more_buffered())
+        {
+            answer(xs);
+            cout.flush();
+            xs.clear();
+        }
     }
-}
\ No newline at end of file
+    answer(xs);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,89 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdlib>
+#include <boost/program_options.hpp>
+#include "ahs/ahs.hpp"
+
+using std::cout;
+using std::string;
+using std::cin;
+using std::string_view;
+using std::vector;
+using std::cerr;
+using alex::ahs::approximate_hash_set;
+
+void output_info(string_view prog)
+{
+    cout    << "Approximate hash set true positive rate\n"
+            << "---------------------------------------\n"
+            << prog << " : AHS[X] -> Real outputs the true positive rate of\n"
+            << "contains on an approximate hash set, i.e., one minus its false\n"
+            << "negative rate. It is recorded in the header of the AHS file,\n"
+            << "so only the header is read.\n"
+            << "\n"
+            << prog << " accepts AHS files as command-line arguments or on the\n"
+            << "standard input, and outputs one line for each.\n";
+}
+
+int main(
+    int argc,
+    char const * argv[])
+{
+    namespace po = boost::program_options;
+
+    vector<string> in;
+
+    // Declare the supported options.
+    po::options_description desc(string(argv[0]) + " [options] AHS[X]* -> Real*");
+    desc.add_options()
+        ("help", "show help")
+        ("info", "show detailed info")
+        ("pair", "show as file-tpr pairs")
+        ("in", po::value<vector<string>>(&in)->multitoken(), "AHS files")
+        ;
+
+    po::positional_options_description p;
+    p.add("in", -1);
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(p).run(), vm);
+    po::notify(vm);
+
+    if (vm.count("info"))
+    {
+        output_info(argv[0]);
+        return EXIT_SUCCESS;
+    }
+
+    if (vm.count("help"))
+    {
+        cout << desc << "\n";
+        return EXIT_SUCCESS;
+    }
+
+    if (vm.count("in") == 0)
+    {
+        string f;
+        while (cin >> f)
+            in.push_back(f);
+    }
+
+    int status = EXIT_SUCCESS;
+    for (auto const & f : in)
+    {
+        auto s = approximate_hash_set::open(f);
+        if (!s)
+        {
+            cerr << "Error: " << f << " is not an AHS file\n";
+            status = EXIT_FAILURE;
+            continue;
+        }
+
+        if (vm.count("pair"))
+            cout << f << "\t";
+        cout << s->tpr() << "\n";
+    }
+    return status;
+}
@@ -0,0 +1,107 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdlib>
+#include <boost/program_options.hpp>
+#include "ahs/ahs_merge.hpp"
+
+using std::cout;
+using std::string;
+using std::string_view;
+using std::vector;
+using std::cerr;
+using std::ofstream;
+using alex::ahs::approximate_hash_set;
+using alex::ahs::merge_into;
+using alex::ahs::merge_op;
+
+void output_info(string_view prog)
+{
+    cout    << "Approximate hash set union\n"
+            << "--------------------------\n"
+            << prog << " : (AHS[X], AHS[X]) -> AHS[X] models the union of\n"
+            << "approximate hash sets. It is computed from the AHS files\n"
+            << "directly, without the elements, so the AHS files must be\n"
+            << "compatible: the same backend (bloom or cuckoo), hash seed and\n"
+            << "size. fuse sets are static and must be rebuilt instead.\n"
+            << "\n"
+            << "Union is a monoid, so it may reduce a sequence of AHS[X] to\n"
+            << "AHS[X], e.g.,\n"
+            << "    " << prog << " --out all shard1 shard2 shard3\n"
+            << "\n"
+            << "The false positive rate of the union is recomputed from the\n"
+            << "merged AHS, and its cardinality is estimated from it.\n";
+}
+
+int main(
+    int argc,
+    char const * argv[])
+{
+    namespace po = boost::program_options;
+
+    string out_file;
+    vector<string> in;
+
+    // Declare the supported options.
+    po::options_description desc(string(argv[0]) + " [options] AHS[X]* -> AHS[X]");
+    desc.add_options()
+        ("help", "show help")
+        ("info", "show detailed info")
+        ("out", po::value<string>(&out_file), "AHS file to write")
+        ("in", po::value<vector<string>>(&in)->multitoken(), "AHS files to merge")
+        ;
+
+    po::positional_options_description p;
+    p.add("in", -1);
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(p).run(), vm);
+    po::notify(vm);
+
+    if (vm.count("info"))
+    {
+        output_info(argv[0]);
+        return EXIT_SUCCESS;
+    }
+
+    if (vm.count("help") || out_file.empty() || in.empty())
+    {
+        cout << desc << "\n";
+        return EXIT_SUCCESS;
+    }
+
+    auto first = approximate_hash_set::open(in[0]);
+    if (!first)
+    {
+        cerr << "Error: " << in[0] << " is not an AHS file\n";
+        return EXIT_FAILURE;
+    }
+
+    auto acc = first->image();
+    for (size_t i = 1; i < in.size(); ++i)
+    {
+        auto s = approximate_hash_set::open(in[i]);
+        if (!s)
+        {
+            cerr << "Error: " << in[i] << " is not an AHS file\n";
+            return EXIT_FAILURE;
+        }
+
+        if (auto why = merge_into(acc, *s, merge_op::set_union))
+        {
+            cerr << "Error: cannot merge " << in[i] << ": " << *why << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    ofstream out(out_file, std::ios::binary);
+    acc.write(out);
+    if (!out)
+    {
+        cerr << "Error: failed to write " << out_file << "\n";
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include "ahs/perfect_hash.hpp"
+#include "cipher_value_types/cipher_cardinal.hpp"
+
+using std::cerr;
+using std::string;
+using std::vector;
+using std::uint64_t;
+using alex::ahs::minimal_perfect_hash;
+
+/**
+ * Checks cipher_cardinal.hpp and ahs/perfect_hash.hpp (see "make check"):
+ *
+ *  - that a minimal perfect hash maps its keys onto [0,n) one to one, in
+ *    the batched lookup as in the single one, and is not built from keys
+ *    that repeat;
+ *  - cardinal_hash::chain, whose AVX2 or AVX-512 lanes are taken when
+ *    this is built with -mavx2 or -mavx512dq, against mix64 applied one
+ *    value at a time, and encode_many against encode;
+ *  - that a cipher_cardinal_table of every interval decodes the cipher of
+ *    every value of its domain, by operator() and decode_many, and
+ *    rejects the ciphers of another secret.
+ */
+
+int failures = 0;
+
+void check(bool ok, string const & what)
+{
+    if (!ok)
+    {
+        cerr << "check_cardinal: " << what << "\n";
+        ++failures;
+    }
+}
+
+void check_perfect_hash(std::mt19937_64 & g)
+{
+    for (size_t n : {1, 2, 100, 10000, 100000})
+    {
+        vector<uint64_t> keys(n);
+        for (auto & k : keys)
+            k = g();
+        auto f = minimal_perfect_hash::build(keys);
+        check(bool(f), "build of " + std::to_string(n) + " keys");
+        if (!f)
+            continue;
+
+        vector<uint64_t> ps(n);
+        (*f)(keys.data(), n, ps.data());
+        vector<bool> seen(n, false);
+        for (size_t i = 0; i < n; ++i)
+        {
+            check(ps[i] == (*f)(keys[i]), "batched lookup, n = " + std::to_string(n));
+            check(ps[i] < n && !seen[ps[i]], "a position taken twice, n = " + std::to_string(n));
+            if (ps[i] < n)
+                seen[ps[i]] = true;
+        }
+
+        if (n > 1)
+        {
+            keys[n - 1] = keys[0];
+            check(!minimal_perfect_hash::build(keys), "build of repeated keys, n = " + std::to_string(n));
+        }
+    }
+}
+
+void check_chains(std::mt19937_64 & g)
+{
+    cardinal_hash const h;
+    for (size_t n : {0, 1, 7, 8, 31, 32, 33, 63, 64, 65, 200})
+    {
+        for (size_t k : {0, 1, 5})
+        {
+            vector<uint64_t> xs(n), ys(n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                xs[i] = g();
+                ys[i] = xs[i];
+                for (size_t j = 0; j < k; ++j)
+                    ys[i] = alex::ahs::mix64(ys[i]);
+            }
+            h.chain(xs.data(), n, k);
+            check(xs == ys, "chain of " + std::to_string(n) + " values, k = " + std::to_string(k));
+        }
+    }
+
+    constexpr size_t N = 1000, K = 16;
+    cipher_cardinal_coder<N, K> const coder;
+    size_t const s = size_t(g());
+    vector<size_t> xs(N), cs(N);
+    for (size_t x = 0; x < N; ++x)
+        xs[x] = x;
+    coder.encode_many(xs.data(), N, s, cs.data(), 2);
+    for (size_t x = 0; x < N; ++x)
+        check(cs[x] == coder(x, s).cipher, "encode_many of " + std::to_string(x));
+}
+
+template <size_t N, size_t K>
+void check_table(size_t interval, std::mt19937_64 & g)
+{
+    string const what = "table of interval " + std::to_string(interval);
+    auto t = cipher_cardinal_table<N, K>::make(interval, 2);
+    check(bool(t), "make, " + what);
+    if (!t)
+        return;
+
+    cipher_cardinal_coder<N, K> const coder;
+    size_t const s = size_t(g()), other = s + 1;
+    vector<size_t> xs(N), cs(N), out(N);
+    for (size_t x = 0; x < N; ++x)
+        xs[x] = x;
+    coder.encode_many(xs.data(), N, s, cs.data());
+
+    check(t->decode_many(cs.data(), N, s, out.data(), 2) == 0 && out == xs, "decode_many, " + what);
+    for (size_t x = 0; x < N; x += 7)
+    {
+        auto const d = (*t)(cipher_cardinal<N>{cs[x], coder.key_hash(s)}, s);
+        check(d && *d == x, "decode of " + std::to_string(x) + ", " + what);
+    }
+
+    check(t->decode_many(cs.data(), N, other, out.data(), 2) == N, "ciphers of another secret, " + what);
+    for (size_t x = 0; x < N; x += 97)
+        check(!(*t)(cipher_cardinal<N>{cs[x], coder.key_hash(s)}, other),
+            "a cipher of another secret, " + what);
+}
+
+int main()
+{
+    std::mt19937_64 g(50);
+    check_perfect_hash(g);
+    check_chains(g);
+    for (size_t interval : {1, 2, 4, 16})
+        check_table<size_t(1) << 14, 16>(interval, g);
+    check_table<1000, 3>(5, g);
+
+    cipher_cardinal_coder<1000, 3> const coder;
+    cipher_cardinal_decoder<1000, 3> const decoder;
+    auto const d = decoder(coder(123, size_t(7)), size_t(7));
+    check(d && *d == 123, "search decoder");
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,158 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include "serialize.hpp"
+#include "columnar.hpp"
+
+using std::cerr;
+using std::string;
+using std::vector;
+using std::uint32_t;
+using std::uint64_t;
+using alex::column_encoding;
+using alex::column_file_writer;
+using alex::column_file_view;
+
+/**
+ * Checks serialize.hpp and columnar.hpp (see "make check"):
+ *
+ *  - pack_many and unpack_many, whose AVX2 path is taken when this is built
+ *    with -mavx2, against pack and unpack one value at a time;
+ *  - that every encoding of a column file decodes, and reads by get, to the
+ *    values written, for values of every width and columns of sizes around
+ *    the block and word boundaries, and that its size is the one measured;
+ *  - that open rejects a column whose count its size cannot hold, and that
+ *    verify finds a flipped bit.
+ */
+
+string const filename = "check_columnar.col";
+int failures = 0;
+
+void check(bool ok, string const & what)
+{
+    if (!ok)
+    {
+        cerr << "check_columnar: " << what << "\n";
+        ++failures;
+    }
+}
+
+void check_halves(std::mt19937_64 & g)
+{
+    for (size_t n : {0, 1, 7, 8, 9, 15, 16, 17, 1000})
+    {
+        vector<uint64_t> xs(n), ys(n);
+        vector<uint32_t> hi(n), lo(n);
+        for (auto & x : xs)
+            x = g();
+        alex::unpack_many(xs.data(), n, hi.data(), lo.data());
+        for (size_t i = 0; i < n; ++i)
+        {
+            auto const h = alex::unpack<uint64_t, std::pair<uint32_t,uint32_t>>{}(xs[i]);
+            check(hi[i] == h.first && lo[i] == h.second, "unpack_many, n = " + std::to_string(n));
+        }
+        alex::pack_many(hi.data(), lo.data(), n, ys.data());
+        check(ys == xs, "pack_many, n = " + std::to_string(n));
+    }
+}
+
+// values whose high and low halves have the given widths.
+vector<uint64_t> values(std::mt19937_64 & g, size_t n, unsigned hi_bits, unsigned lo_bits)
+{
+    auto low = [](unsigned bits) { return bits == 0 ? 0 : ~uint64_t(0) >> (64 - bits); };
+    vector<uint64_t> xs(n);
+    for (auto & x : xs)
+        x = ((g() & low(hi_bits)) << 32) | (g() & low(lo_bits));
+    return xs;
+}
+
+void check_encodings(std::mt19937_64 & g)
+{
+    column_encoding const encodings[] = {
+        column_encoding::plain, column_encoding::bit_packed, column_encoding::frame_of_reference,
+        column_encoding::varint, column_encoding::split_halves, column_encoding::automatic};
+
+    for (size_t n : {0, 1, 7, 8, 9, 127, 128, 129, 1000})
+    {
+        for (unsigned hi_bits : {0, 1, 13, 32})
+        {
+            for (unsigned lo_bits : {0, 1, 7, 20, 32})
+            {
+                auto const xs = values(g, n, hi_bits, lo_bits);
+                column_file_writer w;
+                for (auto e : encodings)
+                    w.add(xs.data(), n, e);
+                check(w.write(filename), "write " + filename);
+
+                auto v = column_file_view::open(filename);
+                check(v && v->verify(), "open and verify " + filename);
+                if (!v)
+                    return;
+                for (size_t c = 0; c < v->column_count(); ++c)
+                {
+                    string const what = "encoding " + std::to_string(int(v->encoding(c))) +
+                        ", n = " + std::to_string(n) + ", widths " + std::to_string(hi_bits) +
+                        " and " + std::to_string(lo_bits);
+                    check(v->decode(c) == xs, "decode, " + what);
+                    check(v->bytes(c).size() == column_file_writer::encoded_size(xs.data(), n, v->encoding(c)),
+                        "encoded size, " + what);
+                    for (size_t i = 0; i < n; ++i)
+                    {
+                        auto const x = v->get(c, i);
+                        if (v->encoding(c) == column_encoding::varint)
+                            check(!x, "get of a varint column, " + what);
+                        else
+                            check(x && *x == xs[i], "get, " + what);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// overwrites the bytes at offset of the file with those of x.
+template <typename T>
+void poke(size_t offset, T x)
+{
+    std::fstream f(filename, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(std::streamoff(offset));
+    f.write(reinterpret_cast<char const *>(&x), sizeof(x));
+}
+
+void check_corruption()
+{
+    // the count of the first entry of the directory.
+    size_t const count_offset = sizeof(alex::column_file_header) + 16;
+    vector<uint64_t> const zeros(16, 0);
+    for (auto e : {column_encoding::bit_packed, column_encoding::split_halves})
+    {
+        column_file_writer w;
+        w.add(zeros.data(), zeros.size(), e);
+        w.write(filename);
+        poke(count_offset, uint64_t(1) << 60);
+        check(!column_file_view::open(filename), "a column of zeros with a count of 2^60 opened");
+    }
+
+    vector<uint64_t> const xs(100, 0x0123456789abcdefULL);
+    column_file_writer w;
+    w.add(xs.data(), xs.size(), column_encoding::plain);
+    w.write(filename);
+    poke(sizeof(alex::column_file_header) + sizeof(alex::column_file_entry) + 40, char(1));
+    auto v = column_file_view::open(filename);
+    check(v && !v->verify(), "a flipped bit was not found by verify");
+}
+
+int main()
+{
+    std::mt19937_64 g(46);
+    check_halves(g);
+    check_encodings(g);
+    check_corruption();
+    std::remove(filename.c_str());
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,144 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include "cipher_tags/cipher_tag_parse.hpp"
+
+using std::cerr;
+using std::string;
+using std::string_view;
+using std::vector;
+using std::uint64_t;
+using alex::cipher::cipher_tag_column;
+using alex::cipher::parse_cipher_tags;
+
+/**
+ * Checks parse_cipher_tags (see "make check") against strtoull:
+ *
+ *  - on random decimal numbers of every length from 1 to 20 digits, up to
+ *    UINT64_MAX, zero-padded numbers of more than 20 digits and hex
+ *    numbers, separated by runs of every kind of whitespace, with the
+ *    buffer ending right after a number or after whitespace;
+ *  - that a number out of range, a token that is not a number and a
+ *    secret without a value are errors at the offset of the token at
+ *    fault.
+ */
+
+int failures = 0;
+
+void check(bool ok, string const & what)
+{
+    if (!ok)
+    {
+        cerr << "check_tag_parse: " << what << "\n";
+        ++failures;
+    }
+}
+
+// the text of a random number, in one of the forms parse_cipher_tags
+// reads.
+string random_number(std::mt19937_64 & g)
+{
+    switch (g() % 5)
+    {
+    case 0:
+    {
+        // 1 to 20 digits, below 10^digits.
+        size_t const digits = 1 + g() % 20;
+        uint64_t x = g();
+        if (digits < 20)
+        {
+            uint64_t p = 1;
+            for (size_t i = 0; i < digits; ++i)
+                p *= 10;
+            x %= p;
+        }
+        return std::to_string(x);
+    }
+    case 1:
+        return string(g() % 12, '0') + std::to_string(g() >> (g() % 64));
+    case 2:
+    {
+        char buf[24];
+        std::snprintf(buf, sizeof(buf), g() % 2 ? "0x%llx" : "0X%llX", (unsigned long long)(g() >> (g() % 64)));
+        return buf;
+    }
+    case 3:
+        return std::to_string(UINT64_MAX - g() % 1000);
+    default:
+        return std::to_string(g() % 10);
+    }
+}
+
+string random_space(std::mt19937_64 & g)
+{
+    static char const spaces[] = {' ', '\n', '\t', '\r'};
+    string s(1 + g() % 3, ' ');
+    for (auto & c : s)
+        c = spaces[g() % 4];
+    return s;
+}
+
+void check_numbers(std::mt19937_64 & g)
+{
+    for (int round = 0; round < 200; ++round)
+    {
+        string text;
+        vector<uint64_t> expected;
+        size_t const tags = g() % 200;
+        for (size_t i = 0; i < 2 * tags; ++i)
+        {
+            if (i != 0 || g() % 2)
+                text += random_space(g);
+            string const x = random_number(g);
+            bool const hex = x.size() > 1 && (x[1] == 'x' || x[1] == 'X');
+            expected.push_back(std::strtoull(x.c_str() + (hex ? 2 : 0), nullptr, hex ? 16 : 10));
+            text += x;
+        }
+        if (g() % 2)
+            text += random_space(g);
+
+        cipher_tag_column c;
+        auto const r = parse_cipher_tags(text, c);
+        check(bool(r) && r.tags == tags && c.size() == tags, "parse of " + std::to_string(tags) + " tags");
+        for (size_t i = 0; i < c.size() && i < tags; ++i)
+            check(c.secrets()[i] == expected[2 * i] && c.values()[i] == expected[2 * i + 1],
+                "tag " + std::to_string(i) + " of " + text);
+    }
+}
+
+// parses text, which has an error at offset.
+void check_error(string_view text, char const * error, size_t offset, size_t tags)
+{
+    cipher_tag_column c;
+    auto const r = parse_cipher_tags(text, c);
+    check(!r && r.error != nullptr && std::strcmp(r.error, error) == 0 &&
+          r.error_offset == offset && r.tags == tags && c.size() == tags,
+          "error \"" + string(error) + "\" in \"" + string(text) + "\"");
+}
+
+int main()
+{
+    std::mt19937_64 g(44);
+    check_numbers(g);
+
+    check_error("1 18446744073709551616", "number out of range", 2, 0);
+    check_error("1 2 99999999999999999999", "number out of range", 4, 1);
+    check_error("1 0x10000000000000000", "number out of range", 2, 0);
+    check_error("1 2\n3 12a", "not a number", 6, 1);
+    check_error("1 -2", "not a number", 2, 0);
+    check_error("1 2 3", "a secret without a value", 4, 1);
+    check_error("1 2 3 ", "a secret without a value", 4, 1);
+
+    cipher_tag_column c;
+    auto const r = parse_cipher_tags("000000000000000000000000018446744073709551615 0x0", c);
+    check(bool(r) && c.size() == 1 && c.secrets()[0] == UINT64_MAX && c.values()[0] == 0,
+        "UINT64_MAX with leading zeros");
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -9,6 +9,32 @@
  *      .
  *      .
  * keyn     valuen
+ *
+ * Lookups scan the key-value file unless it has an index, the file
+ * <key-value-file>.idx built by "kvs <key-value-file> --build-index", in
+ * which case a lookup is a hash probe; see kvs/kvs_index.hpp. An index is
+ * only used if it was built from the current version of the file.
+ *
+ * "--keys" looks up all of its keys in one scan of the key-value file (or
+ * with the index); see kvs/kvs_lookup.hpp.
+ *
+ * Writes are appended to the log <key-value-file>.log and are merged into
+ * the key-value file by compaction, which runs in the background once the
+ * log is large enough (or by "kvs <key-value-file> --compact"); see
+ * kvs/kvs_store.hpp.
+ *
+ * "kvs <key-value-file> --build-cipher <file> --secret <secret>" builds a
+ * cipher store of the key-value file, which maps the trapdoors of the keys
+ * (under the secret) to the values and does not store the keys. It is read
+ * with "kvs <file> --cipher --secret <secret> ..."; see kvs/kvs_cipher.hpp.
+ *
+ * "kvs <key-value-file> --import <input>" replaces the store by the records
+ * of <input>, parsing, writing and indexing them with a thread per core;
+ * see kvs/kvs_import.hpp.
+ *
+ * "kvs <key-value-file> --build-blocks <file>" writes the records, sorted
+ * by key, into zlib-compressed blocks, and "kvs <file> --blocks ..." reads
+ * them through an LRU block cache (--cache-mb); see kvs/kvs_blocks.hpp.
  */
 
 #include <iostream>
@@ -22,6 +48,15 @@
 #include <utility>
 #include <fstream>
 #include <set>
+#include <optional>
+#include "kvs/kvs_format.hpp"
+#include "kvs/kvs_index.hpp"
+#include "kvs/kvs_lookup.hpp"
+#include "kvs/kvs_store.hpp"
+#include "kvs/kvs_cipher.hpp"
+#include "kvs/kvs_import.hpp"
+#include "kvs/kvs_blocks.hpp"
+#include "mapped_file.hpp"
 
 using std::string;
 using std::pair;
@@ -33,13 +68,36 @@ using std::string_view;
 using std::vector;
 using std::set;
 using std::cerr;
+using std::optional;
+using std::nullopt;
+using alex::mapped_file;
+using alex::kvs::record;
+using alex::kvs::parse_record;
+using alex::kvs::build_index;
+using alex::kvs::store;
+using alex::kvs::mutation;
+using alex::kvs::cipher_store;
+using alex::kvs::build_cipher_store;
+using alex::kvs::import_file;
+using alex::kvs::block_cache;
+using alex::kvs::block_segment;
+using alex::kvs::build_block_segment;
 
 void output_info(string_view prog)
 {
     cout    << "Key-value store\n"
             << "---------------\n"
             << "\"" << prog << " --key-value-file <file> --key <key> <value>\" stores <value> at <key> in <key-value-file>.\n"
-            << "\"" << prog << " --key-value-file <file> --keys <keys>\" retrieves values corresponding to each key in <keys> in <key-value-file>.\n"
+            << "\"" << prog << " --key-value-file <file> --keys <keys>\" retrieves values corresponding to each key in <keys> in <key-value-file>,\n"
+            << "    in the order of <keys>; keys that are not found are reported on standard error.\n"
+            << "\"" << prog << " --key-value-file <file> --delete <key>\" deletes <key> from <key-value-file>.\n"
+            << "\"" << prog << " --key-value-file <file> --compact\" merges the writes logged in <file>.log into <key-value-file>.\n"
+            << "\"" << prog << " --key-value-file <file> --build-index\" builds an index of <key-value-file> for fast lookups.\n"
+            << "\"" << prog << " --key-value-file <file> --import <input>\" loads the records of <input> into a fresh <key-value-file>.\n"
+            << "\"" << prog << " --key-value-file <file> --build-blocks <out>\" builds a block-compressed segment <out> of <key-value-file>.\n"
+            << "\"" << prog << " --key-value-file <out> --blocks --keys <keys>\" looks up <keys> in the block-compressed segment <out>.\n"
+            << "\"" << prog << " --key-value-file <file> --build-cipher <out> --secret <s>\" builds a cipher store <out> of <key-value-file>.\n"
+            << "\"" << prog << " --key-value-file <out> --cipher --secret <s> --keys <keys>\" looks up <keys> in the cipher store <out>.\n"
             << "\n"
             << prog << " accepts command-line arguments or standard input, e.g.,\n"
             << "all of the following are equivalent:\n"
@@ -62,8 +120,13 @@ int main(
     namespace po = boost::program_options;
 
     string key_value_file;
-    vector<string> keys;
+    vector<string> keys, deletes;
     string key, value;
+    unsigned threads;
+    string cipher_file, secret;
+    string import_input;
+    string blocks_file;
+    uint64_t cache_mb;
 
     // Declare the supported options.
     po::options_description desc(string(argv[0]) + " [options]");
@@ -83,7 +146,31 @@ int main(
 
         ("value", po::value<string>(&value), "value to set for corresponding key")
 
-        ("keys", po::value<vector<string>>(&keys), "keys to lookup the corresponding values for")
+        ("keys", po::value<vector<string>>(&keys)->multitoken(), "keys to lookup the corresponding values for (\"-\" to read them from standard input)")
+
+        ("threads", po::value<unsigned>(&threads)->default_value(0), "threads to scan the key-value file with for --keys, or to --import with (0 to choose)")
+
+        ("delete", po::value<vector<string>>(&deletes)->multitoken(), "keys to delete")
+
+        ("compact", "merge the log of writes into the key-value file")
+
+        ("build-index", "build the index of the key-value file (<key-value-file>.idx)")
+
+        ("import", po::value<string>(&import_input), "replace the key-value file by the records of a key-value file, in parallel (see --threads)")
+
+        ("build-cipher", po::value<string>(&cipher_file), "build a cipher store of the key-value file")
+
+        ("cipher", "the key-value file is a cipher store")
+
+        ("build-blocks", po::value<string>(&blocks_file), "build a block-compressed segment of the key-value file")
+
+        ("blocks", "the key-value file is a block-compressed segment")
+
+        ("cache-mb", po::value<uint64_t>(&cache_mb)->default_value(64), "the memory budget of the block cache (MB)")
+
+        ("stats", "report block cache statistics")
+
+        ("secret", po::value<string>(&secret), "the secret of the cipher store (default: $KVS_SECRET)")
 
         ;
 
@@ -114,70 +201,334 @@ int main(
         return EXIT_FAILURE;
     }
 
-    if (vm.count("key") && vm.count("value"))
+    if (secret.empty())
     {
-        std::fstream f(key_value_file); // use option std::ios_base::binary if necessary
-        
-        //f.seekp(position_of_data_to_overwrite, std::ios_base::beg);
-        //f.write(my_data, size_of_data_to_overwrite);     
+        if (char const * s = std::getenv("KVS_SECRET"))
+            secret = s;
+    }
 
-        string k;
-        while (f >> k)
+    if (vm.count("cipher") || vm.count("build-cipher"))
+    {
+        if (secret.empty())
         {
-            if (k == key)
-            {
-            }
+            cerr << "No secret specified.\n";
+            return EXIT_FAILURE;
         }
     }
-    else if (vm.count("key")) // && vm.count("value") == 0
+
+    if (vm.count("build-cipher"))
     {
-        std::ifstream f(key_value_file); // use option std::ios_base::binary if necessary
-        
-        string k;
-        while (f >> k)
+        auto s = store::open(key_value_file, false);
+        if (!s)
+        {
+            cerr << "Failed to open " << key_value_file << ".\n";
+            return EXIT_FAILURE;
+        }
+
+        bool ok = s->read([&](alex::kvs::snapshot const & snap)
         {
-            if (k == key)
+            vector<record> records;
+            snap.for_each([&](record const & r) { records.push_back(r); });
+            return build_cipher_store(cipher_file, records, secret);
+        });
+        if (!ok)
+        {
+            cerr << "Failed to build the cipher store " << cipher_file << ".\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (vm.count("build-blocks"))
+    {
+        auto s = store::open(key_value_file, false);
+        if (!s)
+        {
+            cerr << "Failed to open " << key_value_file << ".\n";
+            return EXIT_FAILURE;
+        }
+
+        bool ok = s->read([&](alex::kvs::snapshot const & snap)
+        {
+            vector<record> records;
+            snap.for_each([&](record const & r) { records.push_back(r); });
+            return build_block_segment(blocks_file, std::move(records));
+        });
+        if (!ok)
+        {
+            cerr << "Failed to build the block segment " << blocks_file << ".\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (vm.count("blocks"))
+    {
+        block_cache cache(cache_mb << 20);
+        auto b = block_segment::open(key_value_file, cache);
+        if (!b)
+        {
+            cerr << "Failed to open the block segment " << key_value_file << ".\n";
+            return EXIT_FAILURE;
+        }
+
+        size_t missing = 0;
+        if (vm.count("all"))
+        {
+            b->for_each([&](record const & r)
             {
-                string v;
-                f >> v;
                 if (vm.count("pair"))
-                    cout << k << "\t" << v << "\n";
+                    cout << r.key << "\t" << r.value << "\n";
                 else
-                    cout << v << "\n";
-                break;
+                    cout << r.value << "\n";
+            });
+        }
+        else
+        {
+            if (vm.count("key"))
+                keys.insert(keys.begin(), key);
+            else if (keys.size() == 1 && keys[0] == "-")
+            {
+                keys.clear();
+                string k;
+                while (cin >> k)
+                    keys.push_back(k);
+            }
+
+            auto values = b->get(vector<string_view>(keys.begin(), keys.end()));
+            for (size_t i = 0; i < keys.size(); ++i)
+            {
+                if (!values[i])
+                {
+                    cerr << "Key not found: " << keys[i] << "\n";
+                    ++missing;
+                    continue;
+                }
+                if (vm.count("pair"))
+                    cout << keys[i] << "\t" << *values[i] << "\n";
+                else
+                    cout << *values[i] << "\n";
             }
         }
+
+        if (vm.count("stats"))
+        {
+            cerr << "Block cache: " << cache.hits() << " hits, " << cache.misses()
+                 << " misses (hit rate " << cache.hit_rate() << "), "
+                 << cache.size() / 1024 << " of " << cache.capacity() / 1024 << " KB used.\n";
+        }
+        return missing == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
     }
-    else if (vm.count("all"))
+
+    if (vm.count("cipher"))
     {
-        std::ifstream f(key_value_file);
-        string k, v;
-        while (f >> k)
+        auto c = cipher_store::open(key_value_file, secret);
+        if (!c)
+        {
+            cerr << "Failed to open the cipher store " << key_value_file << " (or wrong secret).\n";
+            return EXIT_FAILURE;
+        }
+
+        if (vm.count("key"))
+            keys.insert(keys.begin(), key);
+        else if (keys.size() == 1 && keys[0] == "-")
+        {
+            keys.clear();
+            string k;
+            while (cin >> k)
+                keys.push_back(k);
+        }
+        else if (keys.empty())
+        {
+            cerr << "A cipher store only supports lookups (--key or --keys).\n";
+            return EXIT_FAILURE;
+        }
+
+        auto values = c->get(vector<string_view>(keys.begin(), keys.end()));
+        size_t missing = 0;
+        for (size_t i = 0; i < keys.size(); ++i)
         {
-            f >> v;
+            if (!values[i])
+            {
+                cerr << "Key not found: " << keys[i] << "\n";
+                ++missing;
+                continue;
+            }
             if (vm.count("pair"))
-                cout << k << "\t" << v << "\n";
+                cout << keys[i] << "\t" << *values[i] << "\n";
             else
-                cout << v << "\n";
+                cout << *values[i] << "\n";
         }
-        f.close();
+        return missing == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // compacts the store in a child process, so that this one may exit.
+    auto compact_if_needed = [](store & s)
+    {
+        if (s.needs_compaction() && ::fork() == 0)
+        {
+            ::setsid();
+            ::_exit(s.compact() ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    };
+
+    if (vm.count("key") && vm.count("value"))
+    {
+        auto s = store::open(key_value_file);
+        if (!s || !s->set(key, value))
+        {
+            cerr << "Failed to set " << key << " in " << key_value_file << ".\n";
+            return EXIT_FAILURE;
+        }
+        compact_if_needed(*s);
+    }
+    else if (vm.count("delete"))
+    {
+        auto s = store::open(key_value_file);
+        vector<mutation> batch;
+        for (auto const & k : deletes)
+            batch.push_back(mutation{k, nullopt});
+        if (!s || !s->write(batch))
+        {
+            cerr << "Failed to delete from " << key_value_file << ".\n";
+            return EXIT_FAILURE;
+        }
+        compact_if_needed(*s);
+    }
+    else if (vm.count("compact"))
+    {
+        auto s = store::open(key_value_file);
+        if (!s || !s->compact())
+        {
+            cerr << "Failed to compact " << key_value_file << ".\n";
+            return EXIT_FAILURE;
+        }
+    }
+    else if (vm.count("import"))
+    {
+        auto report = [](string_view phase, uint64_t done, uint64_t total)
+        {
+            cerr << "\r" << phase << ": " << (total == 0 ? 100 : 100 * done / total) << "%   ";
+            if (done == total)
+                cerr << "\n";
+        };
+
+        auto s = import_file(import_input, key_value_file, threads, report);
+        if (!s)
+        {
+            cerr << "Failed to import " << import_input << " into " << key_value_file << ".\n";
+            return EXIT_FAILURE;
+        }
+        cerr << "Imported " << s->records << " records (" << s->keys << " keys), "
+             << s->bytes_in / 1000000 << " MB in " << s->seconds << " s ("
+             << uint64_t(double(s->bytes_in) / 1e6 / s->seconds) << " MB/s).\n";
+    }
+    else if (vm.count("build-index"))
+    {
+        mapped_file data(key_value_file);
+        if (!build_index(key_value_file, string_view(data.data(), data.size())))
+        {
+            cerr << "Failed to build the index of " << key_value_file << ".\n";
+            return EXIT_FAILURE;
+        }
+    }
+    else if (vm.count("key")) // && vm.count("value") == 0
+    {
+        auto s = store::open(key_value_file, false);
+        if (!s)
+        {
+            cerr << "Failed to open " << key_value_file << ".\n";
+            return EXIT_FAILURE;
+        }
+
+        if (auto v = s->get(key))
+        {
+            if (vm.count("pair"))
+                cout << key << "\t" << *v << "\n";
+            else
+                cout << *v << "\n";
+        }
+    }
+    else if (vm.count("all"))
+    {
+        auto s = store::open(key_value_file, false);
+        if (!s)
+        {
+            cerr << "Failed to open " << key_value_file << ".\n";
+            return EXIT_FAILURE;
+        }
+
+        s->for_each([&](record const & r)
+        {
+            if (vm.count("pair"))
+                cout << r.key << "\t" << r.value << "\n";
+            else
+                cout << r.value << "\n";
+        });
     }
     else if (vm.count("keys"))
     {
-        std::ifstream f(key_value_file);
-        string k, v;
-        while (f >> k)
+        if (keys.size() == 1 && keys[0] == "-")
+        {
+            keys.clear();
+            string k;
+            while (cin >> k)
+                keys.push_back(k);
+        }
+
+        auto s = store::open(key_value_file, false);
+        if (!s)
         {
-            if (set<string>(keys.begin(),keys.end()).count(k) != 0)
+            cerr << "Failed to open " << key_value_file << ".\n";
+            return EXIT_FAILURE;
+        }
+
+        auto values = s->get(vector<string_view>(keys.begin(), keys.end()), threads);
+
+        size_t missing = 0;
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            if (!values[i])
             {
-                f >> v;
-                if (vm.count("pair"))
-                    cout << k << "\t" << v << "\n";
-                else
-                    cout << v << "\n";
+                cerr << "Key not found: " << keys[i] << "\n";
+                ++missing;
+                continue;
             }
+            if (vm.count("pair"))
+                cout << keys[i] << "\t" << *values[i] << "\n";
+            else
+                cout << *values[i] << "\n";
+        }
+        if (missing != 0)
+            return EXIT_FAILURE;
+    }
+    else if (!::isatty(STDIN_FILENO))
+    {
+        // "key value" lines from standard input, written as one batch.
+        auto s = store::open(key_value_file);
+        if (!s)
+        {
+            cerr << "Failed to open " << key_value_file << ".\n";
+            return EXIT_FAILURE;
+        }
+
+        string line;
+        vector<string> lines;
+        while (std::getline(cin, line))
+            lines.push_back(line);
+
+        vector<mutation> batch;
+        for (auto const & l : lines)
+        {
+            if (auto r = parse_record(l))
+                batch.push_back(mutation{r->key, r->value});
+        }
+        if (!s->write(batch))
+        {
+            cerr << "Failed to write to " << key_value_file << ".\n";
+            return EXIT_FAILURE;
         }
-        f.close();
+        compact_if_needed(*s);
     }
     else
     {